@@ -96,6 +96,8 @@ crud::crud(std::shared_ptr<bzn::asio::io_context_base> io_context,
                  {database_msg::kExpire,        std::bind(&crud::handle_expire,         this, _1, _2, _3)}}
            , owner_public_key(std::move(owner_public_key))
 {
+    // expiry times are taken from each node's own clock...
+    this->storage->set_local_namespaces({TTL_UUID});
 }
 
 
@@ -1081,11 +1083,11 @@ crud::remove_writers(const database_msg& request, Json::Value& perms)
 
 
 bool
-crud::save_state()
+crud::save_state(uint64_t checkpoint)
 {
     std::lock_guard<std::shared_mutex> lock(this->crud_lock); // lock for write access
 
-    return this->storage->create_snapshot();
+    return this->storage->create_snapshot(checkpoint);
 }
 
 
@@ -1099,11 +1101,58 @@ crud::get_saved_state()
 
 
 bool
-crud::load_state(const std::string& state)
+crud::load_state(const std::string& state, const bzn::hash_t& state_hash)
 {
     std::lock_guard<std::shared_mutex> lock(this->crud_lock); // lock for write access
 
-    return this->storage->load_snapshot(state);
+    return this->storage->load_snapshot(state, state_hash);
+}
+
+
+std::optional<bzn::snapshot_chunk_t>
+crud::get_saved_state_chunk(uint64_t checkpoint, uint64_t offset, size_t max_size)
+{
+    std::shared_lock<std::shared_mutex> lock(this->crud_lock); // lock for read access
+
+    return this->storage->get_snapshot_chunk(checkpoint, offset, max_size);
+}
+
+
+bool
+crud::load_state_chunk(uint64_t checkpoint, uint64_t offset, const std::string& chunk, uint64_t total_size,
+    bool delta, const bzn::hash_t& state_hash)
+{
+    std::lock_guard<std::shared_mutex> lock(this->crud_lock); // lock for write access
+
+    return this->storage->load_snapshot_chunk(checkpoint, offset, chunk, total_size, delta, state_hash);
+}
+
+
+std::vector<bzn::hash_t>
+crud::get_state_manifest()
+{
+    std::shared_lock<std::shared_mutex> lock(this->crud_lock); // lock for read access
+
+    return this->storage->get_state_manifest();
+}
+
+
+std::optional<bzn::snapshot_chunk_t>
+crud::get_saved_state_delta_chunk(uint64_t checkpoint, const std::vector<bzn::hash_t>& manifest, uint64_t offset,
+    size_t max_size)
+{
+    std::shared_lock<std::shared_mutex> lock(this->crud_lock); // lock for read access
+
+    return this->storage->get_snapshot_delta_chunk(checkpoint, manifest, offset, max_size);
+}
+
+
+bzn::hash_t
+crud::get_state_hash()
+{
+    std::shared_lock<std::shared_mutex> lock(this->crud_lock); // lock for read access
+
+    return this->storage->get_state_hash();
 }
 
 
@@ -40,11 +40,24 @@ namespace bzn
 
         void start(std::shared_ptr<bzn::pbft_base> pbft, size_t max_storage = 0) override;
 
-        bool save_state() override;
+        bool save_state(uint64_t checkpoint = 0) override;
 
         std::shared_ptr<std::string> get_saved_state() override;
 
-        bool load_state(const std::string& state) override;
+        bool load_state(const std::string& state, const bzn::hash_t& state_hash = {}) override;
+
+        std::optional<bzn::snapshot_chunk_t> get_saved_state_chunk(uint64_t checkpoint, uint64_t offset,
+            size_t max_size) override;
+
+        bool load_state_chunk(uint64_t checkpoint, uint64_t offset, const std::string& chunk,
+            uint64_t total_size, bool delta, const bzn::hash_t& state_hash = {}) override;
+
+        std::vector<bzn::hash_t> get_state_manifest() override;
+
+        std::optional<bzn::snapshot_chunk_t> get_saved_state_delta_chunk(uint64_t checkpoint,
+            const std::vector<bzn::hash_t>& manifest, uint64_t offset, size_t max_size) override;
+
+        bzn::hash_t get_state_hash() override;
 
         bzn::json_message get_status() override;
 
@@ -17,6 +17,7 @@
 #include <include/bluzelle.hpp>
 #include <node/session_base.hpp>
 #include <proto/database.pb.h>
+#include <storage/storage_base.hpp>
 
 namespace bzn
 {
@@ -31,11 +32,24 @@ namespace bzn
 
         virtual void start(std::shared_ptr<bzn::pbft_base> pbft, size_t max_storage) = 0;
 
-        virtual bool save_state() = 0;
+        virtual bool save_state(uint64_t checkpoint = 0) = 0;
 
         virtual std::shared_ptr<std::string> get_saved_state() = 0;
 
-        virtual bool load_state(const std::string& state) = 0;
+        virtual bool load_state(const std::string& state, const bzn::hash_t& state_hash = {}) = 0;
+
+        virtual std::optional<bzn::snapshot_chunk_t> get_saved_state_chunk(uint64_t checkpoint, uint64_t offset,
+            size_t max_size) = 0;
+
+        virtual bool load_state_chunk(uint64_t checkpoint, uint64_t offset, const std::string& chunk,
+            uint64_t total_size, bool delta, const bzn::hash_t& state_hash = {}) = 0;
+
+        virtual std::vector<bzn::hash_t> get_state_manifest() = 0;
+
+        virtual std::optional<bzn::snapshot_chunk_t> get_saved_state_delta_chunk(uint64_t checkpoint,
+            const std::vector<bzn::hash_t>& manifest, uint64_t offset, size_t max_size) = 0;
+
+        virtual bzn::hash_t get_state_hash() = 0;
     };
 
 } // namespace bzn
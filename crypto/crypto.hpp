@@ -21,6 +21,11 @@
 #include <openssl/evp.h>
 #include <openssl/ec.h>
 #include <monitor/monitor_base.hpp>
+#include <peers_beacon/peers_beacon_base.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <mutex>
+#include <list>
+#include <unordered_map>
 
 namespace bzn
 {
@@ -28,16 +33,21 @@ namespace bzn
     {
     public:
 
-        crypto(std::shared_ptr<bzn::options_base> options, std::shared_ptr<bzn::monitor_base> monitor);
+        crypto(std::shared_ptr<bzn::options_base> options, std::shared_ptr<bzn::monitor_base> monitor,
+            std::shared_ptr<bzn::peers_beacon_base> peers = nullptr);
 
         bool sign(bzn_envelope& msg) override;
 
         bool verify(const bzn_envelope& msg) override;
 
+        std::vector<bool> verify_batch(const std::vector<const bzn_envelope*>& msgs) override;
+
         std::string hash(const std::string& msg) override;
 
         std::string hash(const bzn_envelope& msg) override;
 
+        std::vector<std::string> hash_batch(const std::vector<const bzn_envelope*>& msgs) override;
+
     private:
 
         using EC_KEY_ptr_t = std::unique_ptr<EC_KEY, decltype(&::EC_KEY_free)>;
@@ -47,18 +57,53 @@ namespace bzn
 
         bool load_private_key();
 
+        EVP_PKEY_ptr_t parse_public_key(const std::string& sender);
+
+        std::shared_ptr<EVP_PKEY> public_key(const std::string& sender);
+
+        // requires key_cache_lock
+        bool pin_peer_key(const std::string& sender, const std::shared_ptr<EVP_PKEY>& key);
+
+        bool verify_with_key(const bzn_envelope& msg, EVP_PKEY* key, EVP_MD_CTX* context);
+
+        std::string hash_envelope(const bzn_envelope& msg, EVP_MD_CTX* context, size_t& msg_length);
+
+        boost::asio::thread_pool& verifier_pool();
+
         void log_openssl_errors();
 
         const std::string& extract_payload(const bzn_envelope& msg);
 
+        // feeds the deterministic serialization of msg to update piece by piece, stopping if update returns false
+        template <typename Update>
+        bool serialize_pieces(const bzn_envelope& msg, Update&& update, size_t& length);
+
+        // only for diagnostics; signing, verifying and hashing stream the pieces instead
         const std::string deterministic_serialize(const bzn_envelope& msg);
 
         std::shared_ptr<bzn::options_base> options;
         std::shared_ptr<bzn::monitor_base> monitor;
+        std::shared_ptr<bzn::peers_beacon_base> peers;
 
         EVP_PKEY_ptr_t private_key_EVP = EVP_PKEY_ptr_t(nullptr, &EVP_PKEY_free);
         EC_KEY_ptr_t private_key_EC = EC_KEY_ptr_t(nullptr, &EC_KEY_free);
 
+        // parsed keys of recent senders, most recently used first; entries are shared so that eviction can't free
+        // a key that another thread is verifying with
+        using key_cache_entry_t = std::pair<std::string, std::shared_ptr<EVP_PKEY>>;
+        std::mutex key_cache_lock;
+        std::list<key_cache_entry_t> key_cache;
+        std::unordered_map<std::string, std::list<key_cache_entry_t>::iterator> key_cache_index;
+
+        // keys of the current peers are held apart from the other senders, so no number of those can push them out
+        std::unordered_map<std::string, std::shared_ptr<EVP_PKEY>> peer_keys;
+        std::shared_ptr<const bzn::peers_list_t> peer_keys_list;
+
+        // started on the first batch large enough to split
+        const size_t verifier_pool_size;
+        std::once_flag verifier_pool_once;
+        std::unique_ptr<boost::asio::thread_pool> verifier_pool_ptr;
+
     };
 }
 
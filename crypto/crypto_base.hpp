@@ -15,6 +15,7 @@
 #pragma once
 
 #include <proto/bluzelle.pb.h>
+#include <vector>
 
 namespace bzn
 {
@@ -35,6 +36,13 @@ namespace bzn
          */
         virtual bool verify(const bzn_envelope& msg) = 0;
 
+        /*
+         * verify the signatures on many messages together, which is cheaper than verifying them one at a time
+         * @msgs messages to verify
+         * @return for each message (in order), whether its signature is present, valid and matches its sender
+         */
+        virtual std::vector<bool> verify_batch(const std::vector<const bzn_envelope*>& msgs) = 0;
+
         /*
          * Compute the hash of some string
          * @msg data
@@ -48,6 +56,13 @@ namespace bzn
          */
         virtual std::string hash(const bzn_envelope& msg) = 0;
 
+        /*
+         * hash many messages together, which is cheaper than hashing them one at a time
+         * @msgs messages to hash
+         * @return the hash of each message, in order
+         */
+        virtual std::vector<std::string> hash_batch(const std::vector<const bzn_envelope*>& msgs) = 0;
+
         virtual ~crypto_base() = default;
     };
 }
@@ -0,0 +1,63 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <include/bluzelle.hpp>
+#include <cstdint>
+#include <cstring>
+
+namespace bzn
+{
+    /*
+     * Cheap 64 bit FNV-1a hash for in-memory lookups. It is not collision resistant, so it must never be sent to
+     * another node or persisted - use crypto_base::hash for that.
+     * @data bytes to hash
+     * @size number of bytes
+     * @return hash value
+     */
+    inline uint64_t
+    local_hash(const void* data, size_t size)
+    {
+        uint64_t result = 14695981039346656037ull;
+        const auto bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i)
+        {
+            result = (result ^ bytes[i]) * 1099511628211ull;
+        }
+
+        return result;
+    }
+
+    /*
+     * Hasher for unordered containers keyed on bzn::hash_t values that we computed ourselves. Those are already
+     * uniformly distributed, so their leading bytes make a perfectly good bucket index without rehashing them.
+     */
+    struct digest_hasher
+    {
+        size_t
+        operator()(const bzn::hash_t& digest) const noexcept
+        {
+            if (digest.size() < sizeof(size_t))
+            {
+                return static_cast<size_t>(local_hash(digest.data(), digest.size()));
+            }
+
+            size_t result;
+            std::memcpy(&result, digest.data(), sizeof(result));
+            return result;
+        }
+    };
+}
@@ -13,13 +13,17 @@
 // along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include <crypto/crypto.hpp>
+#include <crypto/local_hash.hpp>
 #include <mocks/mock_options_base.hpp>
 #include <mocks/mock_monitor.hpp>
+#include <mocks/smart_mock_peers_beacon.hpp>
 #include <options/options.hpp>
 #include <gtest/gtest.h>
 #include <proto/bluzelle.pb.h>
 #include <fstream>
 #include <boost/range/irange.hpp>
+#include <chrono>
+#include <iostream>
 
 using namespace ::testing;
 
@@ -169,6 +173,222 @@ TEST_F(crypto_test, bad_sender_caught)
     EXPECT_FALSE(crypto->verify(msg3));
 }
 
+TEST_F(crypto_test, verify_batch_agrees_with_verify)
+{
+    // enough messages that the batch is shared out across the verifier pool
+    std::vector<bzn_envelope> msgs(64, msg);
+    for (size_t i = 0; i < msgs.size(); ++i)
+    {
+        msgs[i].set_timestamp(i);
+        EXPECT_TRUE(crypto->sign(msgs[i]));
+
+        switch (i % 3)
+        {
+            case 1:
+                msgs[i].set_signature("a" + msgs[i].signature());
+                break;
+            case 2:
+                msgs[i].set_sender('a' + msgs[i].sender());
+                break;
+            default:
+                break;
+        }
+    }
+
+    std::vector<const bzn_envelope*> batch;
+    for (const auto& m : msgs)
+    {
+        batch.push_back(&m);
+    }
+
+    const auto results = crypto->verify_batch(batch);
+    ASSERT_EQ(results.size(), msgs.size());
+    for (size_t i = 0; i < msgs.size(); ++i)
+    {
+        EXPECT_EQ(results[i], i % 3 == 0);
+        EXPECT_EQ(results[i], crypto->verify(msgs[i]));
+    }
+
+    EXPECT_TRUE(crypto->verify_batch({}).empty());
+}
+
+TEST_F(crypto_test, sender_keys_are_cached)
+{
+    this->options->get_mutable_simple_options().set(bzn::option_names::CRYPTO_KEY_CACHE_SIZE, "1");
+
+    bzn_envelope bad_sender = msg;
+
+    EXPECT_CALL(*this->monitor, send_counter(_, _)).Times(AnyNumber());
+    {
+        InSequence dummy;
+
+        // signing verifies our own signature, which brings our key into the cache
+        EXPECT_CALL(*this->monitor, send_counter(bzn::statistic::key_cache_miss, _));
+        EXPECT_CALL(*this->monitor, send_counter(bzn::statistic::key_cache_hit, _));
+        EXPECT_CALL(*this->monitor, send_counter(bzn::statistic::key_cache_miss, _));
+        EXPECT_CALL(*this->monitor, send_counter(bzn::statistic::key_cache_hit, _));
+    }
+
+    EXPECT_TRUE(crypto->sign(msg));
+    EXPECT_TRUE(crypto->verify(msg));
+
+    bad_sender.set_sender('a' + msg.sender());
+    bad_sender.set_signature(msg.signature());
+
+    // unparseable senders miss every time, and don't evict anything
+    EXPECT_FALSE(crypto->verify(bad_sender));
+    EXPECT_TRUE(crypto->verify(msg));
+}
+
+TEST_F(crypto_test, peer_keys_are_not_evicted_by_other_senders)
+{
+    this->options->get_mutable_simple_options().set(bzn::option_names::CRYPTO_KEY_CACHE_SIZE, "1");
+    this->crypto = std::make_shared<bzn::crypto>(this->options, this->monitor,
+        bzn::static_peers_beacon_for(bzn::peers_list_t{{"127.0.0.1", 8081, "name1", this->options->get_uuid()}}));
+
+    // a well formed key that is not one of our peers
+    bzn_envelope other_sender = msg;
+    other_sender.set_sender("MFYwEAYHKoZIzj0CAQYFK4EEAAoDQgAEBYQGbUPDWeUxRqnT2cbolTM+xb6NSvlx"
+        "Uyl//GZPVUIvG1GWv1JFwZgsHL8AK1Dz5Aq3VJfAcoPRmpB2mYWxyA==");
+
+    EXPECT_CALL(*this->monitor, send_counter(_, _)).Times(AnyNumber());
+    {
+        InSequence dummy;
+
+        EXPECT_CALL(*this->monitor, send_counter(bzn::statistic::key_cache_miss, _));
+        EXPECT_CALL(*this->monitor, send_counter(bzn::statistic::key_cache_hit, _));
+        EXPECT_CALL(*this->monitor, send_counter(bzn::statistic::key_cache_miss, _));
+        EXPECT_CALL(*this->monitor, send_counter(bzn::statistic::key_cache_hit, _)).Times(2);
+    }
+
+    EXPECT_TRUE(crypto->sign(msg));
+    EXPECT_TRUE(crypto->verify(msg));
+
+    // the other sender fills the whole cache, and our key is still there
+    other_sender.set_signature(msg.signature());
+    EXPECT_FALSE(crypto->verify(other_sender));
+    EXPECT_FALSE(crypto->verify(other_sender));
+    EXPECT_TRUE(crypto->verify(msg));
+}
+
+// microbenchmark; run with --gtest_also_run_disabled_tests
+TEST_F(crypto_test, DISABLED_benchmark_verify_batch_against_verify)
+{
+    const size_t MESSAGES = 1000;
+
+    std::vector<bzn_envelope> msgs(MESSAGES, msg);
+    std::vector<const bzn_envelope*> batch;
+    for (size_t i = 0; i < msgs.size(); ++i)
+    {
+        msgs[i].set_timestamp(i);
+        ASSERT_TRUE(crypto->sign(msgs[i]));
+        batch.push_back(&msgs[i]);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& m : msgs)
+    {
+        ASSERT_TRUE(crypto->verify(m));
+    }
+    const auto single = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+    start = std::chrono::steady_clock::now();
+    const auto results = crypto->verify_batch(batch);
+    const auto batched = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+    EXPECT_EQ(std::count(results.begin(), results.end(), true), static_cast<long>(MESSAGES));
+
+    std::cout << MESSAGES << " signatures: verify " << single.count() << "us ("
+        << single.count() / MESSAGES << "us each), verify_batch " << batched.count() << "us ("
+        << batched.count() / MESSAGES << "us each)" << std::endl;
+}
+
+TEST_F(crypto_test, envelope_hash_matches_length_prefixed_serialization)
+{
+    // signatures depend on this exact layout, so it must not change
+    this->msg.set_sender("some sender");
+    this->msg.set_timestamp(12345);
+
+    const std::string payload_case = std::to_string(bzn_envelope::kPbft);
+    const std::string expected = std::to_string(this->msg.sender().size()) + "|" + this->msg.sender()
+        + std::to_string(payload_case.size()) + "|" + payload_case
+        + std::to_string(this->msg.pbft().size()) + "|" + this->msg.pbft()
+        + "5|12345";
+
+    EXPECT_EQ(this->crypto->hash(this->msg), this->crypto->hash(expected));
+}
+
+TEST_F(crypto_test, hash_batch_agrees_with_hash)
+{
+    std::vector<bzn_envelope> msgs(16, msg);
+    std::vector<const bzn_envelope*> batch;
+    for (size_t i = 0; i < msgs.size(); ++i)
+    {
+        msgs[i].set_timestamp(i);
+        batch.push_back(&msgs[i]);
+    }
+
+    const auto hashes = crypto->hash_batch(batch);
+    ASSERT_EQ(hashes.size(), msgs.size());
+    for (size_t i = 0; i < msgs.size(); ++i)
+    {
+        EXPECT_EQ(hashes[i], crypto->hash(msgs[i]));
+    }
+
+    EXPECT_EQ(std::set<std::string>(hashes.begin(), hashes.end()).size(), msgs.size());
+    EXPECT_TRUE(crypto->hash_batch({}).empty());
+}
+
+TEST_F(crypto_test, digest_hasher_handles_digests_and_short_keys)
+{
+    bzn::digest_hasher hasher;
+
+    const auto digest = crypto->hash(msg);
+    EXPECT_EQ(hasher(digest), hasher(std::string(digest)));
+    EXPECT_NE(hasher(digest), hasher(crypto->hash(digest)));
+
+    EXPECT_EQ(hasher("abc"), hasher("abc"));
+    EXPECT_NE(hasher("abc"), hasher("abd"));
+    EXPECT_NE(hasher(""), hasher("a"));
+}
+
+// microbenchmark; run with --gtest_also_run_disabled_tests
+TEST_F(crypto_test, DISABLED_benchmark_hash_consensus_messages)
+{
+    const size_t MESSAGES = 100000;
+
+    std::vector<bzn_envelope> msgs(MESSAGES, msg);
+    std::vector<const bzn_envelope*> batch;
+    for (size_t i = 0; i < msgs.size(); ++i)
+    {
+        msgs[i].set_timestamp(i);
+        batch.push_back(&msgs[i]);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& m : msgs)
+    {
+        crypto->hash(m);
+    }
+    const auto single = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+    start = std::chrono::steady_clock::now();
+    crypto->hash_batch(batch);
+    const auto batched = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+    const auto digest = crypto->hash(msg);
+    size_t sink = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < MESSAGES; ++i)
+    {
+        sink += bzn::local_hash(digest.data(), digest.size()) + i;
+    }
+    const auto local = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+    std::cout << MESSAGES << " messages: hash " << single.count() << "us, hash_batch " << batched.count()
+        << "us, local_hash of their digests " << local.count() << "us (" << sink % 2 << ")" << std::endl;
+}
+
 TEST_F(crypto_test, hash_no_collision)
 {
     /*
@@ -25,12 +25,24 @@ namespace bzn {
             void(const bzn::caller_id_t& caller_id, const database_msg& request, std::shared_ptr<bzn::session_base> session));
         MOCK_METHOD2(start,
             void(std::shared_ptr<bzn::pbft_base> pbft, size_t max_storage));
-        MOCK_METHOD0(save_state,
-            bool());
+        MOCK_METHOD1(save_state,
+            bool(uint64_t checkpoint));
         MOCK_METHOD0(get_saved_state,
             std::shared_ptr<std::string>());
-        MOCK_METHOD1(load_state,
-            bool(const std::string&));
+        MOCK_METHOD2(load_state,
+            bool(const std::string&, const bzn::hash_t&));
+        MOCK_METHOD3(get_saved_state_chunk,
+            std::optional<bzn::snapshot_chunk_t>(uint64_t checkpoint, uint64_t offset, size_t max_size));
+        MOCK_METHOD6(load_state_chunk,
+            bool(uint64_t checkpoint, uint64_t offset, const std::string& chunk, uint64_t total_size, bool delta,
+                const bzn::hash_t& state_hash));
+        MOCK_METHOD0(get_state_manifest,
+            std::vector<bzn::hash_t>());
+        MOCK_METHOD4(get_saved_state_delta_chunk,
+            std::optional<bzn::snapshot_chunk_t>(uint64_t checkpoint, const std::vector<bzn::hash_t>& manifest,
+                uint64_t offset, size_t max_size));
+        MOCK_METHOD0(get_state_hash,
+            bzn::hash_t());
     };
 
 }  // namespace bzn
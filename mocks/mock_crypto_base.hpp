@@ -26,8 +26,12 @@ namespace bzn
 
         MOCK_METHOD1(verify, bool(const bzn_envelope& msg));
 
+        MOCK_METHOD1(verify_batch, std::vector<bool>(const std::vector<const bzn_envelope*>& msgs));
+
         MOCK_METHOD1(hash, std::string(const std::string& msg));
 
         MOCK_METHOD1(hash,  std::string(const bzn_envelope& msg));
+
+        MOCK_METHOD1(hash_batch, std::vector<std::string>(const std::vector<const bzn_envelope*>& msgs));
     };
 }
@@ -27,6 +27,8 @@ namespace bzn {
             void(statistic stat, std::string instance_id));
         MOCK_METHOD2(send_counter,
             void(statistic, uint64_t));
+        MOCK_METHOD2(send_gauge,
+            void(statistic, uint64_t));
     };
 
 }  // namespace bzn
@@ -88,6 +88,14 @@ class mock_options_base : public options_base {
       size_t());
   MOCK_CONST_METHOD0(get_peer_message_signing,
       bool());
+  MOCK_CONST_METHOD0(get_pbft_batch_max_requests,
+      size_t());
+  MOCK_CONST_METHOD0(get_pbft_batch_max_bytes,
+      size_t());
+  MOCK_CONST_METHOD0(get_pbft_batch_max_delay,
+      std::chrono::milliseconds());
+  MOCK_CONST_METHOD0(get_pbft_verifier_threads,
+      size_t());
 };
 
 }  // namespace bzn
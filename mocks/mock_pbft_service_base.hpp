@@ -34,10 +34,18 @@ namespace bzn {
           void(const std::shared_ptr<pbft_operation>&));
       MOCK_METHOD2(apply_operation_now,
           bool(const bzn_envelope& msg, std::shared_ptr<bzn::session_base> session));
-      MOCK_CONST_METHOD1(get_service_state,
-          std::shared_ptr<bzn::service_state_t>(uint64_t sequence_number));
-      MOCK_METHOD2(set_service_state,
-          bool(uint64_t sequence_number, const bzn::service_state_t& data));
+      MOCK_CONST_METHOD3(get_service_state_chunk,
+          std::optional<bzn::snapshot_chunk_t>(uint64_t sequence_number, uint64_t offset, size_t max_size));
+      MOCK_METHOD3(set_service_state,
+          bool(uint64_t sequence_number, const bzn::service_state_t& data, const bzn::hash_t& state_hash));
+      MOCK_CONST_METHOD4(get_service_state_delta_chunk,
+          std::optional<bzn::snapshot_chunk_t>(uint64_t sequence_number, const std::vector<bzn::hash_t>& manifest,
+              uint64_t offset, size_t max_size));
+      MOCK_CONST_METHOD0(get_service_state_manifest,
+          std::vector<bzn::hash_t>());
+      MOCK_METHOD6(set_service_state_chunk,
+          bool(uint64_t sequence_number, uint64_t offset, const bzn::service_state_t& chunk, uint64_t total_size, bool delta,
+              const bzn::hash_t& state_hash));
       MOCK_METHOD1(save_service_state_at,
             void(uint64_t));
     };
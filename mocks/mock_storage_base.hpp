@@ -23,6 +23,8 @@ namespace bzn {
     public:
         MOCK_METHOD3(create,
             bzn::storage_result(const bzn::uuid_t& uuid, const std::string& key, const std::string& value));
+        MOCK_METHOD1(create_batch,
+            bzn::storage_result(const std::vector<bzn::storage_record_t>& records));
         MOCK_METHOD2(read,
             std::optional<bzn::value_t> (const bzn::uuid_t& uuid, const std::string& key));
         MOCK_METHOD3(update,
@@ -47,12 +49,26 @@ namespace bzn {
             std::optional<std::size_t>(const bzn::uuid_t& uuid, const bzn::key_t& key));
         MOCK_METHOD1(remove,
             bzn::storage_result(const bzn::uuid_t& uuid));
-        MOCK_METHOD0(create_snapshot,
-            bool());
+        MOCK_METHOD1(create_snapshot,
+            bool(uint64_t checkpoint));
         MOCK_METHOD0(get_snapshot,
             std::shared_ptr<std::string>());
-        MOCK_METHOD1(load_snapshot,
-            bool(const std::string&));
+        MOCK_METHOD2(load_snapshot,
+            bool(const std::string&, const bzn::hash_t&));
+        MOCK_METHOD3(get_snapshot_chunk,
+            std::optional<bzn::snapshot_chunk_t>(uint64_t checkpoint, uint64_t offset, size_t max_size));
+        MOCK_METHOD6(load_snapshot_chunk,
+            bool(uint64_t checkpoint, uint64_t offset, const std::string& data, uint64_t total_size, bool delta,
+                const bzn::hash_t& state_hash));
+        MOCK_METHOD0(get_state_manifest,
+            std::vector<bzn::hash_t>());
+        MOCK_METHOD4(get_snapshot_delta_chunk,
+            std::optional<bzn::snapshot_chunk_t>(uint64_t checkpoint, const std::vector<bzn::hash_t>& manifest,
+                uint64_t offset, size_t max_size));
+        MOCK_METHOD0(get_state_hash,
+            bzn::hash_t());
+        MOCK_METHOD1(set_local_namespaces,
+            void(const std::vector<bzn::uuid_t>& uuids));
         MOCK_METHOD3(remove_range,
             void(const bzn::uuid_t& uuid, const std::string&, const std::string&));
         MOCK_METHOD4(get_keys_if,
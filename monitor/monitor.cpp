@@ -28,6 +28,8 @@ namespace
                     {statistic::signature_verified, "crypto.signatures_verified"},
                     {statistic::signature_verified_bytes, "crypto.bytes_verified"},
                     {statistic::signature_rejected, "crypto.signatures_rejected"},
+                    {statistic::key_cache_hit, "crypto.key_cache_hits"},
+                    {statistic::key_cache_miss, "crypto.key_cache_misses"},
 
                     {statistic::session_opened, "node.sessions_opened"},
                     {statistic::message_sent, "node.messages_sent"},
@@ -36,10 +38,22 @@ namespace
                     {statistic::pbft_no_primary, "pbft.liveness.no_primary"},
                     {statistic::pbft_primary_alive, "pbft.liveness.primary_alive"},
                     {statistic::pbft_commit, "pbft.liveness.commit"},
+                    {statistic::pbft_window_occupancy, "pbft.pipeline.window_occupancy"},
+                    {statistic::pbft_verification_queue_latency, "pbft.verification.queue_latency"},
+                    {statistic::pbft_verification_latency, "pbft.verification.verify_latency"},
+                    {statistic::pbft_verification_handoff_latency, "pbft.verification.handoff_latency"},
+                    {statistic::pbft_verification_dropped, "pbft.verification.dropped"},
+                    {statistic::pbft_gc_sequences_collected, "pbft.gc.sequences_collected"},
+                    {statistic::pbft_gc_backlog, "pbft.gc.backlog"},
+                    {statistic::pbft_gc_latency, "pbft.gc.latency"},
                     {statistic::pbft_failure_detected, "pbft.liveness.failure_detected"},
                     {statistic::pbft_commit_conflict, "pbft.safety.commit_conflict"},
                     {statistic::pbft_primary_conflict, "pbft.safety.primary_conflict"},
 
+                    {statistic::storage_group_commit_batches, "storage.group_commit.batches"},
+                    {statistic::storage_group_commit_writes, "storage.group_commit.writes"},
+                    {statistic::storage_group_commit_latency, "storage.group_commit.latency"},
+
                     {statistic::request_latency, "total-server-latency"}
             }
     };
@@ -135,12 +149,39 @@ monitor::send_counter(bzn::statistic stat, uint64_t amount)
     }
 }
 
+void
+monitor::send_gauge(bzn::statistic stat, uint64_t value)
+{
+    if (!this->monitor_endpoint)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(this->lock);
+    if (this->options->get_simple_options().get<bool>(option_names::MONITOR_COLLATE))
+    {
+        // intermediate values are superseded, so only the latest one is sent with the batch
+        this->latest_gauges.insert_or_assign(stat, value);
+        this->maybe_send();
+    }
+    else
+    {
+        this->send(this->format_gauge(stat, value));
+    }
+}
+
 std::string
 monitor::format_counter(bzn::statistic stat, uint64_t amount)
 {
     return this->scope_prefix + "." + statistic_names.at(stat) + ":" + std::to_string(amount) + "|c";
 }
 
+std::string
+monitor::format_gauge(bzn::statistic stat, uint64_t value)
+{
+    return this->scope_prefix + "." + statistic_names.at(stat) + ":" + std::to_string(value) + "|g";
+}
+
 void
 monitor::send(const std::string& stat)
 {
@@ -168,6 +209,13 @@ monitor::maybe_send()
             this->send(this->format_counter(pair.first, pair.second));
         }
         this->accumulated_stats.clear();
+
+        for (const auto& pair : this->latest_gauges)
+        {
+            this->send(this->format_gauge(pair.first, pair.second));
+        }
+        this->latest_gauges.clear();
+
         this->time_last_sent = this->clock->microseconds_since_epoch();
     }
 }
@@ -36,16 +36,21 @@ namespace bzn
 
         void send_counter(statistic stat, uint64_t amount = 1) override;
 
+        void send_gauge(statistic stat, uint64_t value) override;
+
     private:
 
         void send(const std::string& stat);
 
         std::string format_counter(statistic stat, uint64_t amount);
 
+        std::string format_gauge(statistic stat, uint64_t value);
+
         void maybe_send();
 
         uint64_t time_last_sent;
         std::unordered_map<statistic, uint64_t> accumulated_stats;
+        std::unordered_map<statistic, uint64_t> latest_gauges;
 
         std::list<std::string> ordered_timers;
         std::unordered_map<std::string, uint64_t> start_times;
@@ -28,6 +28,8 @@ namespace bzn
         signature_verified,
         signature_verified_bytes,
         signature_rejected,
+        key_cache_hit,
+        key_cache_miss,
 
         session_opened,
         message_sent,
@@ -40,6 +42,18 @@ namespace bzn
         pbft_primary_conflict,
 
         pbft_commit,
+        pbft_window_occupancy,
+        pbft_verification_queue_latency,
+        pbft_verification_latency,
+        pbft_verification_handoff_latency,
+        pbft_verification_dropped,
+        pbft_gc_sequences_collected,
+        pbft_gc_backlog,
+        pbft_gc_latency,
+
+        storage_group_commit_batches,
+        storage_group_commit_writes,
+        storage_group_commit_latency,
 
         request_latency
     };
@@ -70,6 +84,13 @@ namespace bzn
          */
         virtual void send_counter(statistic stat, uint64_t amount = 1) = 0;
 
+        /*
+         * Send a gauge statistic; unlike a counter, only the latest value is meaningful
+         * @stat statistic to send
+         * @value current value of that statistic
+         */
+        virtual void send_gauge(statistic stat, uint64_t value) = 0;
+
         virtual ~monitor_base() = default;
     };
 }
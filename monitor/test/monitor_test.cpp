@@ -121,6 +121,36 @@ TEST_F(monitor_test, test_that_counters_emit_metric)
     EXPECT_EQ(this->parse_counter(this->sent_messages.at(1)).second, 15u);
 }
 
+TEST_F(monitor_test, test_that_gauges_emit_metric)
+{
+    this->monitor->send_gauge(bzn::statistic::pbft_window_occupancy, 12u);
+
+    std::regex gauge_regex("^(.*):(\\d*)\\|(.*)$");
+    std::smatch result;
+
+    ASSERT_TRUE(std::regex_match(this->sent_messages.at(0), result, gauge_regex));
+    EXPECT_NE(result[1].str().find("window_occupancy"), std::string::npos);
+    EXPECT_EQ(result[2].str(), "12");
+    EXPECT_EQ(result[3].str(), "g");
+}
+
+TEST_F(monitor_test, test_that_collated_gauges_only_send_latest_value)
+{
+    this->soptions.set(bzn::option_names::MONITOR_COLLATE, "true");
+    this->soptions.set(bzn::option_names::MONITOR_COLLATE_INTERVAL_SECONDS, "1");
+
+    monitor->send_gauge(bzn::statistic::pbft_window_occupancy, 7);
+    monitor->send_gauge(bzn::statistic::pbft_window_occupancy, 3);
+
+    EXPECT_EQ(this->sent_messages.size(), 0u);
+
+    this->current_time = 2000000;
+    monitor->send_gauge(bzn::statistic::pbft_window_occupancy, 5);
+
+    ASSERT_EQ(this->sent_messages.size(), 1u);
+    EXPECT_NE(this->sent_messages.at(0).find(":5|g"), std::string::npos);
+}
+
 TEST_F(monitor_test, test_that_timers_emit_metric)
 {
     this->monitor->start_timer("hash");
@@ -304,4 +304,28 @@ bool
 options::get_peer_message_signing() const
 {
     return this->raw_opts.get<bool>(PEER_MESSAGE_SIGNING);
+}
+
+size_t
+options::get_pbft_batch_max_requests() const
+{
+    return this->raw_opts.get<size_t>(PBFT_BATCH_MAX_REQUESTS);
+}
+
+size_t
+options::get_pbft_batch_max_bytes() const
+{
+    return this->raw_opts.get<size_t>(PBFT_BATCH_MAX_BYTES);
+}
+
+std::chrono::milliseconds
+options::get_pbft_batch_max_delay() const
+{
+    return std::chrono::milliseconds(this->raw_opts.get<uint64_t>(PBFT_BATCH_MAX_DELAY_MS));
+}
+
+size_t
+options::get_pbft_verifier_threads() const
+{
+    return this->raw_opts.get<size_t>(PBFT_VERIFIER_THREADS);
 }
\ No newline at end of file
@@ -86,6 +86,14 @@ namespace bzn
 
         bool get_peer_message_signing() const override;
 
+        size_t get_pbft_batch_max_requests() const override;
+
+        size_t get_pbft_batch_max_bytes() const override;
+
+        std::chrono::milliseconds get_pbft_batch_max_delay() const override;
+
+        size_t get_pbft_verifier_threads() const override;
+
     private:
         size_t parse_size(const std::string& key) const;
 
@@ -251,5 +251,30 @@ namespace bzn
          * @return true/false
          */
         virtual bool get_peer_message_signing() const = 0;
+
+        /**
+         * Get the maximum number of client requests the primary orders together in one pbft instance
+         * @return request count (batching is off at one or less)
+         */
+        virtual size_t get_pbft_batch_max_requests() const = 0;
+
+        /**
+         * Get the maximum combined size of the client requests in a batch. A batch is stored as one value, so pbft
+         * limits it to what storage takes whatever this says.
+         * @return bytes
+         */
+        virtual size_t get_pbft_batch_max_bytes() const = 0;
+
+        /**
+         * Get how long the first request of a batch waits for others to join it
+         * @return milliseconds
+         */
+        virtual std::chrono::milliseconds get_pbft_batch_max_delay() const = 0;
+
+        /**
+         * Get the number of threads that verify signatures of incoming consensus messages
+         * @return thread count (zero verifies on the thread that received the message)
+         */
+        virtual size_t get_pbft_verifier_threads() const = 0;
     };
 } // bzn
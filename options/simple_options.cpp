@@ -79,6 +79,12 @@ simple_options::build_options()
                 (MEM_STORAGE.c_str(),
                          po::value<bool>()->default_value(true),
                          "enable in memory storage for debugging")
+                (STORAGE_GROUP_COMMIT_WINDOW_US.c_str(),
+                         po::value<uint64_t>()->default_value(0),
+                         "time (us) concurrent writes wait to share a wal sync (zero syncs every write individually)")
+                (STORAGE_GROUP_COMMIT_MAX_BATCH.c_str(),
+                         po::value<size_t>()->default_value(64),
+                         "maximum number of writes sharing a single wal sync")
                 (NODE_UUID.c_str(),
                         po::value<std::string>(),
                         "uuid of this node")
@@ -114,7 +120,19 @@ simple_options::build_options()
                     "admission control request window")
                 (PEER_MESSAGE_SIGNING.c_str(),
                     po::value<bool>()->default_value(false),
-                    "should peer messages be signed/verified");
+                    "should peer messages be signed/verified")
+                (PBFT_BATCH_MAX_REQUESTS.c_str(),
+                    po::value<size_t>()->default_value(1),
+                    "maximum number of requests ordered together by the primary (one disables batching)")
+                (PBFT_BATCH_MAX_BYTES.c_str(),
+                    po::value<size_t>()->default_value(128 * 1024),
+                    "maximum combined size (bytes) of the requests in a batch (at most the largest value storage takes)")
+                (PBFT_BATCH_MAX_DELAY_MS.c_str(),
+                    po::value<uint64_t>()->default_value(5),
+                    "time (ms) a request waits for others to join its batch")
+                (PBFT_VERIFIER_THREADS.c_str(),
+                    po::value<size_t>()->default_value(2),
+                    "threads verifying signatures ahead of pbft (zero verifies inline)");
 
     po::options_description logging("Logging");
     logging.add_options()
@@ -190,7 +208,10 @@ simple_options::build_options()
                         "attach signatures on outgoing messages")
                 (CRYPTO_SELF_VERIFY.c_str(),
                          po::value<bool>()->default_value(true),
-                        "verify own signatures as a sanity check");
+                        "verify own signatures as a sanity check")
+                (CRYPTO_KEY_CACHE_SIZE.c_str(),
+                         po::value<size_t>()->default_value(1024),
+                        "number of parsed sender public keys kept for signature verification");
 
     this->options_root.add(crypto);
 
@@ -52,6 +52,12 @@ namespace bzn::option_names
     const std::string OWNER_PUBLIC_KEY = "owner_public_key";
     const std::string ADMISSION_WINDOW = "admission_window";
     const std::string PEER_MESSAGE_SIGNING = "peer_message_signing";
+    const std::string PBFT_BATCH_MAX_REQUESTS = "pbft_batch_max_requests";
+    const std::string PBFT_BATCH_MAX_BYTES = "pbft_batch_max_bytes";
+    const std::string PBFT_BATCH_MAX_DELAY_MS = "pbft_batch_max_delay_ms";
+    const std::string PBFT_VERIFIER_THREADS = "pbft_verifier_threads";
+    const std::string STORAGE_GROUP_COMMIT_WINDOW_US = "storage_group_commit_window_us";
+    const std::string STORAGE_GROUP_COMMIT_MAX_BATCH = "storage_group_commit_max_batch";
 
     const std::string CHAOS_ENABLED = "chaos_testing_enabled";
     const std::string CHAOS_NODE_FAILURE_SHAPE = "chaos_node_failure_shape";
@@ -63,6 +69,7 @@ namespace bzn::option_names
     const std::string CRYPTO_ENABLED_OUTGOING = "crypto_enabled_outgoing";
     const std::string CRYPTO_ENABLED_INCOMING = "crypto_enabled_incoming";
     const std::string CRYPTO_SELF_VERIFY = "crypto_self_verify";
+    const std::string CRYPTO_KEY_CACHE_SIZE = "crypto_key_cache_size";
 
     const std::string MONITOR_MAX_TIMERS = "monitor_max_timers";
     const std::string OVERRIDE_NUM_THREADS = "override_num_threads";
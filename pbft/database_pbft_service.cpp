@@ -22,6 +22,7 @@ using namespace bzn;
 namespace
 {
     const std::string NEXT_REQUEST_SEQUENCE_KEY{"next_request_sequence"};
+    const std::string BATCH_KEY_PREFIX{"batch_"};
 }
 
 
@@ -51,22 +52,31 @@ database_pbft_service::apply_operation(const std::shared_ptr<bzn::pbft_operation
 {
     std::lock_guard<std::mutex> lock(this->lock);
 
-    // store op...
-    if (auto result = this->unstable_storage->create(this->uuid, std::to_string(op->get_sequence()), op->get_database_msg().SerializeAsString());
-        result != bzn::storage_result::ok)
+    // store op, a batch is stored whole and its requests are executed in order...
+    const bool batch = op->has_batch_request();
+    const key_t key{std::to_string(op->get_sequence())};
+    const auto describe = [&]()
+    {
+        return (batch ? op->get_batch_request().DebugString() : op->get_database_msg().DebugString()).substr(0, MAX_MESSAGE_SIZE);
+    };
+
+    auto result = this->unstable_storage->has(this->uuid, batch ? key : BATCH_KEY_PREFIX + key)
+        ? bzn::storage_result::exists
+        : this->unstable_storage->create(this->uuid, batch ? BATCH_KEY_PREFIX + key : key,
+            batch ? op->get_request().pbft_request_batch() : op->get_database_msg().SerializeAsString());
+
+    if (result != bzn::storage_result::ok)
     {
         if (result == bzn::storage_result::exists)
         {
             // KEP-899 - We do not want to throw a runtime error for duplicates, as it is possible that
             // during a view change we may try to perform duplicate operatiosn that have already been
             // done in previous views.
-            LOG(warning) << "failed to store pbft request, possible duplicate? : "
-                << op->get_database_msg().DebugString().substr(0, MAX_MESSAGE_SIZE) << ", " << uint32_t(result);
+            LOG(warning) << "failed to store pbft request, possible duplicate? : " << describe() << ", " << uint32_t(result);
             return;
         }
 
-        LOG(fatal) << "failed to store pbft request: "
-            << op->get_database_msg().DebugString().substr(0, MAX_MESSAGE_SIZE) << ", " << uint32_t(result);
+        LOG(fatal) << "failed to store pbft request: " << describe() << ", " << uint32_t(result);
 
         // these are fatal... something bad is going on.
         throw std::runtime_error("Failed to store pbft request! (" + std::to_string(uint8_t(result)) + ")");
@@ -106,57 +116,98 @@ database_pbft_service::apply_operation_now(const bzn_envelope& msg, std::shared_
 void
 database_pbft_service::process_awaiting_operations()
 {
-    while (this->unstable_storage->has(this->uuid, std::to_string(this->next_request_sequence)))
+    while (true)
     {
-        const key_t key{std::to_string(this->next_request_sequence)};
+        key_t key{std::to_string(this->next_request_sequence)};
 
-        auto result = this->unstable_storage->read(this->uuid, key);
+        // the requests stored for this sequence along with who sent them...
+        std::vector<std::pair<bzn::caller_id_t, database_msg>> requests;
 
-        if (!result)
+        if (this->unstable_storage->has(this->uuid, key))
         {
-            // these are fatal... something bad is going on.
-            throw std::runtime_error("Failed to store pbft request!");
+            auto result = this->unstable_storage->read(this->uuid, key);
+
+            if (!result)
+            {
+                // these are fatal... something bad is going on.
+                throw std::runtime_error("Failed to store pbft request!");
+            }
+
+            requests.emplace_back();
+
+            if (!requests.back().second.ParseFromString(*result))
+            {
+                // these are fatal... something bad is going on.
+                throw std::runtime_error("Failed to create pbft_request from database read!");
+            }
         }
+        else if (this->unstable_storage->has(this->uuid, BATCH_KEY_PREFIX + key))
+        {
+            key = BATCH_KEY_PREFIX + key;
+
+            auto result = this->unstable_storage->read(this->uuid, key);
+            pbft_request_batch batch;
+
+            if (!result || !batch.ParseFromString(*result))
+            {
+                // these are fatal... something bad is going on.
+                throw std::runtime_error("Failed to create pbft_request_batch from database read!");
+            }
 
-        database_msg request;
+            for (const auto& request_env : batch.requests())
+            {
+                requests.emplace_back(request_env.sender(), database_msg());
 
-        if (!request.ParseFromString(*result))
+                if (!requests.back().second.ParseFromString(request_env.database_msg()))
+                {
+                    LOG(error) << "Failed to parse a request of the batch at sequence: " << this->next_request_sequence;
+
+                    // the other requests of the batch still have to be executed in order...
+                    requests.back().second.mutable_nullmsg();
+                }
+            }
+        }
+        else
         {
-            // these are fatal... something bad is going on.
-            throw std::runtime_error("Failed to create pbft_request from database read!");
+            break;
         }
 
-        LOG(info) << "Executing request " << request.DebugString().substr(0, MAX_MESSAGE_SIZE) << "..., sequence: " << key;
+        LOG(info) << "Executing " << requests.size() << " request(s) "
+            << requests.front().second.DebugString().substr(0, MAX_MESSAGE_SIZE) << "..., sequence: " << key;
 
         if (auto op_it = this->operations_awaiting_result.find(this->next_request_sequence); op_it != this->operations_awaiting_result.end())
         {
-            // set request hash field for responses...
-            request.mutable_header()->set_request_hash(op_it->second->get_request_hash());
+            const auto& op = op_it->second;
 
-            if (op_it->second->has_session() && op_it->second->session()->is_open())
+            if (op->has_batch_request())
             {
-                this->crud->handle_request(op_it->second->get_request().sender(), request, op_it->second->session());
+                const auto& batch_sessions = op->batch_sessions();
+
+                for (size_t i = 0; i < requests.size(); ++i)
+                {
+                    // without the sessions (they do not persist) there is no one to respond to...
+                    this->execute_request(requests[i].first, requests[i].second,
+                        i < batch_sessions.size() ? batch_sessions[i].first : bzn::hash_t{},
+                        i < batch_sessions.size() ? batch_sessions[i].second : nullptr);
+                }
             }
             else
             {
-                // session not found then this was probably loaded from the database...
-                LOG(info) << "We do not have a pending operation for this request";
-
-                this->crud->handle_request(op_it->second->get_request().sender(), request, nullptr);
+                this->execute_request(op->get_request().sender(), requests.front().second, op->get_request_hash(),
+                    op->has_session() ? op->session() : nullptr);
             }
 
-            // update stats...
-            this->monitor->finish_timer(bzn::statistic::request_latency, op_it->second->get_request_hash());
-
             if (this->next_request_sequence == this->next_checkpoint)
             {
-                if (this->crud->save_state())
+                if (this->crud->save_state(this->next_request_sequence))
                 {
+                    // nothing else writes to crud here, so this is the hash of the state just saved...
                     this->last_checkpoint = this->next_request_sequence;
+                    this->last_checkpoint_hash = this->crud->get_state_hash();
                 }
             }
 
-            this->io_context->post(std::bind(this->execute_handler, (*op_it).second));
+            this->io_context->post(std::bind(this->execute_handler, op));
         }
 
         if (auto result = this->unstable_storage->remove(this->uuid, key); result != bzn::storage_result::ok)
@@ -171,27 +222,89 @@ database_pbft_service::process_awaiting_operations()
     }
 }
 
+
+void
+database_pbft_service::execute_request(const bzn::caller_id_t& caller_id, database_msg& request, const bzn::hash_t& request_hash,
+    const std::shared_ptr<bzn::session_base>& session)
+{
+    // set request hash field for responses...
+    request.mutable_header()->set_request_hash(request_hash);
+
+    if (session && session->is_open())
+    {
+        this->crud->handle_request(caller_id, request, session);
+    }
+    else
+    {
+        // session not found then this was probably loaded from the database...
+        LOG(info) << "We do not have a pending operation for this request";
+
+        this->crud->handle_request(caller_id, request, nullptr);
+    }
+
+    // update stats...
+    this->monitor->finish_timer(bzn::statistic::request_latency, request_hash);
+}
+
 bzn::hash_t
-database_pbft_service::service_state_hash(uint64_t /*sequence_number*/) const
+database_pbft_service::service_state_hash(uint64_t sequence_number) const
 {
-    // TODO: not sure how this works... (KEP-1203)
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    // the hash is taken when the checkpoint is saved, as later requests may already have been applied...
+    if (sequence_number == this->last_checkpoint)
+    {
+        return this->last_checkpoint_hash;
+    }
 
     return "";
 }
 
-std::shared_ptr<bzn::service_state_t>
-database_pbft_service::get_service_state(uint64_t sequence_number) const
+std::optional<bzn::snapshot_chunk_t>
+database_pbft_service::get_service_state_chunk(uint64_t sequence_number, uint64_t offset, size_t max_size) const
 {
-    if (sequence_number == this->last_checkpoint)
+    // the saved state is kept by the checkpoint it was taken at, so execution moving on does not change what we read
+    return this->crud->get_saved_state_chunk(sequence_number, offset, max_size);
+}
+
+std::optional<bzn::snapshot_chunk_t>
+database_pbft_service::get_service_state_delta_chunk(uint64_t sequence_number, const std::vector<bzn::hash_t>& manifest,
+    uint64_t offset, size_t max_size) const
+{
+    return this->crud->get_saved_state_delta_chunk(sequence_number, manifest, offset, max_size);
+}
+
+std::vector<bzn::hash_t>
+database_pbft_service::get_service_state_manifest() const
+{
+    return this->crud->get_state_manifest();
+}
+
+bool
+database_pbft_service::set_service_state(uint64_t sequence_number, const bzn::service_state_t& data,
+    const bzn::hash_t& state_hash)
+{
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    if (this->next_request_sequence > sequence_number)
     {
-        return this->crud->get_saved_state();
+        LOG(debug) << "No need to apply service state";
+        return true;
+    }
+
+    // initialize database state from checkpoint data, provided it is the state the checkpoint attests to
+    if (!this->crud->load_state(data, state_hash))
+    {
+        return false;
     }
 
-    return nullptr;
+    this->adopt_service_state(sequence_number);
+    return true;
 }
 
 bool
-database_pbft_service::set_service_state(uint64_t sequence_number, const bzn::service_state_t& data)
+database_pbft_service::set_service_state_chunk(uint64_t sequence_number, uint64_t offset, const bzn::service_state_t& chunk,
+    uint64_t total_size, bool delta, const bzn::hash_t& state_hash)
 {
     std::lock_guard<std::mutex> lock(this->lock);
 
@@ -201,12 +314,31 @@ database_pbft_service::set_service_state(uint64_t sequence_number, const bzn::se
         return true;
     }
 
-    // initialize database state from checkpoint data
-    if (!this->crud->load_state(data))
+    // the database state is only replaced once the last chunk has been received
+    if (!this->crud->load_state_chunk(sequence_number, offset, chunk, total_size, delta, state_hash))
     {
         return false;
     }
+
+    if (offset + chunk.size() == total_size)
+    {
+        this->adopt_service_state(sequence_number);
+    }
+
+    return true;
+}
+
+void
+database_pbft_service::adopt_service_state(uint64_t sequence_number)
+{
     this->last_checkpoint = sequence_number;
+    this->last_checkpoint_hash = this->crud->get_state_hash();
+
+    // so that we can pass the checkpoint on to others in turn
+    if (!this->crud->save_state(sequence_number))
+    {
+        LOG(error) << "Failed to save the adopted state at " << sequence_number;
+    }
 
     // remove all backlogged requests prior to checkpoint
     uint64_t seq = this->next_request_sequence;
@@ -214,12 +346,12 @@ database_pbft_service::set_service_state(uint64_t sequence_number, const bzn::se
     {
         const key_t key{std::to_string(seq)};
         this->unstable_storage->remove(uuid, key);
+        this->unstable_storage->remove(uuid, BATCH_KEY_PREFIX + key);
         seq++;
     }
 
     this->next_request_sequence = seq;
     this->process_awaiting_operations();
-    return true;
 }
 
 void
@@ -41,9 +41,19 @@ namespace bzn
 
         bzn::hash_t service_state_hash(uint64_t sequence_number) const override;
 
-        std::shared_ptr<bzn::service_state_t> get_service_state(uint64_t sequence_number) const override;
+        std::optional<bzn::snapshot_chunk_t> get_service_state_chunk(uint64_t sequence_number, uint64_t offset,
+            size_t max_size) const override;
 
-        bool set_service_state(uint64_t sequence_number, const bzn::service_state_t& data) override;
+        bool set_service_state(uint64_t sequence_number, const bzn::service_state_t& data,
+            const bzn::hash_t& state_hash) override;
+
+        std::optional<bzn::snapshot_chunk_t> get_service_state_delta_chunk(uint64_t sequence_number,
+            const std::vector<bzn::hash_t>& manifest, uint64_t offset, size_t max_size) const override;
+
+        std::vector<bzn::hash_t> get_service_state_manifest() const override;
+
+        bool set_service_state_chunk(uint64_t sequence_number, uint64_t offset, const bzn::service_state_t& chunk,
+            uint64_t total_size, bool delta, const bzn::hash_t& state_hash) override;
 
         void save_service_state_at(uint64_t sequence_number) override;
 
@@ -55,6 +65,9 @@ namespace bzn
 
     private:
         void process_awaiting_operations();
+        void execute_request(const bzn::caller_id_t& caller_id, database_msg& request, const bzn::hash_t& request_hash,
+            const std::shared_ptr<bzn::session_base>& session);
+        void adopt_service_state(uint64_t sequence_number);
 
         void load_next_request_sequence();
         void save_next_request_sequence();
@@ -71,9 +84,10 @@ namespace bzn
         bzn::execute_handler_t execute_handler;
 
         std::once_flag start_once;
-        std::mutex lock;
+        mutable std::mutex lock;
         uint64_t next_checkpoint = 0;
         uint64_t last_checkpoint = 0;
+        bzn::hash_t last_checkpoint_hash;
     };
 
 } // bzn
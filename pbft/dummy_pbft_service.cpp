@@ -78,14 +78,42 @@ dummy_pbft_service::service_state_hash(uint64_t sequence_number) const
     return "I don't actually have a database [" + std::to_string(sequence_number) + "]";
 }
 
-std::shared_ptr<bzn::service_state_t>
-dummy_pbft_service::get_service_state(uint64_t sequence_number) const
+std::optional<bzn::snapshot_chunk_t>
+dummy_pbft_service::get_service_state_chunk(uint64_t sequence_number, uint64_t offset, size_t max_size) const
 {
-    return std::make_shared<std::string>("I don't actually have a database [" + std::to_string(sequence_number) + "]");
+    const std::string state("I don't actually have a database [" + std::to_string(sequence_number) + "]");
+
+    if (offset > state.size())
+    {
+        return std::nullopt;
+    }
+
+    return bzn::snapshot_chunk_t{state.substr(offset, max_size), state.size()};
+}
+
+bool
+dummy_pbft_service::set_service_state(uint64_t /*sequence_number*/, const bzn::service_state_t& /*data*/,
+    const bzn::hash_t& /*state_hash*/)
+{
+    return true;
+}
+
+std::optional<bzn::snapshot_chunk_t>
+dummy_pbft_service::get_service_state_delta_chunk(uint64_t /*sequence_number*/, const std::vector<bzn::hash_t>& /*manifest*/,
+    uint64_t /*offset*/, size_t /*max_size*/) const
+{
+    return std::nullopt;
+}
+
+std::vector<bzn::hash_t>
+dummy_pbft_service::get_service_state_manifest() const
+{
+    return {};
 }
 
 bool
-dummy_pbft_service::set_service_state(uint64_t /*sequence_number*/, const bzn::service_state_t& /*data*/)
+dummy_pbft_service::set_service_state_chunk(uint64_t /*sequence_number*/, uint64_t /*offset*/,
+    const bzn::service_state_t& /*chunk*/, uint64_t /*total_size*/, bool /*delta*/, const bzn::hash_t& /*state_hash*/)
 {
     return true;
 }
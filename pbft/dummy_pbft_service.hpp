@@ -33,8 +33,11 @@ namespace bzn
         void consolidate_log(uint64_t sequence_number) override;
         void register_execute_handler(execute_handler_t handler) override;
         bzn::hash_t service_state_hash(uint64_t sequence_number) const override;
-        std::shared_ptr<bzn::service_state_t> get_service_state(uint64_t sequence_number) const override;
-        bool set_service_state(uint64_t sequence_number, const bzn::service_state_t& data) override;
+        std::optional<bzn::snapshot_chunk_t> get_service_state_chunk(uint64_t sequence_number, uint64_t offset, size_t max_size) const override;
+        bool set_service_state(uint64_t sequence_number, const bzn::service_state_t& data, const bzn::hash_t& state_hash) override;
+        std::optional<bzn::snapshot_chunk_t> get_service_state_delta_chunk(uint64_t sequence_number, const std::vector<bzn::hash_t>& manifest, uint64_t offset, size_t max_size) const override;
+        std::vector<bzn::hash_t> get_service_state_manifest() const override;
+        bool set_service_state_chunk(uint64_t sequence_number, uint64_t offset, const bzn::service_state_t& chunk, uint64_t total_size, bool delta, const bzn::hash_t& state_hash) override;
         void save_service_state_at(uint64_t sequence_number) override;
 
         uint64_t applied_requests_count();
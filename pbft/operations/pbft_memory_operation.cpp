@@ -42,6 +42,12 @@ pbft_memory_operation::has_config_request() const
     return this->has_request() && this->request.payload_case() == bzn_envelope::kPbftInternalRequest;
 }
 
+bool
+pbft_memory_operation::has_batch_request() const
+{
+    return this->has_request() && this->request.payload_case() == bzn_envelope::kPbftRequestBatch;
+}
+
 const bzn_envelope&
 pbft_memory_operation::get_request() const
 {
@@ -75,6 +81,17 @@ pbft_memory_operation::get_database_msg() const
     return this->parsed_db;
 }
 
+const pbft_request_batch&
+pbft_memory_operation::get_batch_request() const
+{
+    if (!this->has_batch_request())
+    {
+        throw std::runtime_error("Tried to get a batch request that is not saved");
+    }
+
+    return this->parsed_batch;
+}
+
 void
 pbft_memory_operation::record_request(const bzn_envelope& wrapped_request)
 {
@@ -96,6 +113,14 @@ pbft_memory_operation::record_request(const bzn_envelope& wrapped_request)
             return;
         }
     }
+    else if (wrapped_request.payload_case() == bzn_envelope::kPbftRequestBatch)
+    {
+        if (!this->parsed_batch.ParseFromString(wrapped_request.pbft_request_batch()))
+        {
+            LOG(error) << "Failed to parse pbft request batch";
+            return;
+        }
+    }
     else
     {
         LOG(error) << "Tried to record request as envelope that does not actually contain a request type";
@@ -42,10 +42,12 @@ namespace bzn
         bool has_request() const override;
         bool has_db_request() const override;
         bool has_config_request() const override;
+        bool has_batch_request() const override;
 
         const bzn_envelope& get_request() const override;
         const pbft_config_msg& get_config_request() const override;
         const database_msg& get_database_msg() const override;
+        const pbft_request_batch& get_batch_request() const override;
 
         bzn_envelope get_preprepare() const override ;
         std::map<uuid_t, bzn_envelope> get_prepares() const override;
@@ -63,6 +65,7 @@ namespace bzn
         bzn_envelope request;
         database_msg parsed_db;
         pbft_config_msg parsed_config;
+        pbft_request_batch parsed_batch;
 
         bool request_saved = false;
 
@@ -48,6 +48,18 @@ pbft_operation::has_session() const
     return this->session_saved;
 }
 
+void
+pbft_operation::set_batch_sessions(std::vector<std::pair<bzn::hash_t, std::shared_ptr<bzn::session_base>>> sessions)
+{
+    this->request_sessions = std::move(sessions);
+}
+
+const std::vector<std::pair<bzn::hash_t, std::shared_ptr<bzn::session_base>>>&
+pbft_operation::batch_sessions() const
+{
+    return this->request_sessions;
+}
+
 uint64_t
 pbft_operation::get_sequence() const
 {
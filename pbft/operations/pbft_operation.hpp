@@ -54,6 +54,18 @@ namespace bzn
          */
         virtual bool has_session() const;
 
+        /**
+         * Store the hash of each request of a batch along with the session waiting on it, if any, in batch order
+         * (will not persist across crashes)
+         * @param sessions request hash and session pairs
+         */
+        virtual void set_batch_sessions(std::vector<std::pair<bzn::hash_t, std::shared_ptr<bzn::session_base>>> sessions);
+
+        /**
+         * @return the saved request hashes and sessions of a batch, empty if none were saved
+         */
+        virtual const std::vector<std::pair<bzn::hash_t, std::shared_ptr<bzn::session_base>>>& batch_sessions() const;
+
         /**
          * @return the operation_key_t that uniquely identifies this operation
          */
@@ -131,6 +143,11 @@ namespace bzn
          */
         virtual bool has_config_request() const = 0;
 
+        /**
+         * @return do we know the full request associated with this operation, and is it a batch of requests?
+         */
+        virtual bool has_batch_request() const = 0;
+
         /**
          * @return the signed envelope containing the request associated with this operation
          */
@@ -146,6 +163,11 @@ namespace bzn
          */
         virtual const database_msg& get_database_msg() const = 0;
 
+        /**
+         * @return the parsed batch of requests associated with this operation
+         */
+        virtual const pbft_request_batch& get_batch_request() const = 0;
+
         /**
          * @return the recorded preprepare envelope
          */
@@ -161,6 +183,7 @@ namespace bzn
     private:
         bool session_saved = false;
         std::shared_ptr<bzn::session_base> listener_session;
+        std::vector<std::pair<bzn::hash_t, std::shared_ptr<bzn::session_base>>> request_sessions;
 
         const uint64_t view;
         const uint64_t sequence;
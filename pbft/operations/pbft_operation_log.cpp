@@ -0,0 +1,630 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <pbft/operations/pbft_operation_log.hpp>
+#include <limits>
+#include <iterator>
+
+using namespace bzn;
+
+namespace
+{
+    const std::string OPERATION_LOG_UUID = "pbft_operation_log";
+    const std::string STAGE_INDEX_UUID = "pbft_operation_log_stages";
+
+    void
+    append_be(std::string& out, uint64_t value, size_t bytes)
+    {
+        for (size_t i = bytes; i > 0; --i)
+        {
+            out.push_back(static_cast<char>((value >> (8 * (i - 1))) & 0xff));
+        }
+    }
+
+    bool
+    read_be(const std::string& in, size_t& pos, size_t bytes, uint64_t& value)
+    {
+        if (in.size() < pos + bytes)
+        {
+            return false;
+        }
+
+        value = 0;
+        for (size_t i = 0; i < bytes; ++i)
+        {
+            value = (value << 8) | static_cast<unsigned char>(in[pos++]);
+        }
+
+        return true;
+    }
+}
+
+
+pbft_operation_log::pbft_operation_log(std::shared_ptr<bzn::storage_base> storage, bool write_behind, size_t max_pending
+    , std::shared_ptr<bzn::monitor_base> monitor)
+    : storage(std::move(storage))
+    , write_behind(write_behind)
+    , max_pending(std::max<size_t>(max_pending, 1))
+    , monitor(std::move(monitor))
+{
+    if (this->write_behind)
+    {
+        this->writer = std::thread(&pbft_operation_log::write_pending, this);
+        this->collector = std::thread(&pbft_operation_log::collect_pending, this);
+    }
+}
+
+
+pbft_operation_log::~pbft_operation_log()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->lock);
+        this->stopping = true;
+    }
+    this->pending_changed.notify_all();
+
+    // the writer persists whatever is still queued before it exits; collection left undone is redone by the next run
+    if (this->writer.joinable())
+    {
+        this->writer.join();
+    }
+
+    if (this->collector.joinable())
+    {
+        this->collector.join();
+    }
+}
+
+
+const bzn::uuid_t&
+pbft_operation_log::get_uuid()
+{
+    return OPERATION_LOG_UUID;
+}
+
+
+const bzn::uuid_t&
+pbft_operation_log::get_stage_index_uuid()
+{
+    return STAGE_INDEX_UUID;
+}
+
+
+std::string
+pbft_operation_log::sequence_prefix(uint64_t sequence)
+{
+    std::string result;
+    append_be(result, sequence, sizeof(sequence));
+    return result;
+}
+
+
+std::string
+pbft_operation_log::operation_prefix(uint64_t view, uint64_t sequence, const bzn::hash_t& request_hash)
+{
+    if (request_hash.size() > std::numeric_limits<uint16_t>::max())
+    {
+        throw std::runtime_error("request hash too long for the operation log");
+    }
+
+    std::string result = sequence_prefix(sequence);
+    append_be(result, view, sizeof(view));
+    append_be(result, request_hash.size(), sizeof(uint16_t));
+    result += request_hash;
+    return result;
+}
+
+
+std::string
+pbft_operation_log::record_key(const std::string& operation_prefix, record_type type, const std::string& tail)
+{
+    std::string result;
+    result.reserve(operation_prefix.size() + 1 + tail.size());
+    result += operation_prefix;
+    result.push_back(static_cast<char>(type));
+    result += tail;
+    return result;
+}
+
+
+bool
+pbft_operation_log::parse_record_key(const std::string& key, record_key_t& parsed)
+{
+    size_t pos = 0;
+    uint64_t hash_size;
+    uint64_t type;
+    if (!read_be(key, pos, sizeof(parsed.sequence), parsed.sequence) || !read_be(key, pos, sizeof(parsed.view), parsed.view)
+        || !read_be(key, pos, sizeof(uint16_t), hash_size) || key.size() < pos + hash_size + 1)
+    {
+        return false;
+    }
+
+    parsed.request_hash = key.substr(pos, hash_size);
+    pos += hash_size;
+
+    read_be(key, pos, 1, type);
+    if (type > static_cast<uint64_t>(record_type::commit))
+    {
+        return false;
+    }
+
+    parsed.type = static_cast<record_type>(type);
+    parsed.tail = key.substr(pos);
+    return true;
+}
+
+
+bzn::storage_result
+pbft_operation_log::append(const std::string& operation_prefix, record_type type, const std::string& tail
+    , const bzn::value_t& value)
+{
+    auto key = record_key(operation_prefix, type, tail);
+    if (!this->write_behind)
+    {
+        // create_batch leaves existing records as they are without saying so, so look first
+        const bool existed = this->storage->has(get_uuid(), key);
+        if (existed && type != record_type::stage)
+        {
+            return storage_result::exists;
+        }
+
+        // a stage record and its index entry go in one write, as they do from the writer thread
+        std::vector<bzn::storage_record_t> records{{get_uuid(), key, value}};
+        if (type == record_type::stage)
+        {
+            records.push_back({get_stage_index_uuid(), key, ""});
+        }
+
+        if (const auto result = this->storage->create_batch(records); result != storage_result::ok)
+        {
+            return result;
+        }
+
+        return existed ? storage_result::exists : storage_result::ok;
+    }
+
+    if (key.size() > bzn::MAX_KEY_SIZE)
+    {
+        return storage_result::key_too_large;
+    }
+
+    if (value.size() > bzn::MAX_VALUE_SIZE)
+    {
+        return storage_result::value_too_large;
+    }
+
+    std::unique_lock<std::mutex> lock(this->lock);
+
+    // bound the memory held by the queue if storage falls behind
+    this->pending_changed.wait(lock, [&]()
+    {
+        return this->pending.size() < this->max_pending || this->stopping;
+    });
+
+    if (this->write_failure)
+    {
+        throw std::runtime_error("operation log failed to persist records: " + storage_result_msg.at(*this->write_failure));
+    }
+
+    auto queued_key = std::make_pair(get_uuid(), std::move(key));
+    if (this->pending.count(queued_key) || this->writing.count(queued_key))
+    {
+        return storage_result::exists;
+    }
+
+    if (type == record_type::stage)
+    {
+        this->pending.emplace(std::make_pair(get_stage_index_uuid(), queued_key.second), "");
+        this->appended_count++;
+    }
+
+    this->pending.emplace(std::move(queued_key), value);
+    this->appended_count++;
+    lock.unlock();
+
+    this->pending_changed.notify_all();
+    return storage_result::ok;
+}
+
+
+void
+pbft_operation_log::write_pending()
+{
+    std::unique_lock<std::mutex> lock(this->lock);
+    while (true)
+    {
+        // tasks can also be released by the collector, which drops queued records it collects
+        this->pending_changed.wait(lock, [&]()
+        {
+            return !this->pending.empty() || this->stopping
+                || (!this->persisted_tasks.empty() && this->persisted_tasks.front().first <= this->written_count);
+        });
+
+        if (this->pending.empty())
+        {
+            this->run_persisted_tasks(lock);
+
+            if (this->stopping && this->pending.empty())
+            {
+                return;
+            }
+            continue;
+        }
+
+        this->writing.swap(this->pending);
+        lock.unlock();
+
+        // only this thread changes writing, so it can be walked without the lock. The records and their stage index
+        // entries go in one write, so an operation found through the index always has the records it was indexed for.
+        std::vector<bzn::storage_record_t> records;
+        records.reserve(this->writing.size());
+        for (const auto& record : this->writing)
+        {
+            records.push_back({record.first.first, record.first.second, record.second});
+        }
+
+        std::optional<bzn::storage_result> failure;
+        if (const auto result = this->storage->create_batch(records); result != storage_result::ok)
+        {
+            failure = result;
+        }
+
+        lock.lock();
+        this->written_count += this->writing.size();
+        this->writing.clear();
+
+        if (failure)
+        {
+            LOG(error) << "failed to persist pbft operation records: " << storage_result_msg.at(*failure);
+            this->write_failure = failure;
+        }
+
+        this->pending_changed.notify_all();
+        this->run_persisted_tasks(lock);
+    }
+}
+
+
+void
+pbft_operation_log::collect_pending()
+{
+    std::unique_lock<std::mutex> lock(this->lock);
+    auto next_step = std::chrono::steady_clock::now();
+    while (true)
+    {
+        this->pending_changed.wait(lock, [&]()
+        {
+            return this->collected < this->collect_target || this->stopping;
+        });
+
+        // steps are spaced out, so that a large backlog does not keep storage busy while records wait to be written
+        if (this->stopping || this->pending_changed.wait_until(lock, next_step, [&](){ return this->stopping; }))
+        {
+            return;
+        }
+
+        const auto first = this->collected;
+        const auto last = std::min(this->collect_target, first + MAX_COLLECT_SEQUENCES);
+        const auto target = this->collect_target;
+
+        // records still queued for the range would outlive its collection, and are no longer needed anyway...
+        for (const auto& uuid : {get_uuid(), get_stage_index_uuid()})
+        {
+            const auto begin = this->pending.lower_bound(std::make_pair(uuid, bzn::key_t{}));
+            const auto end = this->pending.lower_bound(std::make_pair(uuid, sequence_prefix(last)));
+            this->written_count += std::distance(begin, end);
+            this->pending.erase(begin, end);
+        }
+        this->pending_changed.notify_all();
+
+        // ...and ones the writer is persisting right now have to land before the range is removed
+        this->pending_changed.wait(lock, [&]()
+        {
+            for (const auto& uuid : {get_uuid(), get_stage_index_uuid()})
+            {
+                const auto it = this->writing.lower_bound(std::make_pair(uuid, bzn::key_t{}));
+                if (it != this->writing.end() && it->first.first == uuid && it->first.second < sequence_prefix(last))
+                {
+                    return false;
+                }
+            }
+            return true;
+        });
+        lock.unlock();
+
+        this->collect_range(first, last, target);
+
+        lock.lock();
+        this->collected = last;
+        next_step = std::chrono::steady_clock::now() + COLLECT_STEP_INTERVAL;
+        this->pending_changed.notify_all();
+    }
+}
+
+
+void
+pbft_operation_log::run_persisted_tasks(std::unique_lock<std::mutex>& lock)
+{
+    // what the tasks stand for must not happen on the strength of records that are not on disk
+    if (this->write_failure)
+    {
+        if (!this->persisted_tasks.empty())
+        {
+            LOG(error) << "dropping " << this->persisted_tasks.size() << " tasks waiting on pbft operation records that were not persisted";
+            this->persisted_tasks.clear();
+        }
+        return;
+    }
+
+    std::vector<std::function<void()>> ready;
+    while (!this->persisted_tasks.empty() && this->persisted_tasks.front().first <= this->written_count)
+    {
+        ready.emplace_back(std::move(this->persisted_tasks.front().second));
+        this->persisted_tasks.pop_front();
+    }
+
+    if (ready.empty())
+    {
+        return;
+    }
+
+    lock.unlock();
+    for (const auto& task : ready)
+    {
+        task();
+    }
+    lock.lock();
+}
+
+
+bool
+pbft_operation_log::when_persisted(std::function<void()> task)
+{
+    if (!this->write_behind)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    if (this->write_failure)
+    {
+        throw std::runtime_error("operation log failed to persist records: " + storage_result_msg.at(*this->write_failure));
+    }
+
+    if (this->written_count >= this->appended_count)
+    {
+        return false;
+    }
+
+    this->persisted_tasks.emplace_back(this->appended_count, std::move(task));
+    return true;
+}
+
+
+void
+pbft_operation_log::collect_until(uint64_t last)
+{
+    std::unique_lock<std::mutex> lock(this->lock);
+
+    if (!this->write_behind)
+    {
+        if (this->collected < last)
+        {
+            this->collect_range(this->collected, last, last);
+            this->collected = last;
+        }
+        return;
+    }
+
+    this->collect_target = std::max(this->collect_target, last);
+    lock.unlock();
+
+    this->pending_changed.notify_all();
+}
+
+
+void
+pbft_operation_log::collect_range(uint64_t first, uint64_t last, uint64_t target)
+{
+    const auto timer_id = "pbft.gc." + std::to_string(reinterpret_cast<uintptr_t>(this)) + "." + std::to_string(first);
+    if (this->monitor)
+    {
+        this->monitor->start_timer(timer_id);
+    }
+
+    // drop the index entries before the records they point at
+    this->storage->remove_range(get_stage_index_uuid(), sequence_prefix(first), sequence_prefix(last));
+    this->storage->remove_range(get_uuid(), sequence_prefix(first), sequence_prefix(last));
+
+    LOG(debug) << "collected operation records for sequences " << first << " to " << last;
+
+    if (this->monitor)
+    {
+        this->monitor->finish_timer(bzn::statistic::pbft_gc_latency, timer_id);
+        this->monitor->send_counter(bzn::statistic::pbft_gc_sequences_collected, last - first);
+        this->monitor->send_gauge(bzn::statistic::pbft_gc_backlog, target - last);
+    }
+}
+
+
+void
+pbft_operation_log::flush()
+{
+    std::unique_lock<std::mutex> lock(this->lock);
+
+    const auto target = this->appended_count;
+    const auto collect_target = this->collect_target;
+    this->pending_changed.wait(lock, [&]()
+    {
+        return (this->written_count >= target && this->collected >= collect_target) || !this->writer.joinable();
+    });
+}
+
+
+void
+pbft_operation_log::flush_records()
+{
+    std::unique_lock<std::mutex> lock(this->lock);
+
+    const auto target = this->appended_count;
+    this->pending_changed.wait(lock, [&]()
+    {
+        return this->written_count >= target || this->write_failure || !this->writer.joinable();
+    });
+
+    if (this->write_failure)
+    {
+        throw std::runtime_error("operation log failed to persist records: " + storage_result_msg.at(*this->write_failure));
+    }
+}
+
+
+uint64_t
+pbft_operation_log::collected_until()
+{
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    return this->collected;
+}
+
+
+size_t
+pbft_operation_log::pending_count()
+{
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    return this->pending.size() + this->writing.size();
+}
+
+
+std::vector<std::pair<bzn::key_t, bzn::value_t>>
+pbft_operation_log::read_range(const bzn::uuid_t& uuid, const bzn::key_t& first, const bzn::key_t& last, bool keys_only) const
+{
+    std::map<bzn::key_t, bzn::value_t> result;
+
+    // take the queued records before reading storage; a record that leaves the queue meanwhile is already persisted
+    if (this->write_behind)
+    {
+        std::lock_guard<std::mutex> lock(this->lock);
+        for (const auto* queue : {&this->pending, &this->writing})
+        {
+            for (auto it = queue->lower_bound(std::make_pair(uuid, first));
+                it != queue->end() && it->first.first == uuid && (last.empty() || it->first.second < last); it++)
+            {
+                result.emplace(it->first.second, keys_only ? "" : it->second);
+            }
+        }
+    }
+
+    if (keys_only)
+    {
+        for (auto& key : this->storage->get_keys_if(uuid, first, last))
+        {
+            result.emplace(std::move(key), "");
+        }
+    }
+    else
+    {
+        for (auto& pair : this->storage->read_if(uuid, first, last))
+        {
+            result.emplace(std::move(pair));
+        }
+    }
+
+    return std::vector<std::pair<bzn::key_t, bzn::value_t>>(std::make_move_iterator(result.begin())
+        , std::make_move_iterator(result.end()));
+}
+
+
+std::optional<bzn::value_t>
+pbft_operation_log::read(const std::string& operation_prefix, record_type type, const std::string& tail) const
+{
+    auto key = std::make_pair(get_uuid(), record_key(operation_prefix, type, tail));
+    if (this->write_behind)
+    {
+        std::lock_guard<std::mutex> lock(this->lock);
+        for (const auto* queue : {&this->pending, &this->writing})
+        {
+            if (const auto it = queue->find(key); it != queue->end())
+            {
+                return it->second;
+            }
+        }
+    }
+
+    return this->storage->read(get_uuid(), key.second);
+}
+
+
+std::vector<pbft_operation_log::record_key_t>
+pbft_operation_log::operation_records(const std::string& operation_prefix) const
+{
+    std::vector<record_key_t> result;
+    for (const auto& record : this->read_range(get_uuid(), record_key(operation_prefix, record_type::stage)
+        , operation_prefix + static_cast<char>(static_cast<uint8_t>(record_type::commit) + 1), true))
+    {
+        record_key_t parsed;
+        if (parse_record_key(record.first, parsed))
+        {
+            result.emplace_back(std::move(parsed));
+        }
+    }
+
+    return result;
+}
+
+
+std::vector<std::pair<std::string, bzn::value_t>>
+pbft_operation_log::read_records(const std::string& operation_prefix, record_type type) const
+{
+    const auto first = record_key(operation_prefix, type);
+    const auto last = operation_prefix + static_cast<char>(static_cast<uint8_t>(type) + 1);
+
+    std::vector<std::pair<std::string, bzn::value_t>> result;
+    for (auto& pair : this->read_range(get_uuid(), first, last, false))
+    {
+        result.emplace_back(pair.first.substr(first.size()), std::move(pair.second));
+    }
+
+    return result;
+}
+
+
+std::vector<pbft_operation_log::record_key_t>
+pbft_operation_log::stage_records(uint64_t first, std::optional<uint64_t> last) const
+{
+    std::vector<record_key_t> result;
+    for (const auto& record : this->read_range(get_stage_index_uuid(), sequence_prefix(first), last ? sequence_prefix(*last) : "", true))
+    {
+        record_key_t parsed;
+        if (parse_record_key(record.first, parsed) && parsed.type == record_type::stage)
+        {
+            result.emplace_back(std::move(parsed));
+        }
+    }
+
+    return result;
+}
+
+
+void
+pbft_operation_log::remove_range(uint64_t first, uint64_t last)
+{
+    // records still queued for these operations must not be persisted after they are removed
+    this->flush();
+
+    this->collect_range(first, last, last);
+}
@@ -0,0 +1,182 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <include/bluzelle.hpp>
+#include <storage/storage_base.hpp>
+#include <monitor/monitor_base.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+namespace bzn
+{
+    /*
+     * Append-only log of what we know about pbft operations. Each fact - an operation's stage, its request and
+     * every preprepare, prepare and commit - is one record that is written once and never rewritten. Record keys are
+     * binary: the big endian sequence, the big endian view, the length prefixed request hash, the record type and
+     * a type specific tail (the sender of a message or the stage reached). The log therefore sorts by sequence and
+     * the records of an operation are contiguous.
+     *
+     * Stage records are also kept, under the same keys, in a separate stage index. Recovery and view changes walk
+     * only the index, so finding the prepared operations costs in proportion to the number of operations held rather
+     * than to the number of messages logged for them.
+     *
+     * A write behind log queues appended records in memory and a writer thread persists each batch of them with a
+     * single storage write, so appending never waits on storage. Anything sent on the strength of a record has to
+     * wait until it is persisted, either by handing the sending to when_persisted() or by calling flush_records()
+     * first. Reads see queued records as well as persisted ones. A second thread garbage collects old operations,
+     * a bounded range of sequences at a time and at most one range every COLLECT_STEP_INTERVAL, so that removing
+     * them never holds up records that are waiting to be persisted.
+     */
+    class pbft_operation_log
+    {
+    public:
+        enum class record_type : uint8_t
+        {
+            stage = 0,
+            request = 1,
+            preprepare = 2,
+            prepare = 3,
+            commit = 4
+        };
+
+        struct record_key_t
+        {
+            uint64_t sequence = 0;
+            uint64_t view = 0;
+            bzn::hash_t request_hash;
+            record_type type = record_type::stage;
+            std::string tail;
+        };
+
+        pbft_operation_log(std::shared_ptr<bzn::storage_base> storage, bool write_behind = false
+            , size_t max_pending = DEFAULT_MAX_PENDING_RECORDS, std::shared_ptr<bzn::monitor_base> monitor = nullptr);
+
+        ~pbft_operation_log();
+
+        /*
+         * Append a record
+         * @return storage_result::exists if it was already logged (a write behind log only knows about records
+         * still queued)
+         */
+        bzn::storage_result append(const std::string& operation_prefix, record_type type, const std::string& tail
+            , const bzn::value_t& value);
+
+        std::optional<bzn::value_t> read(const std::string& operation_prefix, record_type type, const std::string& tail = "") const;
+
+        /*
+         * Keys of all records of an operation, in log order
+         */
+        std::vector<record_key_t> operation_records(const std::string& operation_prefix) const;
+
+        /*
+         * Tails and values of the records of one type for an operation
+         */
+        std::vector<std::pair<std::string, bzn::value_t>> read_records(const std::string& operation_prefix, record_type type) const;
+
+        /*
+         * Stage records of all operations with sequences in [first, last), read from the stage index
+         */
+        std::vector<record_key_t> stage_records(uint64_t first, std::optional<uint64_t> last) const;
+
+        /*
+         * Drop the records of all operations with sequences in [first, last)
+         */
+        void remove_range(uint64_t first, uint64_t last);
+
+        /*
+         * Drop the records of all operations with sequences below last; a write behind log does so in the background
+         */
+        void collect_until(uint64_t last);
+
+        /*
+         * Wait until every record appended so far has been persisted and every requested collection is done
+         */
+        void flush();
+
+        /*
+         * Wait until every record appended so far has been persisted; throws if the log failed to persist them
+         */
+        void flush_records();
+
+        /*
+         * Have a background thread of the log run task once every record appended so far has been persisted. Tasks
+         * run in the order they were queued, and should only hand the work they stand for off to another thread.
+         * @return false, without queueing the task, if there is nothing left to persist; throws if the log failed
+         * to persist records
+         */
+        bool when_persisted(std::function<void()> task);
+
+        size_t pending_count();
+
+        uint64_t collected_until();
+
+        static constexpr size_t DEFAULT_MAX_PENDING_RECORDS = 10000;
+        static constexpr uint64_t MAX_COLLECT_SEQUENCES = 1000;
+        static constexpr std::chrono::milliseconds COLLECT_STEP_INTERVAL{10};
+
+        static const bzn::uuid_t& get_uuid();
+
+        static const bzn::uuid_t& get_stage_index_uuid();
+
+        static std::string operation_prefix(uint64_t view, uint64_t sequence, const bzn::hash_t& request_hash);
+
+        static std::string record_key(const std::string& operation_prefix, record_type type, const std::string& tail = "");
+
+        static bool parse_record_key(const std::string& key, record_key_t& parsed);
+
+    private:
+        static std::string sequence_prefix(uint64_t sequence);
+
+        // queued records with keys in [first, last), then the storage ones not among them, sorted by key
+        std::vector<std::pair<bzn::key_t, bzn::value_t>> read_range(const bzn::uuid_t& uuid, const bzn::key_t& first
+            , const bzn::key_t& last, bool keys_only) const;
+
+        void write_pending();
+        void collect_pending();
+        void run_persisted_tasks(std::unique_lock<std::mutex>& lock);
+        void collect_range(uint64_t first, uint64_t last, uint64_t target);
+
+        const std::shared_ptr<bzn::storage_base> storage;
+        const bool write_behind;
+        const size_t max_pending;
+        const std::shared_ptr<bzn::monitor_base> monitor;
+
+        using queue_t = std::map<std::pair<bzn::uuid_t, bzn::key_t>, bzn::value_t>;
+
+        // records are moved from pending to writing while the writer thread persists them
+        mutable std::mutex lock;
+        std::condition_variable pending_changed;
+        queue_t pending;
+        queue_t writing;
+        uint64_t appended_count = 0;
+        uint64_t written_count = 0;
+        std::optional<bzn::storage_result> write_failure;
+        std::deque<std::pair<uint64_t, std::function<void()>>> persisted_tasks; // by the appended_count they wait for
+        uint64_t collected = 0;
+        uint64_t collect_target = 0;
+        bool stopping = false;
+
+        std::thread writer;
+        std::thread collector;
+    };
+}
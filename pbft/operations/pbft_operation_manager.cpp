@@ -17,49 +17,91 @@
 #include <pbft/operations/pbft_persistent_operation.hpp>
 #include <utils/bytes_to_debug_string.hpp>
 #include <boost/format.hpp>
+#include <boost/pool/pool_alloc.hpp>
 
 using namespace bzn;
 
-pbft_operation_manager::pbft_operation_manager(std::shared_ptr<bzn::peers_beacon_base> peers, std::optional<std::shared_ptr<bzn::storage_base>> storage)
+namespace
+{
+    // an operation is made for every request, so they (and their shared_ptr control blocks) come from a pool
+    template <typename T, typename... Args>
+    std::shared_ptr<T>
+    make_pooled(Args&&... args)
+    {
+        return std::allocate_shared<T>(boost::fast_pool_allocator<T>(), std::forward<Args>(args)...);
+    }
+}
+
+pbft_operation_manager::pbft_operation_manager(std::shared_ptr<bzn::peers_beacon_base> peers, std::optional<std::shared_ptr<bzn::storage_base>> storage
+    , std::shared_ptr<bzn::monitor_base> monitor, bool write_behind)
     : peers(peers)
     , storage(storage)
+    , operation_log(storage ? std::make_shared<bzn::pbft_operation_log>(*storage, write_behind
+        , pbft_operation_log::DEFAULT_MAX_PENDING_RECORDS, std::move(monitor)) : nullptr)
 {
     if (!storage)
     {
         LOG(warning) << "pbft operation operation manager constructed without a storage backend; operations will not be persistent";
     }
+    else if (const auto migrated = pbft_persistent_operation::migrate_legacy_records(*storage, this->operation_log); migrated > 0)
+    {
+        LOG(info) << "migrated " << migrated << " operations from the old record format";
+    }
 }
 
 std::shared_ptr<pbft_operation>
-pbft_operation_manager::find_or_construct(uint64_t view, uint64_t sequence, const bzn::hash_t &request_hash)
+pbft_operation_manager::find(uint64_t view, uint64_t sequence, const bzn::hash_t& request_hash) const
 {
-    std::lock_guard<std::mutex> lock(this->pbft_lock);
+    if (auto lookup = this->held_operations.find(sequence); lookup != this->held_operations.end())
+    {
+        for (const auto& op : lookup->second)
+        {
+            if (op->get_view() == view && op->get_request_hash() == request_hash)
+            {
+                return op;
+            }
+        }
+    }
 
-    auto key = bzn::operation_key_t(view, sequence, request_hash);
+    return nullptr;
+}
 
-    auto lookup = this->held_operations.find(key);
-    if (lookup == this->held_operations.end())
+std::shared_ptr<pbft_operation>
+pbft_operation_manager::find_or_construct(uint64_t view, uint64_t sequence, const bzn::hash_t &request_hash)
+{
     {
-        LOG(debug) << "Creating operation for seq " << sequence << " view " << view << " req " << bytes_to_debug_string(request_hash);
+        std::shared_lock<std::shared_mutex> lock(this->pbft_lock);
 
-        std::shared_ptr<pbft_operation> op;
-        if (this->storage)
+        if (auto op = this->find(view, sequence, request_hash))
         {
-            op = std::make_shared<pbft_persistent_operation>(view, sequence, request_hash, *(this->storage));
-        }
-        else
-        {
-            op = std::make_shared<pbft_memory_operation>(view, sequence, request_hash);
+            return op;
         }
+    }
 
-        bool added;
-        std::tie(std::ignore, added) = this->held_operations.emplace(std::piecewise_construct, std::forward_as_tuple(std::move(key)), std::forward_as_tuple(op));
-        assert(added);
+    std::lock_guard<std::shared_mutex> lock(this->pbft_lock);
 
+    // another thread may have constructed it while we did not hold the lock
+    if (auto op = this->find(view, sequence, request_hash))
+    {
         return op;
     }
 
-    return lookup->second;
+    LOG(debug) << "Creating operation for seq " << sequence << " view " << view << " req " << bytes_to_debug_string(request_hash);
+
+    std::shared_ptr<pbft_operation> op;
+    if (this->storage)
+    {
+        op = make_pooled<pbft_persistent_operation>(view, sequence, request_hash, this->operation_log);
+    }
+    else
+    {
+        op = make_pooled<pbft_memory_operation>(view, sequence, request_hash);
+    }
+
+    this->held_operations[sequence].push_back(op);
+    this->held_count++;
+
+    return op;
 }
 
 std::shared_ptr<pbft_operation>
@@ -71,32 +113,41 @@ pbft_operation_manager::find_or_construct(const pbft_msg& msg)
 void
 pbft_operation_manager::delete_operations_until(uint64_t sequence)
 {
-    std::lock_guard<std::mutex> lock(this->pbft_lock);
+    std::lock_guard<std::shared_mutex> lock(this->pbft_lock);
 
     size_t ops_removed = 0;
-    auto it = this->held_operations.begin();
-    while (it != this->held_operations.end())
+    const auto end = this->held_operations.upper_bound(sequence);
+    for (auto it = this->held_operations.begin(); it != end; it++)
     {
-        if (it->second->get_sequence() <= sequence)
-        {
-            it = this->held_operations.erase(it);
-            ops_removed++;
-        }
-        else
-        {
-            it++;
-        }
+        ops_removed += it->second.size();
     }
+    this->held_operations.erase(this->held_operations.begin(), end);
+    this->held_count -= ops_removed;
 
     LOG(debug) << boost::format("Cleared %1% old operation records") % ops_removed;
 
     if (this->storage)
     {
-        LOG(debug) << "cleaning up operation state from storage";
-        pbft_persistent_operation::remove_range(*this->storage, 0, sequence);
+        LOG(debug) << "scheduling cleanup of operation state from storage";
+        this->operation_log->collect_until(sequence);
     }
 }
 
+void
+pbft_operation_manager::flush()
+{
+    if (this->operation_log)
+    {
+        this->operation_log->flush_records();
+    }
+}
+
+bool
+pbft_operation_manager::when_persisted(std::function<void()> task)
+{
+    return this->operation_log && this->operation_log->when_persisted(std::move(task));
+}
+
 std::map<uint64_t, std::shared_ptr<pbft_operation>>
 pbft_operation_manager::prepared_operations_since(uint64_t sequence)
 {
@@ -117,18 +168,23 @@ pbft_operation_manager::prepared_operations_since(uint64_t sequence)
 
     if (this->storage)
     {
-        for (const auto& op : pbft_persistent_operation::prepared_operations_in_range(*this->storage, sequence + 1))
+        for (const auto& op : pbft_persistent_operation::prepared_operations_in_range(this->operation_log, sequence + 1))
         {
             maybe_store(op);
         }
     }
     else
     {
-        for (const auto& pair : this->held_operations)
+        std::shared_lock<std::shared_mutex> lock(this->pbft_lock);
+
+        for (auto it = this->held_operations.upper_bound(sequence); it != this->held_operations.end(); it++)
         {
-            if (pair.second->get_sequence() > sequence && pair.second->is_prepared())
+            for (const auto& op : it->second)
             {
-                maybe_store(pair.second);
+                if (op->is_prepared())
+                {
+                    maybe_store(op);
+                }
             }
         }
     }
@@ -139,5 +195,7 @@ pbft_operation_manager::prepared_operations_since(uint64_t sequence)
 size_t
 pbft_operation_manager::held_operations_count()
 {
-    return this->held_operations.size();
+    std::shared_lock<std::shared_mutex> lock(this->pbft_lock);
+
+    return this->held_count;
 }
@@ -14,19 +14,23 @@
 
 #pragma once
 #include <pbft/operations/pbft_operation.hpp>
+#include <pbft/operations/pbft_operation_log.hpp>
 #include <include/bluzelle.hpp>
 #include <storage/storage_base.hpp>
 #include <optional>
 #include <mutex>
+#include <shared_mutex>
 #include <peers_beacon/peer_address.hpp>
 #include <peers_beacon/peers_beacon_base.hpp>
+#include <monitor/monitor_base.hpp>
 
 namespace bzn
 {
     class pbft_operation_manager
     {
     public:
-        pbft_operation_manager(std::shared_ptr<bzn::peers_beacon_base> peers, std::optional<std::shared_ptr<bzn::storage_base>> storage = std::nullopt);
+        pbft_operation_manager(std::shared_ptr<bzn::peers_beacon_base> peers, std::optional<std::shared_ptr<bzn::storage_base>> storage = std::nullopt
+            , std::shared_ptr<bzn::monitor_base> monitor = nullptr, bool write_behind = true);
 
         /*
          * Returns a (possibly freshly constructed) pbft_operation for a particular view/sequence/request_hash.
@@ -41,13 +45,38 @@ namespace bzn
 
         size_t held_operations_count();
 
+        /*
+         * Forget the operations with sequences up to and including sequence. Their persisted records are removed
+         * in the background.
+         */
         void delete_operations_until(uint64_t sequence);
 
+        /*
+         * Wait until everything recorded about operations so far is persisted. Messages that vouch for that state
+         * (preprepares, prepares, commits and viewchanges) must not be sent before.
+         */
+        void flush();
+
+        /*
+         * Have the log's writer thread run task once everything recorded about operations so far is persisted,
+         * rather than wait for it.
+         * @return false, without queueing the task, if it already is
+         */
+        bool when_persisted(std::function<void()> task);
+
     private:
-        std::mutex pbft_lock;
+        std::shared_mutex pbft_lock; // lookups of existing operations may run concurrently
         std::shared_ptr<bzn::peers_beacon_base> peers;
         const std::optional<std::shared_ptr<bzn::storage_base>> storage;
 
-        std::map<bzn::operation_key_t, std::shared_ptr<pbft_operation>> held_operations;
+        // shared by the persistent operations, which keep their state in memory and let it be written behind
+        const std::shared_ptr<bzn::pbft_operation_log> operation_log;
+
+        std::shared_ptr<pbft_operation> find(uint64_t view, uint64_t sequence, const bzn::hash_t& request_hash) const;
+
+        // operations by sequence; there is rarely more than one per sequence (one per view, or a conflicting
+        // preprepare), so garbage collection and range queries cost O(log n + k)
+        std::map<uint64_t, std::vector<std::shared_ptr<pbft_operation>>> held_operations;
+        size_t held_count = 0;
     };
 }
@@ -13,80 +13,106 @@
 // along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include <pbft/operations/pbft_persistent_operation.hpp>
-#include <boost/format.hpp>
 #include <include/bluzelle.hpp>
 #include <utils/bytes_to_debug_string.hpp>
 #include <pbft/pbft.hpp>
-#include <regex>
-#include <limits>
+#include <algorithm>
+#include <cctype>
+#include <map>
 
 using namespace bzn;
 
 namespace {
-    const std::string STAGE_KEY = "stage";
-    const std::string REQUEST_KEY = "request";
-    const std::string OPERATIONS_UUID = "pbft_operations_data";
+    using record_type = pbft_operation_log::record_type;
+
+    // where operations were kept before they moved to the operation log. Keys were the operation prefix,
+    // "<sequence>_<request hash>_<view>" with both integers 20 digits wide, followed by "_stage", "_request" or
+    // "_<pbft_msg_type>_<sender>"
+    const bzn::uuid_t LEGACY_OPERATIONS_UUID = "pbft_operations_data";
+    const std::string LEGACY_STAGE_KEY = "stage";
+    const std::string LEGACY_REQUEST_KEY = "request";
+    const size_t LEGACY_INTEGER_WIDTH = 20;
+
+    bool
+    parse_legacy_prefix(const std::string& prefix, uint64_t& view, uint64_t& sequence, bzn::hash_t& request_hash)
+    {
+        // the hash may contain anything, so the fields are found by their fixed widths rather than by separators
+        if (prefix.size() < 2 * (LEGACY_INTEGER_WIDTH + 1) || prefix[LEGACY_INTEGER_WIDTH] != '_'
+            || prefix[prefix.size() - LEGACY_INTEGER_WIDTH - 1] != '_')
+        {
+            return false;
+        }
+
+        const auto sequence_field = prefix.substr(0, LEGACY_INTEGER_WIDTH);
+        const auto view_field = prefix.substr(prefix.size() - LEGACY_INTEGER_WIDTH);
+        const auto is_number = [](const std::string& field)
+        {
+            return std::all_of(field.begin(), field.end(), [](char c){ return std::isdigit(static_cast<unsigned char>(c)); });
+        };
+
+        if (!is_number(sequence_field) || !is_number(view_field))
+        {
+            return false;
+        }
+
+        sequence = std::stoull(sequence_field);
+        view = std::stoull(view_field);
+        request_hash = prefix.substr(LEGACY_INTEGER_WIDTH + 1, prefix.size() - 2 * (LEGACY_INTEGER_WIDTH + 1));
+        return true;
+    }
+
+    record_type
+    record_type_for(pbft_msg_type type)
+    {
+        switch (type)
+        {
+            case pbft_msg_type::PBFT_MSG_PREPREPARE :
+                return record_type::preprepare;
+            case pbft_msg_type::PBFT_MSG_PREPARE :
+                return record_type::prepare;
+            case pbft_msg_type::PBFT_MSG_COMMIT :
+                return record_type::commit;
+            default:
+                throw std::runtime_error("no operation log record for pbft_msg_type " + pbft_msg_type_Name(type));
+        }
+    }
 }
 
-std::string
-pbft_persistent_operation::generate_prefix(uint64_t view, uint64_t sequence, const bzn::hash_t& request_hash)
+const std::string&
+pbft_persistent_operation::get_uuid()
 {
-    // Integers formatted to 20 digits, which is the maximum length of a 64 bit uint- they need to have constant length
-    // to be sorted correctly for prefix searches and the like
-    return (boost::format("%020u_%s_%020u") % sequence % request_hash % view).str();
+    return pbft_operation_log::get_uuid();
 }
 
 std::string
-pbft_persistent_operation::generate_key(const std::string& prefix, const std::string& key)
+pbft_persistent_operation::stage_tail(pbft_operation_stage stage)
 {
-    // Integers formatted to 20 digits, which is the maximum length of a 64 bit uint- they need to have constant length
-    // to be sorted correctly for prefix searches and the like
-    return prefix + "_" + key;
+    return std::string(1, static_cast<char>(stage));
 }
 
-std::string
-pbft_persistent_operation::prefix_for_sequence(uint64_t sequence)
+pbft_persistent_operation::pbft_persistent_operation(uint64_t view, uint64_t sequence, const bzn::hash_t& request_hash, std::shared_ptr<bzn::storage_base> storage)
+    : pbft_persistent_operation(view, sequence, request_hash, std::make_shared<pbft_operation_log>(std::move(storage)))
 {
-    return (boost::format("%020u_") % sequence).str();                // This is an inefficient search, but we can fix it if it matters
-
 }
 
-bool
-pbft_persistent_operation::parse_prefix(const std::string& prefix, uint64_t& view, uint64_t& sequence, bzn::hash_t& hash)
+pbft_persistent_operation::pbft_persistent_operation(uint64_t view, uint64_t sequence, const bzn::hash_t& request_hash, std::shared_ptr<bzn::pbft_operation_log> log)
+    : pbft_operation(view, sequence, request_hash)
+    , log(std::move(log))
+    , prefix(pbft_operation_log::operation_prefix(view, sequence, request_hash))
 {
-    auto hash_start = prefix.find_first_of('_');
-    auto hash_end = prefix.find_last_of('_');
-    if (hash_end >= (prefix.size() - 1) || hash_start >= hash_end)
+    // a write behind log cannot tell us whether storage already holds the stage record, so look before appending
+    if (this->load_records())
     {
-        return false;
+        LOG(trace) << "created persistent operation with prefix " << bzn::bytes_to_debug_string(this->prefix) << "; using existing records";
+        return;
     }
 
-    sequence = std::stoul(prefix.substr(0, hash_start));
-    view = std::stoul(prefix.substr(hash_end + 1));
-    hash = prefix.substr(hash_start + 1, hash_end - hash_start - 1);
-    return true;
-}
-
-const std::string&
-pbft_persistent_operation::get_uuid()
-{
-    return OPERATIONS_UUID;
-}
-
-pbft_persistent_operation::pbft_persistent_operation(uint64_t view, uint64_t sequence, const bzn::hash_t& request_hash, std::shared_ptr<bzn::storage_base> storage)
-        : pbft_operation(view, sequence, request_hash)
-        , storage(std::move(storage))
-        , prefix(pbft_persistent_operation::generate_prefix(view, sequence, request_hash))
-{
-    const auto response = this->storage->create(get_uuid(), generate_key(this->prefix, STAGE_KEY)
-        , std::to_string(static_cast<unsigned int>(pbft_operation_stage::prepare)));
+    const auto response = this->log->append(this->prefix, record_type::stage, stage_tail(pbft_operation_stage::prepare), "");
     switch (response)
     {
         case storage_result::ok:
-            LOG(trace) << "created persistent operation with prefix " << bzn::bytes_to_debug_string(this->prefix) << "; this is our first record of it";
-            break;
         case storage_result::exists:
-            LOG(trace) << "created persistent operation with prefix " << bzn::bytes_to_debug_string(this->prefix) << "; using existing records";
+            LOG(trace) << "created persistent operation with prefix " << bzn::bytes_to_debug_string(this->prefix) << "; this is our first record of it";
             break;
         default:
             throw std::runtime_error("failed to write stage of new persistent operation " + storage_result_msg.at(response));
@@ -95,14 +121,53 @@ pbft_persistent_operation::pbft_persistent_operation(uint64_t view, uint64_t seq
 
 // constructs operation already in storage without re-adding to storage
 pbft_persistent_operation::pbft_persistent_operation(std::shared_ptr<bzn::storage_base> storage, uint64_t view, uint64_t sequence, const bzn::hash_t& request_hash)
+    : pbft_persistent_operation(std::make_shared<pbft_operation_log>(std::move(storage)), view, sequence, request_hash)
+{
+}
+
+pbft_persistent_operation::pbft_persistent_operation(std::shared_ptr<bzn::pbft_operation_log> log, uint64_t view, uint64_t sequence, const bzn::hash_t& request_hash)
     : pbft_operation(view, sequence, request_hash)
-    , storage(std::move(storage))
-    , prefix(pbft_persistent_operation::generate_prefix(view, sequence, request_hash))
+    , log(std::move(log))
+    , prefix(pbft_operation_log::operation_prefix(view, sequence, request_hash))
 {
-    assert(this->storage->read(get_uuid(), generate_key(this->prefix, STAGE_KEY)));
+    const bool found = this->load_records();
+    assert(found);
+    (void) found;
     LOG(trace) << "re-hydrated operation with prefix " << bzn::bytes_to_debug_string(this->prefix);
 }
 
+bool
+pbft_persistent_operation::load_records()
+{
+    const auto records = this->log->operation_records(this->prefix);
+    for (const auto& record : records)
+    {
+        switch (record.type)
+        {
+            case record_type::stage:
+                if (!record.tail.empty())
+                {
+                    this->stage = std::max(this->stage, static_cast<pbft_operation_stage>(record.tail.front()));
+                }
+                break;
+            case record_type::preprepare:
+                this->preprepare_seen = true;
+                break;
+            case record_type::prepare:
+                this->prepares_seen.insert(record.tail);
+                break;
+            case record_type::commit:
+                this->commits_seen.insert(record.tail);
+                break;
+            case record_type::request:
+                this->request_logged = true;
+                break;
+        }
+    }
+
+    return !records.empty();
+}
+
 void
 pbft_persistent_operation::record_pbft_msg(const pbft_msg& msg, const bzn_envelope& encoded_msg)
 {
@@ -114,8 +179,11 @@ pbft_persistent_operation::record_pbft_msg(const pbft_msg& msg, const bzn_envelo
         return;
     }
 
-    const auto response = this->storage->create(get_uuid()
-        , generate_key(this->typed_prefix(msg.type()), encoded_msg.sender()), encoded_msg.SerializeAsString());
+    const bool duplicate = (msg.type() == pbft_msg_type::PBFT_MSG_PREPARE && this->prepares_seen.count(encoded_msg.sender()))
+        || (msg.type() == pbft_msg_type::PBFT_MSG_COMMIT && this->commits_seen.count(encoded_msg.sender()));
+
+    const auto response = duplicate ? storage_result::exists
+        : this->log->append(this->prefix, record_type_for(msg.type()), encoded_msg.sender(), encoded_msg.SerializeAsString());
 
     switch (response)
     {
@@ -124,21 +192,29 @@ pbft_persistent_operation::record_pbft_msg(const pbft_msg& msg, const bzn_envelo
             break;
         case storage_result::exists:
             LOG(debug) << "ignored duplicate " << pbft_msg_type_Name(msg.type()) << " from " << encoded_msg.sender() << " for operation " << bzn::bytes_to_debug_string(this->prefix);
-            break;
+            return;
         default:
             throw std::runtime_error("failed to write pbft_msg " + storage_result_msg.at(response));
     }
+
+    switch (msg.type())
+    {
+        case pbft_msg_type::PBFT_MSG_PREPREPARE :
+            this->preprepare_seen = true;
+            break;
+        case pbft_msg_type::PBFT_MSG_PREPARE :
+            this->prepares_seen.insert(encoded_msg.sender());
+            break;
+        default:
+            this->commits_seen.insert(encoded_msg.sender());
+            break;
+    }
 }
 
 pbft_operation_stage
 pbft_persistent_operation::get_stage() const
 {
-    const auto response = this->storage->read(get_uuid(), generate_key(this->prefix, STAGE_KEY));
-    if (!response)
-    {
-        throw std::runtime_error("failed to read stage of pbft_operation " + bzn::bytes_to_debug_string(this->prefix) + " from storage");
-    }
-    return static_cast<pbft_operation_stage>(std::stoi(*response));
+    return this->stage;
 }
 
 void
@@ -164,20 +240,21 @@ pbft_persistent_operation::advance_operation_stage(pbft_operation_stage new_stag
             throw std::runtime_error("unknown pbft_operation_stage: " + std::to_string(static_cast<int>(new_stage)));
     }
 
-    const auto response = this->storage->update(get_uuid(), generate_key(this->prefix, STAGE_KEY)
-        , std::to_string(static_cast<int>(new_stage)));
-    if (response != storage_result::ok)
+    // a stage is never overwritten; reaching one appends its record, and the latest stage is the highest logged
+    const auto response = this->log->append(this->prefix, record_type::stage, stage_tail(new_stage), "");
+    if (response != storage_result::ok && response != storage_result::exists)
     {
         throw std::runtime_error("failed to write operation stage update: " + storage_result_msg.at(response));
     }
+
+    this->stage = new_stage;
 }
 
 bool
 pbft_persistent_operation::is_preprepared() const
 {
     // TODO: maybe check if the sender of the preprepare is still in the peers list
-    auto prefix = this->typed_prefix(pbft_msg_type::PBFT_MSG_PREPREPARE);
-    return this->storage->get_keys_if(get_uuid(), prefix, this->increment_prefix(prefix)).size() > 0;
+    return this->preprepare_seen;
 }
 
 bool
@@ -195,17 +272,14 @@ pbft_persistent_operation::is_committed() const
 bool
 pbft_persistent_operation::is_ready_for_commit(const std::shared_ptr<bzn::peers_beacon_base>& peers) const
 {
-    auto prefix = this->typed_prefix(pbft_msg_type::PBFT_MSG_PREPARE);
-    return this->storage->get_keys_if(get_uuid(), prefix, this->increment_prefix(prefix)).size()
-        >= pbft::honest_majority_size(peers->current()->size()) && this->is_preprepared() && this->has_request();
+    return this->prepares_seen.size() >= pbft::honest_majority_size(peers->current()->size())
+        && this->is_preprepared() && this->has_request();
 }
 
 bool
 pbft_persistent_operation::is_ready_for_execute(const std::shared_ptr<bzn::peers_beacon_base>& peers) const
 {
-    auto prefix = this->typed_prefix(pbft_msg_type::PBFT_MSG_COMMIT);
-    return this->storage->get_keys_if(get_uuid(), prefix, this->increment_prefix(prefix)).size()
-        >= pbft::honest_majority_size(peers->current()->size()) && this->is_prepared();
+    return this->commits_seen.size() >= pbft::honest_majority_size(peers->current()->size()) && this->is_prepared();
 }
 
 void
@@ -217,8 +291,7 @@ pbft_persistent_operation::record_request(const bzn_envelope& encoded_request)
         return;
     }
 
-    const auto response = this->storage->create(get_uuid(), generate_key(this->prefix, REQUEST_KEY)
-        , encoded_request.SerializeAsString());
+    const auto response = this->log->append(this->prefix, record_type::request, "", encoded_request.SerializeAsString());
     switch (response)
     {
         case storage_result::ok:
@@ -229,13 +302,15 @@ pbft_persistent_operation::record_request(const bzn_envelope& encoded_request)
             break;
         case storage_result::value_too_large:
             LOG(debug) << "request too large to store: " << encoded_request.SerializeAsString().size() << " bytes, " << bzn::bytes_to_debug_string(this->prefix);
-            break;
+            return;
         default:
             throw std::runtime_error("failed to write request for operation " + bzn::bytes_to_debug_string(this->prefix));
     }
 
-    // this will allow future calls to record_request to short circuit
-    this->load_transient_request();
+    // keep the request we were given rather than reading it back from the log; this also allows future calls to
+    // record_request to short circuit
+    this->request_logged = true;
+    this->set_transient_request(encoded_request);
 }
 
 bool
@@ -248,18 +323,26 @@ pbft_persistent_operation::has_request() const
 void
 pbft_persistent_operation::load_transient_request() const
 {
-    if (this->transient_request_available)
+    if (this->transient_request_available || !this->request_logged)
     {
         return;
     }
 
-    const auto response = this->storage->read(get_uuid(), generate_key(this->prefix, REQUEST_KEY));
+    const auto response = this->log->read(this->prefix, record_type::request);
     if (!response.has_value())
     {
         return;
     }
 
-    this->transient_request.ParseFromString(*response);
+    bzn_envelope request;
+    request.ParseFromString(*response);
+    this->set_transient_request(request);
+}
+
+void
+pbft_persistent_operation::set_transient_request(const bzn_envelope& request) const
+{
+    this->transient_request = request;
     this->transient_request_available = true;
 
     if (this->transient_request.payload_case() == bzn_envelope::kDatabaseMsg)
@@ -270,6 +353,10 @@ pbft_persistent_operation::load_transient_request() const
     {
         this->transient_config_request.ParseFromString(this->transient_request.pbft_internal_request());
     }
+    else if (this->transient_request.payload_case() == bzn_envelope::kPbftRequestBatch)
+    {
+        this->transient_batch_request.ParseFromString(this->transient_request.pbft_request_batch());
+    }
 }
 
 bool
@@ -284,6 +371,12 @@ pbft_persistent_operation::has_config_request() const
     return this->has_request() && this->get_request().payload_case() == bzn_envelope::kPbftInternalRequest;
 }
 
+bool
+pbft_persistent_operation::has_batch_request() const
+{
+    return this->has_request() && this->get_request().payload_case() == bzn_envelope::kPbftRequestBatch;
+}
+
 const bzn_envelope&
 pbft_persistent_operation::get_request() const
 {
@@ -318,24 +411,28 @@ pbft_persistent_operation::get_database_msg() const
     return this->transient_database_request;
 }
 
-std::string
-pbft_persistent_operation::typed_prefix(pbft_msg_type pbft_type) const
+const pbft_request_batch&
+pbft_persistent_operation::get_batch_request() const
 {
-    return this->prefix + "_" + std::to_string(pbft_type);
+    if (!this->has_batch_request())
+    {
+        throw std::runtime_error("tried to get batch request of operation " + bzn::bytes_to_debug_string(this->prefix) + "; we have no such request");
+    }
+
+    return this->transient_batch_request;
 }
 
 bzn_envelope
 pbft_persistent_operation::get_preprepare() const
 {
-    auto keys = this->storage->get_keys_if(get_uuid(), this->typed_prefix(pbft_msg_type::PBFT_MSG_PREPREPARE)
-        , this->typed_prefix(pbft_msg_type::PBFT_MSG_PREPARE));
-    if (keys.size() == 0)
+    const auto records = this->log->read_records(this->prefix, record_type::preprepare);
+    if (records.empty())
     {
         throw std::runtime_error("tried to fetch a preprepare that we don't have for operation " + bzn::bytes_to_debug_string(this->prefix));
     }
 
     bzn_envelope env;
-    if (!env.ParseFromString(this->storage->read(get_uuid(), keys.at(0)).value_or("")))
+    if (!env.ParseFromString(records.front().second))
     {
         throw std::runtime_error("failed to parse or fetch preprepare that we supposedly have? " + bzn::bytes_to_debug_string(this->prefix));
     }
@@ -346,13 +443,10 @@ pbft_persistent_operation::get_preprepare() const
 std::map<bzn::uuid_t, bzn_envelope>
 pbft_persistent_operation::get_prepares() const
 {
-    auto keys = this->storage->get_keys_if(get_uuid(), this->typed_prefix(pbft_msg_type::PBFT_MSG_PREPARE)
-        , this->typed_prefix(pbft_msg_type::PBFT_MSG_COMMIT));
     std::map<uuid_t, bzn_envelope> result;
-
-    for (const auto& key : keys)
+    for (const auto& record : this->log->read_records(this->prefix, record_type::prepare))
     {
-        if (!result[key].ParseFromString(this->storage->read(get_uuid(), key).value_or("")))
+        if (!result[record.first].ParseFromString(record.second))
         {
             throw std::runtime_error("failed to parse or fetch prepare that we supposedly have? " + bzn::bytes_to_debug_string(this->prefix));
         }
@@ -365,38 +459,34 @@ std::vector<std::shared_ptr<pbft_persistent_operation>>
 pbft_persistent_operation::prepared_operations_in_range(std::shared_ptr<bzn::storage_base> storage, uint64_t start
     , std::optional<uint64_t> end)
 {
-    static const std::regex pattern(STAGE_KEY + "$");
-
-    auto first = (boost::format("%020u_") % start).str();
-    auto last = end ? (boost::format("%020u_") % *end).str() : "";
-    auto matches = storage->read_if(get_uuid(), first, last, [](const std::string& key, const std::string& value)->bool
-    {
-        return (value == std::to_string(static_cast<unsigned int>(pbft_operation_stage::commit))
-            || value == std::to_string(static_cast<unsigned int>(pbft_operation_stage::execute)))
-            && std::regex_search(key, pattern);
-    });
+    return prepared_operations_in_range(std::make_shared<pbft_operation_log>(std::move(storage)), start, end);
+}
 
+std::vector<std::shared_ptr<pbft_persistent_operation>>
+pbft_persistent_operation::prepared_operations_in_range(std::shared_ptr<bzn::pbft_operation_log> log, uint64_t start
+    , std::optional<uint64_t> end)
+{
     std::vector<std::shared_ptr<pbft_persistent_operation>> results;
-    for (const auto& m : matches)
+    std::optional<operation_key_t> last_op;
+    for (const auto& record : log->stage_records(start, end))
     {
-        auto prefix = m.first.substr(0, m.first.find("_" + STAGE_KEY));
-        auto key = generate_key(prefix, REQUEST_KEY);
-        auto res = storage->read(get_uuid(), key);
-        if (res)
+        if (record.tail.empty() || static_cast<pbft_operation_stage>(record.tail.front()) == pbft_operation_stage::prepare)
         {
-            uint64_t view;
-            uint64_t sequence;
-            bzn::hash_t hash;
-            if (parse_prefix(prefix, view, sequence, hash))
-            {
-                auto op = std::make_shared<pbft_persistent_operation>(storage, view, sequence, hash);
-                results.push_back(op);
-            }
-            else
-            {
-                LOG(error) << boost::format("Unable to parse stored operation at view:%1% sequence:%2% hash:%3%")
-                    % view % sequence % hash;
-            }
+            continue;
+        }
+
+        // an operation that reached execute also logged reaching commit; only look at it once
+        const operation_key_t key{record.view, record.sequence, record.request_hash};
+        if (last_op == key)
+        {
+            continue;
+        }
+        last_op = key;
+
+        auto op = std::make_shared<pbft_persistent_operation>(log, record.view, record.sequence, record.request_hash);
+        if (op->has_request())
+        {
+            results.push_back(op);
         }
     }
 
@@ -406,21 +496,109 @@ pbft_persistent_operation::prepared_operations_in_range(std::shared_ptr<bzn::sto
 void
 pbft_persistent_operation::remove_range(std::shared_ptr<bzn::storage_base> storage, uint64_t first, uint64_t last)
 {
-    storage->remove_range(get_uuid(), prefix_for_sequence(first), prefix_for_sequence(last));
+    pbft_operation_log(std::move(storage)).remove_range(first, last);
 }
 
-std::string
-pbft_persistent_operation::increment_prefix(const std::string& prefix) const
+void
+pbft_persistent_operation::remove_range(std::shared_ptr<bzn::pbft_operation_log> log, uint64_t first, uint64_t last)
+{
+    log->remove_range(first, last);
+}
+
+size_t
+pbft_persistent_operation::migrate_legacy_records(std::shared_ptr<bzn::storage_base> storage, std::shared_ptr<bzn::pbft_operation_log> log)
 {
-    auto result = prefix;
-    if (result.back() < std::numeric_limits<char>::max())
+    std::map<bzn::key_t, bzn::value_t> records;
+    for (auto& record : storage->read_if(LEGACY_OPERATIONS_UUID, "", ""))
     {
-        result.back()++;
+        records.emplace(std::move(record));
     }
-    else
+
+    if (records.empty())
     {
-        result += char(0x1);
+        return 0;
     }
 
-    return result;
+    const std::string stage_suffix = "_" + LEGACY_STAGE_KEY;
+
+    size_t migrated = 0;
+    bool failed = false;
+    const auto append = [&](const std::string& prefix, record_type type, const std::string& tail, const bzn::value_t& value)
+    {
+        const auto result = log->append(prefix, type, tail, value);
+        if (result != storage_result::ok && result != storage_result::exists)
+        {
+            LOG(error) << "failed to migrate record of operation " << bzn::bytes_to_debug_string(prefix) << ": " << storage_result_msg.at(result);
+            failed = true;
+        }
+    };
+
+    for (const auto& [stage_key, stage_value] : records)
+    {
+        if (stage_key.size() < stage_suffix.size()
+            || stage_key.compare(stage_key.size() - stage_suffix.size(), stage_suffix.size(), stage_suffix) != 0)
+        {
+            continue;
+        }
+
+        const auto legacy_prefix = stage_key.substr(0, stage_key.size() - stage_suffix.size());
+
+        uint64_t view;
+        uint64_t sequence;
+        bzn::hash_t request_hash;
+        if (!parse_legacy_prefix(legacy_prefix, view, sequence, request_hash) || stage_value.size() != 1
+            || stage_value[0] < '0' || stage_value[0] > '0' + static_cast<int>(pbft_operation_stage::execute))
+        {
+            LOG(warning) << "dropping unreadable operation record " << bzn::bytes_to_debug_string(stage_key);
+            continue;
+        }
+
+        const auto prefix = pbft_operation_log::operation_prefix(view, sequence, request_hash);
+
+        // the log keeps every stage reached, where the old format overwrote one
+        const auto stage = static_cast<pbft_operation_stage>(stage_value[0] - '0');
+        for (auto reached = pbft_operation_stage::prepare; reached <= stage;
+            reached = static_cast<pbft_operation_stage>(static_cast<int>(reached) + 1))
+        {
+            append(prefix, record_type::stage, stage_tail(reached), "");
+        }
+
+        const auto first = legacy_prefix + "_";
+        for (auto it = records.lower_bound(first); it != records.end() && it->first.compare(0, first.size(), first) == 0; ++it)
+        {
+            const auto tail = it->first.substr(first.size());
+            if (tail == LEGACY_STAGE_KEY)
+            {
+                continue;
+            }
+
+            if (tail == LEGACY_REQUEST_KEY)
+            {
+                append(prefix, record_type::request, "", it->second);
+                continue;
+            }
+
+            const auto separator = tail.find('_');
+            const auto type = separator == std::string::npos ? std::string{} : tail.substr(0, separator);
+            if (type == std::to_string(pbft_msg_type::PBFT_MSG_PREPREPARE) || type == std::to_string(pbft_msg_type::PBFT_MSG_PREPARE)
+                || type == std::to_string(pbft_msg_type::PBFT_MSG_COMMIT))
+            {
+                append(prefix, record_type_for(static_cast<pbft_msg_type>(std::stoi(type))), tail.substr(separator + 1), it->second);
+            }
+        }
+
+        migrated++;
+    }
+
+    log->flush_records();
+
+    // anything left behind would be lost with the old records, so they stay until a later start migrates them
+    if (failed)
+    {
+        return migrated;
+    }
+
+    storage->remove(LEGACY_OPERATIONS_UUID);
+
+    return migrated;
 }
@@ -15,8 +15,10 @@
 #pragma once
 
 #include <pbft/operations/pbft_operation.hpp>
+#include <pbft/operations/pbft_operation_log.hpp>
 #include <storage/storage_base.hpp>
 #include <proto/pbft.pb.h>
+#include <set>
 
 namespace bzn
 {
@@ -24,9 +26,11 @@ namespace bzn
     {
     public:
         pbft_persistent_operation(uint64_t view, uint64_t sequence, const bzn::hash_t& request_hash, std::shared_ptr<bzn::storage_base> storage);
+        pbft_persistent_operation(uint64_t view, uint64_t sequence, const bzn::hash_t& request_hash, std::shared_ptr<bzn::pbft_operation_log> log);
 
         // constructs operation already in storage
         pbft_persistent_operation(std::shared_ptr<bzn::storage_base> storage, uint64_t view, uint64_t sequence, const bzn::hash_t& request_hash);
+        pbft_persistent_operation(std::shared_ptr<bzn::pbft_operation_log> log, uint64_t view, uint64_t sequence, const bzn::hash_t& request_hash);
 
         void record_pbft_msg(const pbft_msg& msg, const bzn_envelope& encoded_msg) override;
 
@@ -43,37 +47,55 @@ namespace bzn
         bool has_request() const override;
         bool has_db_request() const override;
         bool has_config_request() const override;
+        bool has_batch_request() const override;
 
         const bzn_envelope& get_request() const override;
         const pbft_config_msg& get_config_request() const override;
         const database_msg& get_database_msg() const override;
+        const pbft_request_batch& get_batch_request() const override;
 
         bzn_envelope get_preprepare() const override;
         std::map<bzn::uuid_t, bzn_envelope> get_prepares() const override;
 
-        static std::string generate_prefix(uint64_t view, uint64_t sequence, const bzn::hash_t& request_hash);
         static const std::string& get_uuid();
 
         static std::vector<std::shared_ptr<pbft_persistent_operation>> prepared_operations_in_range(
             std::shared_ptr<bzn::storage_base> storage, uint64_t start, std::optional<uint64_t> end = std::nullopt);
+        static std::vector<std::shared_ptr<pbft_persistent_operation>> prepared_operations_in_range(
+            std::shared_ptr<bzn::pbft_operation_log> log, uint64_t start, std::optional<uint64_t> end = std::nullopt);
         static void remove_range(std::shared_ptr<bzn::storage_base> storage, uint64_t first, uint64_t last);
+        static void remove_range(std::shared_ptr<bzn::pbft_operation_log> log, uint64_t first, uint64_t last);
+
+        /*
+         * Move operations kept in the string keyed format that preceded the operation log into the log, then drop
+         * the old records. Records that cannot be parsed are dropped with them.
+         * @return the number of operations migrated
+         */
+        static size_t migrate_legacy_records(std::shared_ptr<bzn::storage_base> storage, std::shared_ptr<bzn::pbft_operation_log> log);
 
     private:
-        std::string typed_prefix(pbft_msg_type pbft_type) const;
+        // rebuilds the in memory state below from the records already in the log; false if there are none
+        bool load_records();
         void load_transient_request() const;
+        void set_transient_request(const bzn_envelope& request) const;
 
-        static std::string prefix_for_sequence(uint64_t sequence);
-        static std::string generate_key(const std::string& prefix, const std::string& key);
-        static bool parse_prefix(const std::string& prefix, uint64_t& view, uint64_t& sequence, bzn::hash_t& hash);
-        std::string increment_prefix(const std::string& prefix) const;
+        static std::string stage_tail(pbft_operation_stage stage);
 
-        const std::shared_ptr<bzn::storage_base> storage;
+        const std::shared_ptr<pbft_operation_log> log;
         const std::string prefix;
 
+        // everything the log holds about votes and progress, so that quorum checks never go to storage
+        pbft_operation_stage stage = pbft_operation_stage::prepare;
+        bool preprepare_seen = false;
+        std::set<bzn::uuid_t> prepares_seen;
+        std::set<bzn::uuid_t> commits_seen;
+        bool request_logged = false;
+
         mutable bool transient_request_available = false;
         mutable bzn_envelope transient_request;
         mutable database_msg transient_database_request;
         mutable pbft_config_msg transient_config_request;
+        mutable pbft_request_batch transient_batch_request;
     };
 
 }
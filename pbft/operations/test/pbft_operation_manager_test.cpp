@@ -130,4 +130,26 @@ namespace
         EXPECT_EQ(manager.held_operations_count(), 0u);
 
     }
+
+    TEST(pbft_operation_manager_test, delete_clears_every_operation_at_a_sequence)
+    {
+        bzn::pbft_operation_manager manager{static_peers_beacon_for(TEST_PEER_LIST)};
+        auto op1 = manager.find_or_construct(1, 5, "hash");
+        auto op2 = manager.find_or_construct(2, 5, "hash");
+        auto op3 = manager.find_or_construct(2, 5, "other hash");
+        auto op4 = manager.find_or_construct(1, 6, "hash");
+        make_prepared(op2);
+        make_prepared(op4);
+
+        EXPECT_EQ(manager.held_operations_count(), 4u);
+        EXPECT_EQ(manager.find_or_construct(2, 5, "other hash"), op3);
+        EXPECT_EQ(manager.prepared_operations_since(5).size(), 1u);
+        EXPECT_EQ(manager.prepared_operations_since(4).size(), 2u);
+
+        manager.delete_operations_until(5);
+        EXPECT_EQ(manager.held_operations_count(), 1u);
+        EXPECT_EQ(manager.find_or_construct(1, 6, "hash"), op4);
+        EXPECT_NE(manager.find_or_construct(1, 5, "hash"), op1);
+        EXPECT_EQ(manager.held_operations_count(), 2u);
+    }
 }
@@ -20,6 +20,12 @@
 #include <pbft/operations/pbft_operation.hpp>
 #include <boost/range/irange.hpp>
 #include <mocks/smart_mock_peers_beacon.hpp>
+#include <mocks/mock_storage_base.hpp>
+#include <mocks/mock_monitor.hpp>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
 
 using namespace ::testing;
 
@@ -200,6 +206,176 @@ namespace
         EXPECT_EQ(bzn::pbft_persistent_operation::prepared_operations_in_range(this->storage, 0, 100).size(), 50u);
     }
 
+    TEST_F(persistent_operation_test, log_keys_round_trip_and_sort_by_sequence)
+    {
+        const auto prefix = bzn::pbft_operation_log::operation_prefix(7, 258, "hash");
+        const auto key = bzn::pbft_operation_log::record_key(prefix, bzn::pbft_operation_log::record_type::prepare, "bob");
+
+        bzn::pbft_operation_log::record_key_t parsed;
+        ASSERT_TRUE(bzn::pbft_operation_log::parse_record_key(key, parsed));
+        EXPECT_EQ(parsed.view, 7u);
+        EXPECT_EQ(parsed.sequence, 258u);
+        EXPECT_EQ(parsed.request_hash, "hash");
+        EXPECT_EQ(parsed.type, bzn::pbft_operation_log::record_type::prepare);
+        EXPECT_EQ(parsed.tail, "bob");
+
+        EXPECT_FALSE(bzn::pbft_operation_log::parse_record_key(prefix.substr(0, 10), parsed));
+
+        // later sequences sort later whatever their view or hash
+        EXPECT_LT(bzn::pbft_operation_log::operation_prefix(1000, 2, "zzzz"), bzn::pbft_operation_log::operation_prefix(0, 3, ""));
+        EXPECT_LT(bzn::pbft_operation_log::operation_prefix(0, 255, "a"), bzn::pbft_operation_log::operation_prefix(0, 256, "a"));
+    }
+
+    TEST_F(persistent_operation_test, records_are_only_ever_appended)
+    {
+        const auto records = [&](){ return this->storage->get_size(bzn::pbft_persistent_operation::get_uuid()).first; };
+        EXPECT_EQ(records(), 1u);
+
+        record_request(this->operation);
+        record_pbft_messages(0, 1, PBFT_MSG_PREPREPARE, this->operation);
+        record_pbft_messages(0, 3, PBFT_MSG_PREPARE, this->operation);
+        record_pbft_messages(0, 3, PBFT_MSG_PREPARE, this->operation);
+        EXPECT_EQ(records(), 6u);
+
+        this->operation->advance_operation_stage(bzn::pbft_operation_stage::commit, this->static_beacon);
+        EXPECT_EQ(records(), 7u);
+
+        record_pbft_messages(0, 3, PBFT_MSG_COMMIT, this->operation);
+        this->operation->advance_operation_stage(bzn::pbft_operation_stage::execute, this->static_beacon);
+        EXPECT_EQ(records(), 11u);
+
+        auto op2 = std::make_shared<bzn::pbft_persistent_operation>(this->view, this->sequence, this->request_hash, this->storage);
+        EXPECT_EQ(op2->get_stage(), bzn::pbft_operation_stage::execute);
+        EXPECT_TRUE(op2->is_ready_for_execute(this->static_beacon));
+        EXPECT_EQ(records(), 11u);
+
+        // an executed operation has logged two stages past prepare, but is only reported once
+        EXPECT_EQ(bzn::pbft_persistent_operation::prepared_operations_in_range(this->storage, 0).size(), 1u);
+    }
+
+    TEST_F(persistent_operation_test, write_behind_log_keeps_storage_off_the_message_path)
+    {
+        auto mock_storage = std::make_shared<NiceMock<bzn::mock_storage_base>>();
+        std::promise<void> release;
+        std::shared_future<void> released = release.get_future().share();
+        const auto test_thread = std::this_thread::get_id();
+        std::atomic<size_t> creates_on_test_thread{0};
+
+        // persisting is held up until we release it, as if the disk were slow; each pass is a single write
+        EXPECT_CALL(*mock_storage, create(_, _, _)).Times(0);
+        ON_CALL(*mock_storage, create_batch(_)).WillByDefault(Invoke([&](const auto& records)
+        {
+            if (std::this_thread::get_id() == test_thread)
+            {
+                creates_on_test_thread++;
+            }
+            else
+            {
+                released.wait();
+            }
+            return this->storage->create_batch(records);
+        }));
+        ON_CALL(*mock_storage, read(_, _)).WillByDefault(Invoke([&](auto uuid, auto key)
+        {
+            return this->storage->read(uuid, key);
+        }));
+        ON_CALL(*mock_storage, read_if(_, _, _, _)).WillByDefault(Invoke([&](auto uuid, auto first, auto last, auto pred)
+        {
+            return this->storage->read_if(uuid, first, last, pred);
+        }));
+        ON_CALL(*mock_storage, get_keys_if(_, _, _, _)).WillByDefault(Invoke([&](auto uuid, auto first, auto last, auto pred)
+        {
+            return this->storage->get_keys_if(uuid, first, last, pred);
+        }));
+
+        auto log = std::make_shared<bzn::pbft_operation_log>(mock_storage, true);
+        auto op = std::make_shared<bzn::pbft_persistent_operation>(this->view, this->sequence + 1, this->request_hash, log);
+
+        record_request(op);
+        record_pbft_messages(0, 1, PBFT_MSG_PREPREPARE, op);
+        record_pbft_messages(0, 4, PBFT_MSG_PREPARE, op);
+        op->advance_operation_stage(bzn::pbft_operation_stage::commit, this->static_beacon);
+        record_pbft_messages(0, 4, PBFT_MSG_COMMIT, op);
+        op->advance_operation_stage(bzn::pbft_operation_stage::execute, this->static_beacon);
+        EXPECT_TRUE(op->is_committed());
+        EXPECT_GT(log->pending_count(), 0u);
+
+        // queued records are visible to readers of the log
+        auto op2 = std::make_shared<bzn::pbft_persistent_operation>(log, this->view, this->sequence + 1, this->request_hash);
+        EXPECT_EQ(op2->get_stage(), bzn::pbft_operation_stage::execute);
+        EXPECT_EQ(op2->get_prepares().size(), 4u);
+        EXPECT_EQ(op2->get_database_msg().header().nonce(), 6u);
+
+        release.set_value();
+        log->flush_records();
+        EXPECT_EQ(log->pending_count(), 0u);
+        EXPECT_EQ(creates_on_test_thread, 0u);
+
+        auto op3 = std::make_shared<bzn::pbft_persistent_operation>(this->storage, this->view, this->sequence + 1, this->request_hash);
+        EXPECT_EQ(op3->get_stage(), bzn::pbft_operation_stage::execute);
+        EXPECT_TRUE(op3->is_ready_for_execute(this->static_beacon));
+    }
+
+    TEST_F(persistent_operation_test, write_behind_log_runs_tasks_once_their_records_are_persisted)
+    {
+        auto mock_storage = std::make_shared<NiceMock<bzn::mock_storage_base>>();
+        std::promise<void> release;
+        std::shared_future<void> released = release.get_future().share();
+
+        ON_CALL(*mock_storage, create_batch(_)).WillByDefault(Invoke([&](const auto& records)
+        {
+            released.wait();
+            return this->storage->create_batch(records);
+        }));
+
+        auto log = std::make_shared<bzn::pbft_operation_log>(mock_storage, true);
+
+        // with nothing queued, the caller goes ahead itself
+        EXPECT_FALSE(log->when_persisted([](){ FAIL(); }));
+
+        auto op = std::make_shared<bzn::pbft_persistent_operation>(this->view, this->sequence, this->request_hash, log);
+        record_pbft_messages(0, 1, PBFT_MSG_PREPREPARE, op);
+
+        std::atomic<size_t> run{0};
+        std::atomic<bool> run_on_test_thread{false};
+        const auto test_thread = std::this_thread::get_id();
+        EXPECT_TRUE(log->when_persisted([&, raw_log = log.get()]()
+        {
+            run_on_test_thread = std::this_thread::get_id() == test_thread;
+            EXPECT_EQ(raw_log->pending_count(), 0u);
+            run++;
+        }));
+        EXPECT_EQ(run, 0u);
+
+        // the writer runs the task after the records it waits for, and before it exits
+        release.set_value();
+        op = nullptr;
+        log = nullptr;
+
+        EXPECT_EQ(run, 1u);
+        EXPECT_FALSE(run_on_test_thread);
+
+        // a log that writes as it goes never has anything to wait for
+        EXPECT_FALSE(bzn::pbft_operation_log(this->storage).when_persisted([](){ FAIL(); }));
+    }
+
+    TEST_F(persistent_operation_test, write_behind_log_reports_records_it_failed_to_persist)
+    {
+        auto mock_storage = std::make_shared<NiceMock<bzn::mock_storage_base>>();
+        EXPECT_CALL(*mock_storage, create_batch(_)).WillRepeatedly(Return(bzn::storage_result::not_saved));
+
+        auto log = std::make_shared<bzn::pbft_operation_log>(mock_storage, true);
+
+        // nothing may be sent on the strength of records that are not on disk; once a write has failed, later appends
+        // are refused as well
+        EXPECT_THROW(
+        {
+            auto op = std::make_shared<bzn::pbft_persistent_operation>(this->view, this->sequence + 1, this->request_hash, log);
+            record_pbft_messages(0, 1, PBFT_MSG_PREPREPARE, op);
+            log->flush_records();
+        }, std::runtime_error);
+    }
+
     TEST_F(persistent_operation_test, test_remove_range)
     {
         for (auto i : boost::irange(0, 100))
@@ -211,10 +387,267 @@ namespace
 
         // note - there's an extra operation in there from the constructor
         EXPECT_EQ(this->storage->get_size(bzn::pbft_persistent_operation::get_uuid()).first, 301u);
+        EXPECT_EQ(this->storage->get_size(bzn::pbft_operation_log::get_stage_index_uuid()).first, 101u);
         bzn::pbft_persistent_operation::remove_range(this->storage, 50, 60);
         EXPECT_EQ(this->storage->get_size(bzn::pbft_persistent_operation::get_uuid()).first, 271u);
+        EXPECT_EQ(this->storage->get_size(bzn::pbft_operation_log::get_stage_index_uuid()).first, 91u);
 
         bzn::pbft_persistent_operation::remove_range(this->storage, 0, 10);
         EXPECT_EQ(this->storage->get_size(bzn::pbft_persistent_operation::get_uuid()).first, 240u);
+        EXPECT_EQ(this->storage->get_size(bzn::pbft_operation_log::get_stage_index_uuid()).first, 80u);
+    }
+
+    TEST_F(persistent_operation_test, prepared_operations_are_found_through_the_stage_index)
+    {
+        for (auto i : boost::irange(10, 20))
+        {
+            auto op = std::make_shared<bzn::pbft_persistent_operation>(1, i, "some_hash", this->storage);
+            record_request(op);
+            record_pbft_messages(0, 1, PBFT_MSG_PREPREPARE, op);
+            record_pbft_messages(0, 4, PBFT_MSG_PREPARE, op);
+            if (i % 2)
+            {
+                op->advance_operation_stage(bzn::pbft_operation_stage::commit, this->static_beacon);
+            }
+        }
+
+        EXPECT_EQ(bzn::pbft_operation_log(this->storage).stage_records(10, 20).size(), 15u);
+        EXPECT_EQ(bzn::pbft_operation_log(this->storage).stage_records(15, std::nullopt).size(), 8u);
+
+        // recovery never looks at the message records, so it does not need them to be scanned past
+        auto mock_storage = std::make_shared<NiceMock<bzn::mock_storage_base>>();
+        EXPECT_CALL(*mock_storage, get_keys_if(bzn::pbft_operation_log::get_stage_index_uuid(), _, _, _))
+            .WillOnce(Invoke([&](auto uuid, auto first, auto last, auto pred)
+            {
+                return this->storage->get_keys_if(uuid, first, last, pred);
+            }));
+        EXPECT_CALL(*mock_storage, get_keys_if(bzn::pbft_operation_log::get_uuid(), _, _, _))
+            .Times(5)
+            .WillRepeatedly(Invoke([&](auto uuid, auto first, auto last, auto pred)
+            {
+                return this->storage->get_keys_if(uuid, first, last, pred);
+            }));
+        ON_CALL(*mock_storage, read(_, _)).WillByDefault(Invoke([&](auto uuid, auto key)
+        {
+            return this->storage->read(uuid, key);
+        }));
+
+        const auto prepared = bzn::pbft_persistent_operation::prepared_operations_in_range(mock_storage, 0);
+        ASSERT_EQ(prepared.size(), 5u);
+        for (const auto& op : prepared)
+        {
+            EXPECT_EQ(op->get_sequence() % 2, 1u);
+            EXPECT_TRUE(op->has_db_request());
+        }
+    }
+
+    TEST_F(persistent_operation_test, operations_in_the_old_format_are_migrated_into_the_log)
+    {
+        const bzn::uuid_t legacy_uuid = "pbft_operations_data";
+
+        // the old format keyed records by "<sequence>_<request hash>_<view>", with the integers 20 digits wide
+        database_msg request;
+        request.mutable_header()->set_nonce(1234);
+        bzn_envelope request_env;
+        request_env.set_database_msg(request.SerializeAsString());
+
+        pbft_msg preprepare;
+        preprepare.set_type(PBFT_MSG_PREPREPARE);
+        bzn_envelope preprepare_env;
+        preprepare_env.set_pbft(preprepare.SerializeAsString());
+        preprepare_env.set_sender("alice");
+
+        const std::string hash = "a_hash_with_underscores";
+        const std::string prefix = "00000000000000000007_" + hash + "_00000000000000000003";
+        this->storage->create(legacy_uuid, prefix + "_stage", "1");
+        this->storage->create(legacy_uuid, prefix + "_request", request_env.SerializeAsString());
+        this->storage->create(legacy_uuid, prefix + "_2_alice", preprepare_env.SerializeAsString());
+        for (const auto& sender : {"alice", "bob", "cindy"})
+        {
+            bzn_envelope prepare_env;
+            prepare_env.set_sender(sender);
+            this->storage->create(legacy_uuid, prefix + "_3_" + sender, prepare_env.SerializeAsString());
+        }
+        this->storage->create(legacy_uuid, "not an operation_stage", "0");
+
+        auto log = std::make_shared<bzn::pbft_operation_log>(this->storage);
+        EXPECT_EQ(bzn::pbft_persistent_operation::migrate_legacy_records(this->storage, log), 1u);
+        EXPECT_EQ(this->storage->get_size(legacy_uuid).first, 0u);
+
+        const auto prepared = bzn::pbft_persistent_operation::prepared_operations_in_range(log, 0);
+        ASSERT_EQ(prepared.size(), 1u);
+
+        auto op = prepared.front();
+        EXPECT_EQ(op->get_view(), 3u);
+        EXPECT_EQ(op->get_sequence(), 7u);
+        EXPECT_EQ(op->get_request_hash(), hash);
+        EXPECT_EQ(op->get_stage(), bzn::pbft_operation_stage::commit);
+        EXPECT_TRUE(op->is_preprepared());
+        EXPECT_EQ(op->get_prepares().size(), 3u);
+        ASSERT_TRUE(op->has_db_request());
+        EXPECT_EQ(op->get_database_msg().header().nonce(), 1234u);
+
+        // nothing is left to migrate the next time
+        EXPECT_EQ(bzn::pbft_persistent_operation::migrate_legacy_records(this->storage, log), 0u);
+    }
+
+    TEST_F(persistent_operation_test, write_behind_log_collects_old_operations_in_bounded_steps)
+    {
+        auto monitor = std::make_shared<NiceMock<bzn::mock_monitor>>();
+        auto log = std::make_shared<bzn::pbft_operation_log>(this->storage, true
+            , bzn::pbft_operation_log::DEFAULT_MAX_PENDING_RECORDS, monitor);
+
+        const uint64_t OPERATIONS = 2 * bzn::pbft_operation_log::MAX_COLLECT_SEQUENCES + 500;
+        for (uint64_t i = 0; i < OPERATIONS + 10; i++)
+        {
+            auto op = std::make_shared<bzn::pbft_persistent_operation>(1, i, "some_hash", log);
+            record_pbft_messages(0, 1, PBFT_MSG_PREPREPARE, op);
+        }
+
+        {
+            InSequence s;
+            EXPECT_CALL(*monitor, send_counter(bzn::statistic::pbft_gc_sequences_collected, bzn::pbft_operation_log::MAX_COLLECT_SEQUENCES)).Times(2);
+            EXPECT_CALL(*monitor, send_counter(bzn::statistic::pbft_gc_sequences_collected, 500u));
+        }
+        EXPECT_CALL(*monitor, send_gauge(bzn::statistic::pbft_gc_backlog, OPERATIONS - bzn::pbft_operation_log::MAX_COLLECT_SEQUENCES));
+        EXPECT_CALL(*monitor, send_gauge(bzn::statistic::pbft_gc_backlog, 500u));
+        EXPECT_CALL(*monitor, send_gauge(bzn::statistic::pbft_gc_backlog, 0u));
+        EXPECT_CALL(*monitor, finish_timer(bzn::statistic::pbft_gc_latency, _)).Times(3);
+
+        const auto start = std::chrono::steady_clock::now();
+        log->collect_until(OPERATIONS);
+        log->flush();
+
+        // steps after the first are spaced out
+        EXPECT_GE(std::chrono::steady_clock::now() - start, 2 * bzn::pbft_operation_log::COLLECT_STEP_INTERVAL);
+        EXPECT_EQ(log->collected_until(), OPERATIONS);
+        EXPECT_EQ(log->stage_records(0, std::nullopt).size(), 10u);
+        EXPECT_EQ(this->storage->get_size(bzn::pbft_persistent_operation::get_uuid()).first, 10u * 2u);
+
+        // collecting below what was already collected does nothing
+        log->collect_until(10);
+        log->flush();
+        EXPECT_EQ(log->collected_until(), OPERATIONS);
+    }
+
+    TEST_F(persistent_operation_test, write_behind_log_collects_while_records_keep_arriving)
+    {
+        auto mock_storage = std::make_shared<NiceMock<bzn::mock_storage_base>>();
+        std::shared_ptr<bzn::pbft_operation_log> log;
+        std::atomic<bool> arriving{false};
+        uint64_t next_sequence = 0;
+
+        // while arriving is set, another operation is queued during every write, so the queue never drains
+        ON_CALL(*mock_storage, create_batch(_)).WillByDefault(Invoke([&](const auto& records)
+        {
+            if (arriving)
+            {
+                auto op = std::make_shared<bzn::pbft_persistent_operation>(1, next_sequence++, "some_hash", log);
+                record_pbft_messages(0, 1, PBFT_MSG_PREPREPARE, op);
+            }
+            return this->storage->create_batch(records);
+        }));
+        ON_CALL(*mock_storage, remove_range(_, _, _)).WillByDefault(Invoke([&](auto uuid, auto first, auto last)
+        {
+            this->storage->remove_range(uuid, first, last);
+        }));
+
+        log = std::make_shared<bzn::pbft_operation_log>(mock_storage, true);
+
+        const uint64_t OPERATIONS = 100;
+        for (; next_sequence < OPERATIONS; next_sequence++)
+        {
+            auto op = std::make_shared<bzn::pbft_persistent_operation>(1, next_sequence, "some_hash", log);
+            record_pbft_messages(0, 1, PBFT_MSG_PREPREPARE, op);
+        }
+        log->flush_records();
+
+        // the writer is idle here, so this starts the stream that keeps it busy from now on
+        arriving = true;
+        auto op = std::make_shared<bzn::pbft_persistent_operation>(1, next_sequence++, "some_hash", log);
+        log->collect_until(OPERATIONS);
+
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (log->collected_until() < OPERATIONS && std::chrono::steady_clock::now() < deadline)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        EXPECT_EQ(log->collected_until(), OPERATIONS);
+        arriving = false;
+        log->flush();
+        EXPECT_TRUE(log->stage_records(0, OPERATIONS).empty());
+    }
+
+    TEST_F(persistent_operation_test, write_behind_log_persists_records_while_collection_is_slow)
+    {
+        auto mock_storage = std::make_shared<NiceMock<bzn::mock_storage_base>>();
+        std::promise<void> release;
+        std::shared_future<void> released = release.get_future().share();
+
+        // removing old records is held up until we release it, as if compaction had stalled the disk
+        ON_CALL(*mock_storage, create_batch(_)).WillByDefault(Invoke([&](const auto& records)
+        {
+            return this->storage->create_batch(records);
+        }));
+        ON_CALL(*mock_storage, remove_range(_, _, _)).WillByDefault(Invoke([&](auto uuid, auto first, auto last)
+        {
+            released.wait();
+            this->storage->remove_range(uuid, first, last);
+        }));
+
+        auto log = std::make_shared<bzn::pbft_operation_log>(mock_storage, true);
+
+        for (uint64_t i = 0; i < 10; i++)
+        {
+            auto op = std::make_shared<bzn::pbft_persistent_operation>(1, i, "some_hash", log);
+            record_pbft_messages(0, 1, PBFT_MSG_PREPREPARE, op);
+        }
+        log->flush_records();
+        log->collect_until(5);
+
+        // new records are persisted without waiting for the collection in progress
+        auto op = std::make_shared<bzn::pbft_persistent_operation>(1, 10, "some_hash", log);
+        record_pbft_messages(0, 4, PBFT_MSG_PREPARE, op);
+        log->flush_records();
+        EXPECT_EQ(log->pending_count(), 0u);
+        EXPECT_EQ(log->collected_until(), 0u);
+
+        release.set_value();
+        log->flush();
+        EXPECT_EQ(log->collected_until(), 5u);
+        EXPECT_EQ(this->storage->get_size(bzn::pbft_operation_log::get_stage_index_uuid()).first, 6u);
+    }
+
+    TEST_F(persistent_operation_test, DISABLED_benchmark_recovery_of_100k_operations)
+    {
+        const uint64_t OPERATIONS = 100000;
+        const uint64_t UNCHECKPOINTED = 1000;
+
+        for (uint64_t i = 0; i < OPERATIONS; i++)
+        {
+            auto op = std::make_shared<bzn::pbft_persistent_operation>(1, i, "some_hash", this->storage);
+            record_request(op, i);
+            record_pbft_messages(0, 1, PBFT_MSG_PREPREPARE, op);
+            record_pbft_messages(0, 4, PBFT_MSG_PREPARE, op);
+            op->advance_operation_stage(bzn::pbft_operation_stage::commit, this->static_beacon);
+            record_pbft_messages(0, 4, PBFT_MSG_COMMIT, op);
+            op->advance_operation_stage(bzn::pbft_operation_stage::execute, this->static_beacon);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        const auto all = bzn::pbft_persistent_operation::prepared_operations_in_range(this->storage, 0);
+        const auto full = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+        start = std::chrono::steady_clock::now();
+        const auto recent = bzn::pbft_persistent_operation::prepared_operations_in_range(this->storage, OPERATIONS - UNCHECKPOINTED);
+        const auto tail = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+        EXPECT_EQ(all.size(), OPERATIONS);
+        EXPECT_EQ(recent.size(), UNCHECKPOINTED);
+
+        std::cout << this->storage->get_size(bzn::pbft_persistent_operation::get_uuid()).first << " log records: recovering "
+            << OPERATIONS << " operations took " << full.count() << "us, the last " << UNCHECKPOINTED << " took "
+            << tail.count() << "us" << std::endl;
     }
 }
@@ -13,6 +13,7 @@
 // along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include <pbft/pbft.hpp>
+#include <pbft/pbft_quorum_certificate.hpp>
 #include <pbft/operations/pbft_memory_operation.hpp>
 #include <pbft/operations/pbft_operation_manager.hpp>
 #include <utils/make_endpoint.hpp>
@@ -32,6 +33,63 @@
 
 using namespace bzn;
 
+namespace
+{
+    // Allowing the maximum size to simply be bzn::MAX_VALUE_SIZE does not take into account the overhead that the
+    // primary peer will add to the message when it re-broadcasts the request to the other peers in the swarm. This
+    // additional overhead has been experimentally determined, on MacOS, to be 245 bytes. For now we shall use the magic
+    // number overhead size of 512 when we limit
+    const size_t OVERHEAD_SIZE{512};
+
+    // each request in a batch also carries its field tag and length prefix
+    const size_t BATCH_ENTRY_OVERHEAD_SIZE{1 + 5};
+
+    std::vector<const bzn_envelope*>
+    envelope_pointers(const google::protobuf::RepeatedPtrField<bzn_envelope>& envelopes)
+    {
+        std::vector<const bzn_envelope*> result;
+        result.reserve(envelopes.size());
+        for (const auto& envelope : envelopes)
+        {
+            result.push_back(&envelope);
+        }
+
+        return result;
+    }
+
+    // the checkpoint and prepared proofs a viewchange carries
+    void
+    add_proof_envelopes(const pbft_msg& msg, std::vector<bzn_envelope>& envelopes)
+    {
+        envelopes.insert(envelopes.end(), msg.checkpoint_messages().begin(), msg.checkpoint_messages().end());
+        for (const auto& proof : msg.prepared_proofs())
+        {
+            envelopes.push_back(proof.pre_prepare());
+            envelopes.insert(envelopes.end(), proof.prepare().begin(), proof.prepare().end());
+        }
+    }
+
+    // everything a viewchange or newview carries whose signature its handler relies on
+    std::vector<bzn_envelope>
+    embedded_envelopes(const pbft_msg& msg)
+    {
+        std::vector<bzn_envelope> envelopes;
+        add_proof_envelopes(msg, envelopes);
+        envelopes.insert(envelopes.end(), msg.pre_prepare_messages().begin(), msg.pre_prepare_messages().end());
+        for (const auto& viewchange_env : msg.viewchange_messages())
+        {
+            pbft_msg viewchange;
+            if (viewchange.ParseFromString(viewchange_env.pbft()))
+            {
+                bzn::expand_quorum_certificates(viewchange);
+                add_proof_envelopes(viewchange, envelopes);
+            }
+        }
+
+        return envelopes;
+    }
+}
+
 
 pbft::pbft(
     std::shared_ptr<bzn::node_base> node
@@ -56,12 +114,22 @@ pbft::pbft(
     , peers_beacon(std::move(peers))
     , checkpoint_manager(std::make_shared<pbft_checkpoint_manager>(this->io_context, this->storage, this->peers_beacon, this->node))
     , monitor(std::move(monitor))
+    , verification_stage(std::make_unique<pbft_verification_stage>(this->io_context, this->crypto, this->monitor
+        , this->options->get_pbft_verifier_threads()))
 {
     if (this->peers_beacon->current()->empty())
     {
         throw std::runtime_error("No peers found!");
     }
 
+    // a batch is recorded as a single request, so it has to fit in the value size storage allows
+    this->request_batch_max_bytes = std::min(this->options->get_pbft_batch_max_bytes(), bzn::MAX_VALUE_SIZE - OVERHEAD_SIZE);
+    if (this->request_batch_max_bytes < this->options->get_pbft_batch_max_bytes())
+    {
+        LOG(warning) << boost::format("Limiting request batches to %1% bytes rather than the configured %2%")
+            % this->request_batch_max_bytes % this->options->get_pbft_batch_max_bytes();
+    }
+
     this->initialize_persistent_state();
 
     this->service->save_service_state_at(((this->next_issued_sequence_number.value() / CHECKPOINT_INTERVAL) + 1) * CHECKPOINT_INTERVAL);
@@ -119,6 +187,9 @@ pbft::start()
                     if (strong_this)
                     {
                         strong_this->last_executed_sequence_number = op->get_sequence();
+                        strong_this->monitor->send_gauge(bzn::statistic::pbft_window_occupancy
+                            , strong_this->pipeline_occupancy());
+
                         if (op->get_sequence() % CHECKPOINT_INTERVAL == 0)
                         {
                             // tell service to save the next checkpoint after this one
@@ -184,6 +255,8 @@ pbft::handle_bzn_message(const bzn_envelope& msg, std::shared_ptr<bzn::session_b
         return;
     }
 
+    bzn::expand_quorum_certificates(inner_msg);
+
     this->handle_message(inner_msg, msg);
 }
 
@@ -199,15 +272,15 @@ pbft::handle_membership_message(const bzn_envelope& msg, std::shared_ptr<bzn::se
         return;
     }
 
+    bzn::expand_quorum_certificates(inner_msg);
+
     if ((!msg.sender().empty()) && this->options->get_peer_message_signing() && (!this->crypto->verify(msg)))
     {
         LOG(error) << "Dropping message with invalid signature: " << msg.ShortDebugString().substr(0, MAX_MESSAGE_SIZE);
         return;
     }
 
-    const auto hash = this->crypto->hash(msg);
-
-    std::lock_guard<std::mutex> lock(this->pbft_lock);
+    std::lock_guard<std::shared_mutex> lock(this->pbft_lock);
 
     switch (inner_msg.type())
     {
@@ -215,7 +288,7 @@ pbft::handle_membership_message(const bzn_envelope& msg, std::shared_ptr<bzn::se
             this->handle_get_state(inner_msg, std::move(session));
             break;
         case PBFT_MMSG_SET_STATE:
-            this->handle_set_state(inner_msg);
+            this->handle_set_state(inner_msg, msg.sender());
             break;
         default:
             LOG(error) << "Invalid membership message received "
@@ -228,28 +301,112 @@ pbft::handle_message(const pbft_msg& msg, const bzn_envelope& original_msg)
 {
     LOG(debug) << "Received message: " << msg.ShortDebugString().substr(0, MAX_MESSAGE_SIZE) << "\nFrom: " << original_msg.sender();
 
-    std::lock_guard<std::mutex> lock(this->pbft_lock);
-
-    auto peers = this->peers_beacon->current();
-    auto find = std::find_if(peers->begin(), peers->end(),
-            [&](const auto& peer)
-            {
-                return peer.uuid == original_msg.sender();
-            });
-    if (find == std::end(*peers))
+    if (!this->is_peer(original_msg.sender()))
     {
         LOG(debug) << "Dropping message because it is not from a peer";
         return;
     }
 
-    if (!this->preliminary_filter_msg(msg))
+    if (original_msg.sender().empty() || !this->options->get_peer_message_signing())
+    {
+        this->handle_verified_message(msg, original_msg);
+        return;
+    }
+
+    // stale messages are dropped before they take a verifier's time; the filter runs again once they are verified,
+    // since the view or the low water mark may have moved on while they were queued
+    {
+        std::shared_lock<std::shared_mutex> lock(this->pbft_lock);
+
+        if (!this->preliminary_filter_msg(msg))
+        {
+            return;
+        }
+    }
+
+    // verify ahead of the state machine so that no signature check is done while holding pbft_lock
+    auto msg_copy = std::make_shared<const pbft_msg>(msg);
+    auto env_copy = std::make_shared<const bzn_envelope>(original_msg);
+
+    if (msg.type() == PBFT_MSG_VIEWCHANGE || msg.type() == PBFT_MSG_NEWVIEW)
     {
+        // the proofs these carry are verified here as well, and the handlers look the results up by envelope
+        auto embedded = embedded_envelopes(msg);
+        std::vector<std::string> embedded_keys;
+        embedded_keys.reserve(embedded.size());
+        for (const auto& envelope : embedded)
+        {
+            embedded_keys.push_back(envelope.SerializeAsString());
+        }
+
+        this->verification_stage->submit(env_copy, std::move(embedded),
+            [weak_this = this->weak_from_this(), msg_copy, env_copy, embedded_keys = std::move(embedded_keys)]
+            (bool valid, const std::vector<bool>& embedded_valid)
+            {
+                if (!valid)
+                {
+                    LOG(error) << "Dropping message with invalid signature: " << env_copy->ShortDebugString().substr(0, MAX_MESSAGE_SIZE);
+                    return;
+                }
+
+                std::unordered_map<std::string, bool> verified_embedded;
+                for (size_t i = 0; i < embedded_keys.size(); ++i)
+                {
+                    auto result = verified_embedded.emplace(embedded_keys[i], embedded_valid[i]);
+                    result.first->second = result.first->second && embedded_valid[i];
+                }
+
+                if (auto strong_this = weak_this.lock())
+                {
+                    strong_this->handle_verified_message(*msg_copy, *env_copy, std::move(verified_embedded));
+                }
+            });
         return;
     }
 
-    if ((!original_msg.sender().empty()) && this->options->get_peer_message_signing() && (!this->crypto->verify(original_msg)))
+    // a message dropped by a full queue is recovered like any other lost message
+    this->verification_stage->submit(env_copy,
+        [weak_this = this->weak_from_this(), msg_copy, env_copy](bool valid)
+        {
+            if (!valid)
+            {
+                LOG(error) << "Dropping message with invalid signature: " << env_copy->ShortDebugString().substr(0, MAX_MESSAGE_SIZE);
+                return;
+            }
+
+            if (auto strong_this = weak_this.lock())
+            {
+                strong_this->handle_verified_message(*msg_copy, *env_copy);
+            }
+        });
+}
+
+void
+pbft::handle_verified_message(const pbft_msg& msg, const bzn_envelope& original_msg,
+    std::unordered_map<std::string, bool> verified_embedded)
+{
+    if (auto t = msg.type(); t == PBFT_MSG_PREPREPARE || t == PBFT_MSG_PREPARE || t == PBFT_MSG_COMMIT)
+    {
+        std::shared_lock<std::shared_mutex> lock(this->pbft_lock);
+        std::lock_guard<std::mutex> sequence_lock(this->sequence_lock(msg.sequence()));
+
+        this->dispatch_message(msg, original_msg);
+    }
+    else
+    {
+        std::lock_guard<std::shared_mutex> lock(this->pbft_lock);
+
+        this->verified_embedded_envelopes = std::move(verified_embedded);
+        this->dispatch_message(msg, original_msg);
+        this->verified_embedded_envelopes.clear();
+    }
+}
+
+void
+pbft::dispatch_message(const pbft_msg& msg, const bzn_envelope& original_msg)
+{
+    if (!this->preliminary_filter_msg(msg))
     {
-        LOG(error) << "Dropping message with invalid signature: " << original_msg.ShortDebugString().substr(0, MAX_MESSAGE_SIZE);
         return;
     }
 
@@ -285,6 +442,19 @@ pbft::preliminary_filter_msg(const pbft_msg& msg)
         return false;
     }
 
+    // verified messages can be continued out of the order they arrived in. Preprepares, prepares and commits are
+    // recorded against their operation in any order, and are only checked against the current view and watermarks.
+    // Viewchanges are counted per view and sender. A newview that was overtaken by a later one must not take the
+    // view back, so view changes to a view we are already in or past are dropped here...
+    if (auto t = msg.type(); t == PBFT_MSG_VIEWCHANGE || t == PBFT_MSG_NEWVIEW)
+    {
+        if (msg.view() <= this->view.value())
+        {
+            LOG(debug) << "Dropping message because view " << msg.view() << " is not ahead of the current view";
+            return false;
+        }
+    }
+
     if (auto t = msg.type();t == PBFT_MSG_PREPREPARE || t == PBFT_MSG_PREPARE || t == PBFT_MSG_COMMIT)
     {
         if (msg.view() != this->view.value())
@@ -292,6 +462,13 @@ pbft::preliminary_filter_msg(const pbft_msg& msg)
             LOG(debug) << "Dropping message because it has the wrong view number";
             return false;
         }
+
+        // operations at or below the low water mark are settled and their records may already be collected
+        if (msg.sequence() <= this->get_low_water_mark())
+        {
+            LOG(debug) << "Dropping message because its sequence " << msg.sequence() << " is at or below the low water mark";
+            return false;
+        }
     }
 
     return true;
@@ -304,6 +481,7 @@ pbft::setup_request_operation(const bzn_envelope& request_env, const bzn::hash_t
     this->next_issued_sequence_number = request_seq + 1;
     auto op = this->operation_manager->find_or_construct(this->view.value(), request_seq, request_hash);
     op->record_request(request_env);
+    this->note_sequence_in_flight(request_seq);
 
     return op;
 }
@@ -344,11 +522,6 @@ pbft::handle_request(const bzn_envelope& request_env, const std::shared_ptr<sess
         return;
     }
 
-    // Allowing the maximum size to simply be bzn::MAX_VALUE_SIZE does not take into account the overhead that the
-    // primary peer will add to the message when it re-broadcasts the request to the other peers in the swarm. This
-    // additional overhead has been experimentally determined, on MacOS, to be 245 bytes. For now we shall use the magic
-    // number overhead size of 512 when we limit
-    const size_t OVERHEAD_SIZE{512};
     if (!request_env.database_msg().empty() && request_env.database_msg().size() >= (bzn::MAX_VALUE_SIZE - OVERHEAD_SIZE))
     {
         this->send_error_response(request_env, session, hash, TOO_LARGE_ERROR_MSG);
@@ -369,11 +542,12 @@ pbft::handle_request(const bzn_envelope& request_env, const std::shared_ptr<sess
 
     if (!this->is_primary())
     {
-        this->forward_request_to_primary(request_env);
+        this->forward_request_to_primary(request_env, hash);
         return;
     }
 
-    if ((this->next_issued_sequence_number.value()) - this->last_executed_sequence_number > this->options->get_admission_window())
+    if (this->pipeline_occupancy() >= this->options->get_admission_window()
+        || !this->is_in_pipeline_window(this->next_issued_sequence_number.value()))
     {
         LOG(debug) << "Rejecting request because we're too busy";
         this->send_error_response(request_env, session, hash, TOO_BUSY_ERROR_MSG);
@@ -388,19 +562,129 @@ pbft::handle_request(const bzn_envelope& request_env, const std::shared_ptr<sess
         return;
     }
 
-    if ((!request_env.sender().empty()) && (!this->crypto->verify(request_env)))
+    this->saw_request(request_env, hash);
+
+    if (this->options->get_pbft_batch_max_requests() > 1)
     {
-        LOG(error) << "Dropping message with invalid signature: " << request_env.ShortDebugString().substr(0, MAX_MESSAGE_SIZE);
+        this->add_to_request_batch(request_env, hash);
         return;
     }
 
-    this->saw_request(request_env, hash);
     auto op = setup_request_operation(request_env, hash);
     this->do_preprepare(op);
 }
 
 void
-pbft::forward_request_to_primary(const bzn_envelope& request_env)
+pbft::add_to_request_batch(const bzn_envelope& request_env, const bzn::hash_t& request_hash)
+{
+    const size_t request_size = request_env.ByteSizeLong() + BATCH_ENTRY_OVERHEAD_SIZE;
+
+    // keep the preprepare carrying the batch within bounds
+    if (!this->request_batch.empty() && this->request_batch_bytes + request_size > this->request_batch_max_bytes)
+    {
+        this->issue_request_batch();
+    }
+
+    this->request_batch.emplace_back(request_env, request_hash);
+    this->request_batch_bytes += request_size;
+
+    if (this->request_batch.size() >= this->options->get_pbft_batch_max_requests()
+        || this->request_batch_bytes >= this->request_batch_max_bytes)
+    {
+        this->issue_request_batch();
+        return;
+    }
+
+    if (this->request_batch.size() == 1)
+    {
+        // the first request of a batch waits no longer than the batch delay for others to join it
+        if (!this->request_batch_timer)
+        {
+            this->request_batch_timer = this->io_context->make_unique_steady_timer();
+        }
+
+        this->request_batch_timer->expires_from_now(this->options->get_pbft_batch_max_delay());
+        this->request_batch_timer->async_wait(
+            std::bind(&pbft::handle_request_batch_timeout, shared_from_this(), std::placeholders::_1));
+    }
+}
+
+void
+pbft::handle_request_batch_timeout(const boost::system::error_code& ec)
+{
+    if (ec)
+    {
+        if (ec != boost::asio::error::operation_aborted)
+        {
+            LOG(error) << "request batch timer error: " << ec.message();
+        }
+        return;
+    }
+
+    std::lock_guard<std::shared_mutex> lock(this->pbft_lock);
+
+    this->issue_request_batch();
+}
+
+void
+pbft::issue_request_batch()
+{
+    if (this->request_batch.empty())
+    {
+        return;
+    }
+
+    if (this->request_batch_timer)
+    {
+        this->request_batch_timer->cancel();
+    }
+
+    std::vector<std::pair<bzn_envelope, bzn::hash_t>> requests;
+    requests.swap(this->request_batch);
+    this->request_batch_bytes = 0;
+
+    if (!this->is_primary())
+    {
+        // the view changed while the batch was filling up
+        for (const auto& request : requests)
+        {
+            this->forward_request_to_primary(request.first, request.second);
+        }
+        return;
+    }
+
+    // a lone request is ordered just as it would be without batching
+    if (requests.size() == 1)
+    {
+        auto op = this->setup_request_operation(requests.front().first, requests.front().second);
+        this->do_preprepare(op);
+        return;
+    }
+
+    pbft_request_batch batch;
+    std::vector<std::pair<bzn::hash_t, std::shared_ptr<bzn::session_base>>> batch_sessions;
+    for (auto& request : requests)
+    {
+        *batch.add_requests() = std::move(request.first);
+        batch_sessions.emplace_back(std::move(request.second), nullptr);
+    }
+
+    bzn_envelope batch_env;
+    batch_env.set_pbft_request_batch(batch.SerializeAsString());
+    batch_env.set_sender(this->uuid);
+    batch_env.set_timestamp(this->now());
+
+    LOG(debug) << "Issuing a batch of " << batch.requests_size() << " requests";
+
+    auto op = this->setup_request_operation(batch_env, this->crypto->hash(batch_env));
+
+    // remember the requests' hashes so they aren't computed again when the batch commits
+    op->set_batch_sessions(std::move(batch_sessions));
+    this->do_preprepare(op);
+}
+
+void
+pbft::forward_request_to_primary(const bzn_envelope& request_env, const bzn::hash_t& request_hash)
 {
     auto primary = this->get_current_primary();
     if (!primary.has_value())
@@ -419,14 +703,19 @@ pbft::forward_request_to_primary(const bzn_envelope& request_env)
         return;
     }
 
-    const bzn::hash_t req_hash = this->crypto->hash(request_env);
-    LOG(info) << "Forwarded request to primary, " << bzn::bytes_to_debug_string(req_hash);
+    LOG(info) << "Forwarded request to primary, " << bzn::bytes_to_debug_string(request_hash);
 }
 
 
 void
 pbft::maybe_record_request(const bzn_envelope &request_env, const std::shared_ptr<pbft_operation> &op)
 {
+    // the primary recorded its own request when it issued the operation, so there is nothing to check or hash
+    if (op->has_request())
+    {
+        return;
+    }
+
     if (request_env.payload_case() == bzn_envelope::PayloadCase::PAYLOAD_NOT_SET || this->crypto->hash(request_env) != op->get_request_hash())
     {
         LOG(trace) << "Not recording request because hashes do not match";
@@ -443,9 +732,22 @@ pbft::handle_preprepare(const pbft_msg& msg, const bzn_envelope& original_msg)
     // Note that if we get the same preprepare more than once, we can still accept it
     const log_key_t log_key(msg.view(), msg.sequence());
 
-    if (auto lookup = this->accepted_preprepares.find(log_key);
-        lookup != this->accepted_preprepares.end()
-        && std::get<2>(lookup->second.value()) != msg.request_hash())
+    if (!this->is_in_pipeline_window(msg.sequence()))
+    {
+        LOG(debug) << "Rejecting preprepare: sequence " << msg.sequence() << " is outside of the water marks";
+        return;
+    }
+
+    // the map is shared by all sequences, but the caller holds this sequence's lock so the entry can't change under us
+    bool conflicting;
+    {
+        std::lock_guard<std::mutex> lock(this->accepted_preprepares_lock);
+        const auto lookup = this->accepted_preprepares.find(log_key);
+        conflicting = lookup != this->accepted_preprepares.end()
+            && std::get<2>(lookup->second.value()) != msg.request_hash();
+    }
+
+    if (conflicting)
     {
         LOG(debug) << "Rejecting preprepare: already accepted a conflicting one";
         return;
@@ -464,9 +766,14 @@ pbft::handle_preprepare(const pbft_msg& msg, const bzn_envelope& original_msg)
         }
 
         // This assignment will be redundant if we've seen this preprepare before, but that's fine
-        accepted_preprepares[log_key] = persistent<bzn::operation_key_t>{this->storage, op->get_operation_key()
-            , ACCEPTED_PREPREPARES_KEY, log_key};
+        {
+            std::lock_guard<std::mutex> lock(this->accepted_preprepares_lock);
+            accepted_preprepares[log_key] = persistent<bzn::operation_key_t>{this->storage, op->get_operation_key()
+                , ACCEPTED_PREPREPARES_KEY, log_key};
+        }
+
 
+        this->note_sequence_in_flight(msg.sequence());
 
         this->do_preprepared(op);
         this->maybe_advance_operation_state(op);
@@ -501,8 +808,11 @@ pbft::handle_get_state(const pbft_membership_msg& msg, std::shared_ptr<bzn::sess
 
     // get stable checkpoint for request
     checkpoint_t req_cp(msg.sequence(), msg.state_hash());
-    std::shared_ptr<std::string> state;
-    if (this->checkpoint_manager->get_latest_stable_checkpoint() != req_cp || !(state = this->get_checkpoint_state(req_cp)))
+    const std::vector<bzn::hash_t> manifest(msg.state_manifest().begin(), msg.state_manifest().end());
+    std::optional<bzn::snapshot_chunk_t> chunk;
+    bool delta{false};
+    if (this->checkpoint_manager->get_latest_stable_checkpoint() != req_cp
+        || !(chunk = this->get_checkpoint_state_chunk(req_cp, msg.state_offset(), manifest, delta)))
     {
         LOG(debug) << boost::format("I'm missing data for checkpoint: seq: %1%, hash: %2%")
                       % msg.sequence() % msg.state_hash();
@@ -510,6 +820,22 @@ pbft::handle_get_state(const pbft_membership_msg& msg, std::shared_ptr<bzn::sess
         return;
     }
 
+    // rather than hold up the swarm waiting for the state to be saved, tell the requester to come back for it
+    if (chunk->not_ready)
+    {
+        LOG(debug) << boost::format("State for checkpoint: seq: %1% is still being saved") % msg.sequence();
+
+        pbft_membership_msg reply;
+        reply.set_type(PBFT_MMSG_SET_STATE);
+        reply.set_sequence(req_cp.first);
+        reply.set_state_hash(req_cp.second);
+        reply.set_state_offset(msg.state_offset());
+        reply.set_state_not_ready(true);
+
+        session->send_message(std::make_shared<bzn::encoded_message>(this->wrap_message(reply).SerializeAsString()));
+        return;
+    }
+
     if (this->get_view() > 1 && this->saved_newview.payload_case() != bzn_envelope::kPbft)
     {
         LOG(warning) << "No saved NEWVIEW message to send for state message. Not responding";
@@ -520,16 +846,29 @@ pbft::handle_get_state(const pbft_membership_msg& msg, std::shared_ptr<bzn::sess
     reply.set_type(PBFT_MMSG_SET_STATE);
     reply.set_sequence(req_cp.first);
     reply.set_state_hash(req_cp.second);
-    reply.set_state_data(*state);
+    reply.set_state_data(chunk->data);
+    reply.set_state_offset(msg.state_offset());
+    reply.set_state_size(chunk->total_size);
+    reply.set_state_chunk_hash(this->crypto->hash(chunk->data));
+    reply.set_state_delta(delta);
 
     // TODO: the latest stable checkpoint may have advanced by the time we pull it here, which will cause the receiver
     // to reject this message. This is innocuous, but we could avoid the awkwardness by requesting a specific checkpoint
     // proof from the manager instead of the latest.
+    std::vector<bzn_envelope> checkpoint_claims;
     for (const auto& pair : this->checkpoint_manager->get_latest_stable_checkpoint_proof())
     {
-        bzn_envelope checkpoint_claim;
-        checkpoint_claim.ParseFromString(pair.second);
-        *(reply.add_checkpoint_proof()) = checkpoint_claim;
+        checkpoint_claims.emplace_back();
+        checkpoint_claims.back().ParseFromString(pair.second);
+    }
+
+    if (!bzn::make_quorum_certificate(checkpoint_claims, *reply.mutable_checkpoint_proof_certificate()))
+    {
+        reply.clear_checkpoint_proof_certificate();
+        for (auto& checkpoint_claim : checkpoint_claims)
+        {
+            *(reply.add_checkpoint_proof()) = std::move(checkpoint_claim);
+        }
     }
 
     if (this->saved_newview.payload_case() == bzn_envelope::kPbft)
@@ -542,7 +881,7 @@ pbft::handle_get_state(const pbft_membership_msg& msg, std::shared_ptr<bzn::sess
 }
 
 void
-pbft::handle_set_state(const pbft_membership_msg& msg)
+pbft::handle_set_state(const pbft_membership_msg& msg, const bzn::uuid_t& sender)
 {
     checkpoint_t cp(msg.sequence(), msg.state_hash());
 
@@ -569,11 +908,31 @@ pbft::handle_set_state(const pbft_membership_msg& msg)
         return;
     }
 
-    LOG(info) << boost::format("Adopting checkpoint %1% at seq %2%")
-        % cp.second % cp.first;
+    if (msg.state_not_ready())
+    {
+        this->retry_checkpoint_state_chunk(cp, sender);
+        return;
+    }
+
+    if (msg.state_size() > 0)
+    {
+        // the checkpoint is only adopted once its last chunk has been applied
+        if (!this->set_checkpoint_state_chunk(cp, msg, sender))
+        {
+            return;
+        }
+    }
+    else
+    {
+        LOG(info) << boost::format("Adopting checkpoint %1% at seq %2%")
+            % cp.second % cp.first;
 
-    // TODO: validate the state data
-    this->set_checkpoint_state(cp, msg.state_data());
+        if (!this->set_checkpoint_state(cp, msg.state_data()))
+        {
+            LOG(error) << boost::format("State for checkpoint %1% at seq %2% was not adopted") % cp.second % cp.first;
+            return;
+        }
+    }
 
     // TODO: This should maybe use normal newview handling
     if (msg.has_newview_msg())
@@ -651,6 +1010,37 @@ pbft::async_signed_broadcast(std::shared_ptr<bzn_envelope> msg_env)
     this->node->multicast_maybe_signed_message(std::move(targets), msg_env);
 }
 
+void
+pbft::broadcast_when_persisted(const pbft_msg& msg)
+{
+    auto msg_env = std::make_shared<bzn_envelope>();
+    msg_env->set_pbft(msg.SerializeAsString());
+    this->broadcast_when_persisted(std::move(msg_env));
+}
+
+void
+pbft::broadcast_when_persisted(std::shared_ptr<bzn_envelope> msg_env)
+{
+    // what we send has to survive a restart first; rather than wait for the records here (under pbft_lock), the
+    // log's writer thread hands the message back to the io_context once they are persisted
+    const bool deferred = this->operation_manager->when_persisted(
+        [weak_this = this->weak_from_this(), io_context = this->io_context, msg_env]()
+        {
+            io_context->post([weak_this, msg_env]()
+            {
+                if (auto strong_this = weak_this.lock())
+                {
+                    strong_this->async_signed_broadcast(msg_env);
+                }
+            });
+        });
+
+    if (!deferred)
+    {
+        this->async_signed_broadcast(std::move(msg_env));
+    }
+}
+
 void
 pbft::maybe_advance_operation_state(const std::shared_ptr<pbft_operation>& op)
 {
@@ -697,7 +1087,8 @@ pbft::do_preprepare(const std::shared_ptr<pbft_operation>& op)
     }
 
     msg_env->set_pbft(msg.SerializeAsString());
-    this->async_signed_broadcast(std::move(msg_env));
+
+    this->broadcast_when_persisted(std::move(msg_env));
 }
 
 void
@@ -707,7 +1098,7 @@ pbft::do_preprepared(const std::shared_ptr<pbft_operation>& op)
 
     pbft_msg msg = this->common_message_setup(op, PBFT_MSG_PREPARE);
 
-    this->async_signed_broadcast(msg);
+    this->broadcast_when_persisted(msg);
 }
 
 void
@@ -718,7 +1109,7 @@ pbft::do_prepared(const std::shared_ptr<pbft_operation>& op)
 
     pbft_msg msg = this->common_message_setup(op, PBFT_MSG_COMMIT);
 
-    this->async_signed_broadcast(msg);
+    this->broadcast_when_persisted(msg);
 }
 
 void
@@ -755,8 +1146,33 @@ pbft::do_committed(const std::shared_ptr<pbft_operation>& op)
         this->async_signed_broadcast(msg);
     }
 
+    if (op->has_batch_request())
+    {
+        // each request of the batch may have its own client waiting on it. the primary already knows the requests'
+        // hashes from issuing the batch; everyone else hashes them once here
+        auto batch_sessions = op->batch_sessions();
+        const auto& requests = op->get_batch_request().requests();
+        if (batch_sessions.size() != static_cast<size_t>(requests.size()))
+        {
+            batch_sessions.clear();
+            for (auto& request_hash : this->crypto->hash_batch(envelope_pointers(requests)))
+            {
+                batch_sessions.emplace_back(std::move(request_hash), nullptr);
+            }
+        }
+
+        for (auto& batch_session : batch_sessions)
+        {
+            const auto request_session = this->sessions_waiting_on_forwarded_requests.find(batch_session.first);
+            batch_session.second = request_session != this->sessions_waiting_on_forwarded_requests.end()
+                ? request_session->second : nullptr;
+        }
+
+        op->set_batch_sessions(std::move(batch_sessions));
+    }
+
     // TODO: this needs to be refactored to be service-agnostic
-    if (op->has_db_request())
+    if (op->has_db_request() || op->has_batch_request())
     {
         LOG(debug) << "Posting operation " << op->get_sequence() << " for execution";
         this->io_context->post(std::bind(&pbft_service_base::apply_operation, this->service, op));
@@ -868,7 +1284,7 @@ pbft::notify_audit_failure_detected()
 void
 pbft::handle_failure()
 {
-    std::lock_guard<std::mutex> lock(this->pbft_lock);
+    std::lock_guard<std::shared_mutex> lock(this->pbft_lock);
     LOG (error) << "handle_failure - PBFT failure - invalidating current view and sending VIEWCHANGE to view: "
         << this->view.value() + 1;
     this->notify_audit_failure_detected();
@@ -893,7 +1309,7 @@ pbft::initiate_viewchange(std::optional<uint64_t> opt_view)
 
         LOG(debug) << "Sending VIEWCHANGE for view " << view_to_set << " (currently at " << this->view.value() << ")";
 
-        this->async_signed_broadcast(std::move(msg_env));
+        this->broadcast_when_persisted(std::move(msg_env));
         this->last_view_sent = view_to_set;
     }
     else
@@ -902,20 +1318,221 @@ pbft::initiate_viewchange(std::optional<uint64_t> opt_view)
     }
 }
 
-std::shared_ptr<std::string>
-pbft::get_checkpoint_state(const checkpoint_t& cp) const
+std::optional<bzn::snapshot_chunk_t>
+pbft::get_checkpoint_state_chunk(const checkpoint_t& cp, uint64_t offset, const std::vector<bzn::hash_t>& manifest,
+    bool& delta) const
 {
-    // call service to retrieve state at this checkpoint
-    return this->service->get_service_state(cp.first);
+    // prefer a delta against the requester's state if the service can build a small enough one
+    if (!manifest.empty())
+    {
+        if (auto chunk = this->service->get_service_state_delta_chunk(cp.first, manifest, offset, STATE_TRANSFER_CHUNK_SIZE))
+        {
+            delta = true;
+            return chunk;
+        }
+
+        // the requester starts over when it gets the full state instead
+        if (offset != 0)
+        {
+            return std::nullopt;
+        }
+    }
+
+    // call service to retrieve the next chunk of state at this checkpoint
+    delta = false;
+    return this->service->get_service_state_chunk(cp.first, offset, STATE_TRANSFER_CHUNK_SIZE);
 }
 
-void
+bool
 pbft::set_checkpoint_state(const checkpoint_t& cp, const std::string& data)
 {
     // set the service state at the given checkpoint sequence
     // the service is expected to load the state and discard any pending operations
     // prior to the sequence number, then execute any subsequent operations sequentially
-    this->service->set_service_state(cp.first, data);
+    // it only takes a state that hashes to the checkpoint the swarm agreed on
+    return this->service->set_service_state(cp.first, data, cp.second);
+}
+
+bool
+pbft::set_checkpoint_state_chunk(const checkpoint_t& cp, const pbft_membership_msg& msg, const bzn::uuid_t& sender)
+{
+    if (this->state_transfer_checkpoint != cp)
+    {
+        this->state_transfer_checkpoint = cp;
+        this->state_transfer_offset = 0;
+        this->state_transfer_delta = false;
+        this->state_transfer_manifest.clear();
+
+        // a state spanning several chunks is worth fetching as a delta against the state we already have
+        if (!msg.state_delta() && msg.state_size() > STATE_TRANSFER_CHUNK_SIZE)
+        {
+            this->state_transfer_manifest = this->service->get_service_state_manifest();
+
+            if (!this->state_transfer_manifest.empty())
+            {
+                LOG(info) << boost::format("Requesting a delta for checkpoint %1% of %2% bytes")
+                    % cp.first % msg.state_size();
+
+                this->request_checkpoint_state_chunk(cp, sender);
+                return false;
+            }
+        }
+    }
+
+    // the sender answers with the full state if it cannot build a delta, so switch to whatever it started sending
+    if (msg.state_delta() != this->state_transfer_delta && msg.state_offset() == 0)
+    {
+        this->state_transfer_delta = msg.state_delta();
+        this->state_transfer_offset = 0;
+    }
+
+    // chunks are applied strictly in order; anything else resumes the transfer from where we are
+    if (msg.state_offset() != this->state_transfer_offset || msg.state_delta() != this->state_transfer_delta)
+    {
+        LOG(info) << boost::format("Got state chunk at offset %1% of checkpoint %2%, resuming from %3%")
+            % msg.state_offset() % cp.first % this->state_transfer_offset;
+
+        this->request_checkpoint_state_chunk(cp, sender);
+        return false;
+    }
+
+    if (msg.state_data().empty() || this->crypto->hash(msg.state_data()) != msg.state_chunk_hash())
+    {
+        LOG(error) << boost::format("Dropping invalid state chunk at offset %1% of checkpoint %2%")
+            % msg.state_offset() % cp.first;
+        return false;
+    }
+
+    // the chunk hash only guards the transfer; the service checks the complete state against the checkpoint hash
+    if (!this->service->set_service_state_chunk(cp.first, msg.state_offset(), msg.state_data(), msg.state_size(),
+        msg.state_delta(), cp.second))
+    {
+        LOG(error) << boost::format("Failed to apply state chunk at offset %1% of checkpoint %2%, restarting transfer")
+            % msg.state_offset() % cp.first;
+
+        // a complete state that was refused is not the one the checkpoint attests to, so ask someone else for it
+        const bool complete = msg.state_offset() + msg.state_data().size() == msg.state_size();
+
+        this->state_transfer_offset = 0;
+        this->state_transfer_delta = false;
+        this->state_transfer_manifest.clear();
+        this->request_checkpoint_state_chunk(cp, complete ? this->next_state_provider(sender) : sender);
+        return false;
+    }
+
+    this->state_transfer_offset += msg.state_data().size();
+
+    if (!this->state_transfer_delta)
+    {
+        // no point asking for a delta once we are receiving the full state
+        this->state_transfer_manifest.clear();
+    }
+
+    if (this->state_transfer_offset < msg.state_size())
+    {
+        this->request_checkpoint_state_chunk(cp, sender);
+        return false;
+    }
+
+    LOG(info) << boost::format("Adopting checkpoint %1% at seq %2% (%3% bytes of %4%)")
+        % cp.second % cp.first % msg.state_size() % (this->state_transfer_delta ? "delta" : "state");
+
+    this->state_transfer_checkpoint = {};
+    this->state_transfer_offset = 0;
+    this->state_transfer_delta = false;
+    this->state_transfer_manifest.clear();
+
+    return true;
+}
+
+bzn::uuid_t
+pbft::next_state_provider(const bzn::uuid_t& sender) const
+{
+    // the replicas that attested the stable checkpoint, taken in turn
+    std::set<bzn::uuid_t> providers;
+    for (const auto& proof : this->checkpoint_manager->get_latest_stable_checkpoint_proof())
+    {
+        providers.insert(proof.first);
+    }
+
+    providers.erase(this->get_uuid());
+
+    auto next = providers.upper_bound(sender);
+    if (next == providers.end())
+    {
+        next = providers.begin();
+    }
+
+    return next == providers.end() ? sender : *next;
+}
+
+void
+pbft::request_checkpoint_state_chunk(const checkpoint_t& cp, const bzn::uuid_t& peer)
+{
+    pbft_membership_msg msg;
+    msg.set_type(PBFT_MMSG_GET_STATE);
+    msg.set_sequence(cp.first);
+    msg.set_state_hash(cp.second);
+    msg.set_state_offset(this->state_transfer_offset);
+
+    for (const auto& digest : this->state_transfer_manifest)
+    {
+        msg.add_state_manifest(digest);
+    }
+
+    auto msg_ptr = std::make_shared<bzn_envelope>();
+    msg_ptr->set_pbft_membership(msg.SerializeAsString());
+
+    this->node->send_maybe_signed_message(peer, msg_ptr);
+}
+
+void
+pbft::retry_checkpoint_state_chunk(const checkpoint_t& cp, const bzn::uuid_t& peer)
+{
+    LOG(info) << boost::format("State for checkpoint %1% is still being saved by %2%, asking again shortly")
+        % cp.first % peer;
+
+    if (!this->state_transfer_retry_timer)
+    {
+        this->state_transfer_retry_timer = this->io_context->make_unique_steady_timer();
+    }
+
+    this->state_transfer_retry_timer->expires_from_now(STATE_TRANSFER_RETRY_DELAY);
+    this->state_transfer_retry_timer->async_wait(
+        std::bind(&pbft::handle_state_transfer_retry_timeout, shared_from_this(), cp, peer, std::placeholders::_1));
+}
+
+void
+pbft::handle_state_transfer_retry_timeout(const checkpoint_t& cp, const bzn::uuid_t& peer,
+    const boost::system::error_code& ec)
+{
+    if (ec)
+    {
+        if (ec != boost::asio::error::operation_aborted)
+        {
+            LOG(error) << "state transfer retry timer error: " << ec.message();
+        }
+        return;
+    }
+
+    std::lock_guard<std::shared_mutex> lock(this->pbft_lock);
+
+    // we may have caught up some other way in the meantime
+    if (this->checkpoint_manager->get_latest_stable_checkpoint() != cp
+        || this->checkpoint_manager->get_latest_local_checkpoint().first >= cp.first)
+    {
+        return;
+    }
+
+    // the progress we have is only of use for the same checkpoint
+    if (this->state_transfer_checkpoint != cp)
+    {
+        this->state_transfer_offset = 0;
+        this->state_transfer_delta = false;
+        this->state_transfer_manifest.clear();
+    }
+
+    this->request_checkpoint_state_chunk(cp, peer);
 }
 
 size_t
@@ -935,20 +1552,48 @@ pbft::handle_database_message(const bzn_envelope& msg, std::shared_ptr<bzn::sess
 {
     LOG(debug) << "got database message";
 
-    if (!this->service->apply_operation_now(msg, session))
+    if (this->service->apply_operation_now(msg, session))
     {
-        std::lock_guard<std::mutex> lock(this->pbft_lock);
+        return;
+    }
 
-        if (msg.timestamp() == 0)
-        {
-            bzn_envelope mutable_msg(msg);
-            mutable_msg.set_timestamp(this->now());
-            this->handle_request(mutable_msg, session);
-        }
-        else
+    if (msg.sender().empty())
+    {
+        this->handle_verified_request(msg, session);
+        return;
+    }
+
+    auto env_copy = std::make_shared<const bzn_envelope>(msg);
+    this->verification_stage->submit(env_copy,
+        [weak_this = this->weak_from_this(), env_copy, session](bool valid)
         {
-            this->handle_request(msg, session);
-        }
+            if (!valid)
+            {
+                LOG(error) << "Dropping message with invalid signature: " << env_copy->ShortDebugString().substr(0, MAX_MESSAGE_SIZE);
+                return;
+            }
+
+            if (auto strong_this = weak_this.lock())
+            {
+                strong_this->handle_verified_request(*env_copy, session);
+            }
+        });
+}
+
+void
+pbft::handle_verified_request(const bzn_envelope& request_env, const std::shared_ptr<session_base>& session)
+{
+    std::lock_guard<std::shared_mutex> lock(this->pbft_lock);
+
+    if (request_env.timestamp() == 0)
+    {
+        bzn_envelope mutable_msg(request_env);
+        mutable_msg.set_timestamp(this->now());
+        this->handle_request(mutable_msg, session);
+    }
+    else
+    {
+        this->handle_request(request_env, session);
     }
 }
 
@@ -958,7 +1603,7 @@ pbft::handle_database_response_message(const bzn_envelope& msg, std::shared_ptr<
 {
     database_msg db_msg;
 
-    std::lock_guard<std::mutex> lock(this->pbft_lock);
+    std::lock_guard<std::shared_mutex> lock(this->pbft_lock);
 
     if (db_msg.ParseFromString(msg.database_response()))
     {
@@ -982,7 +1627,7 @@ pbft::handle_swarm_error_response_message(const bzn_envelope& msg, std::shared_p
 {
     swarm_error err;
 
-    std::lock_guard<std::mutex> lock(this->pbft_lock);
+    std::lock_guard<std::shared_mutex> lock(this->pbft_lock);
 
     if (err.ParseFromString(msg.swarm_error()))
     {
@@ -1013,6 +1658,36 @@ pbft::get_high_water_mark()
     return this->checkpoint_manager->get_latest_stable_checkpoint().first + HIGH_WATER_INTERVAL_IN_CHECKPOINTS * CHECKPOINT_INTERVAL;
 }
 
+bool
+pbft::is_in_pipeline_window(uint64_t sequence)
+{
+    return sequence > this->get_low_water_mark() && sequence <= this->get_high_water_mark();
+}
+
+std::mutex&
+pbft::sequence_lock(uint64_t sequence)
+{
+    return this->sequence_locks[sequence % SEQUENCE_LOCK_SHARDS];
+}
+
+uint64_t
+pbft::pipeline_occupancy() const
+{
+    const uint64_t highest = this->highest_in_flight_sequence_number;
+    const uint64_t executed = this->last_executed_sequence_number;
+
+    return highest > executed ? highest - executed : 0;
+}
+
+void
+pbft::note_sequence_in_flight(uint64_t sequence)
+{
+    uint64_t highest = this->highest_in_flight_sequence_number;
+    while (sequence > highest && !this->highest_in_flight_sequence_number.compare_exchange_weak(highest, sequence));
+
+    this->monitor->send_gauge(bzn::statistic::pbft_window_occupancy, this->pipeline_occupancy());
+}
+
 bool
 pbft::is_view_valid() const
 {
@@ -1045,12 +1720,13 @@ std::map<bzn::checkpoint_t, std::set<bzn::uuid_t>>
 pbft::validate_and_extract_checkpoint_hashes(const pbft_msg &viewchange_message) const
 {
     std::map<bzn::checkpoint_t , std::set<bzn::uuid_t>> checkpoint_hashes;
+    const auto verified = this->verify_peer_envelopes(envelope_pointers(viewchange_message.checkpoint_messages()));
     for (size_t i{0}; i < static_cast<uint64_t>(viewchange_message.checkpoint_messages_size()); ++i)
     {
         const bzn_envelope& envelope{viewchange_message.checkpoint_messages(i)};
         checkpoint_msg checkpoint_message;
 
-        if ((this->options->get_peer_message_signing() && !this->crypto->verify(envelope))
+        if (!verified[i]
             || !this->is_peer(envelope.sender()) || !checkpoint_message.ParseFromString(envelope.checkpoint_msg()))
         {
             LOG (error) << "Checkpoint validation failure - unable to verify envelope";
@@ -1067,13 +1743,60 @@ pbft::validate_and_extract_checkpoint_hashes(const pbft_msg &viewchange_message)
     return retval;
 }
 
+std::vector<bool>
+pbft::verify_peer_envelopes(const std::vector<const bzn_envelope*>& envelopes) const
+{
+    if (!this->options->get_peer_message_signing())
+    {
+        return std::vector<bool>(envelopes.size(), true);
+    }
+
+    // the verification stage has usually checked these already; only what it did not see is verified here
+    std::vector<bool> results(envelopes.size(), false);
+    std::vector<const bzn_envelope*> unverified;
+    std::vector<size_t> unverified_positions;
+    for (size_t i = 0; i < envelopes.size(); ++i)
+    {
+        if (!this->verified_embedded_envelopes.empty())
+        {
+            const auto verified = this->verified_embedded_envelopes.find(envelopes[i]->SerializeAsString());
+            if (verified != this->verified_embedded_envelopes.end())
+            {
+                results[i] = verified->second;
+                continue;
+            }
+        }
+
+        unverified.push_back(envelopes[i]);
+        unverified_positions.push_back(i);
+    }
+
+    if (!unverified.empty())
+    {
+        const auto unverified_results = this->crypto->verify_batch(unverified);
+        for (size_t i = 0; i < unverified_positions.size(); ++i)
+        {
+            results[unverified_positions[i]] = unverified_results[i];
+        }
+    }
+
+    return results;
+}
+
 bool
 pbft::is_valid_prepared_proof(const prepared_proof& proof, uint64_t valid_checkpoint_sequence) const
 {
     const bzn_envelope& pre_prepare_envelope{proof.pre_prepare()};
 
-    if (!this->is_peer(pre_prepare_envelope.sender())
-        || (this->options->get_peer_message_signing() && !this->crypto->verify(pre_prepare_envelope)))
+    // the preprepare is verified along with all of the prepares
+    std::vector<const bzn_envelope*> envelopes{&pre_prepare_envelope};
+    for (const auto& prepare_envelope : proof.prepare())
+    {
+        envelopes.push_back(&prepare_envelope);
+    }
+    const auto verified = this->verify_peer_envelopes(envelopes);
+
+    if (!this->is_peer(pre_prepare_envelope.sender()) || !verified[0])
     {
         LOG(error) << "is_valid_prepared_proof - a pre prepare message has a bad envelope, or the sender is not in the peers list";
         LOG(error) << "Sender: " << pre_prepare_envelope.sender() << " is " << (this->is_peer(pre_prepare_envelope.sender()) ? "" : "not ") << "a peer";
@@ -1091,9 +1814,8 @@ pbft::is_valid_prepared_proof(const prepared_proof& proof, uint64_t valid_checkp
     std::set<uuid_t> senders;
     for (int j{0}; j < proof.prepare_size(); ++j)
     {
-        bzn_envelope prepare_envelope{proof.prepare(j)};
-        if (!this->is_peer(prepare_envelope.sender()) ||
-            (this->options->get_peer_message_signing() && !this->crypto->verify(prepare_envelope)))
+        const bzn_envelope& prepare_envelope{proof.prepare(j)};
+        if (!this->is_peer(prepare_envelope.sender()) || !verified[j + 1])
         {
             LOG(error) << "is_valid_prepared_proof - a prepare message has a bad envelope, "
                           "the sender may not be in the peer list, or the envelope failed cryptographic verification";
@@ -1221,8 +1943,11 @@ pbft::is_valid_newview_message(const pbft_msg& theirs, const bzn_envelope& origi
     for (int i{0};i < theirs.viewchange_messages_size();++i)
     {
         const bzn_envelope& original_msg{theirs.viewchange_messages(i)};
+        const bool parsed = viewchange_msg.ParseFromString(original_msg.pbft());
+        bzn::expand_quorum_certificates(viewchange_msg);
+
         // - are each of those viewchange messages valid?
-        if (!viewchange_msg.ParseFromString(original_msg.pbft()) || viewchange_msg.type() != PBFT_MSG_VIEWCHANGE
+        if (!parsed || viewchange_msg.type() != PBFT_MSG_VIEWCHANGE
             || !this->is_valid_viewchange_message(viewchange_msg, original_msg))
         {
             LOG(error) << "is_valid_newview_message - new view message contains invalid viewchange message";
@@ -1259,9 +1984,10 @@ pbft::is_valid_newview_message(const pbft_msg& theirs, const bzn_envelope& origi
         return false;
     }
 
+    const auto verified = this->verify_peer_envelopes(envelope_pointers(theirs.pre_prepare_messages()));
     for (int i{0};i < theirs.pre_prepare_messages_size();++i)
     {
-        if (this->options->get_peer_message_signing() && !this->crypto->verify(theirs.pre_prepare_messages(i)))
+        if (!verified[i])
         {
             LOG(error) <<  "is_valid_newview_message - unable to verify thier pre prepare message";
             return false;
@@ -1439,11 +2165,12 @@ pbft::build_newview(uint64_t new_view, const std::map<uuid_t,bzn_envelope>& view
 void
 pbft::save_checkpoint(const pbft_msg& msg)
 {
+    const auto verified = this->verify_peer_envelopes(envelope_pointers(msg.checkpoint_messages()));
     for (int i{0}; i < msg.checkpoint_messages_size(); ++i)
     {
         const bzn_envelope& original_checkpoint{msg.checkpoint_messages(i)};
 
-        if (this->options->get_peer_message_signing() && !this->crypto->verify(original_checkpoint))
+        if (!verified[i])
         {
             LOG(error) << "ignoring invalid checkpoint message";
             continue;
@@ -1458,11 +2185,10 @@ std::map<bzn::hash_t, int>
 pbft::map_request_to_hash(const bzn_envelope& env)
 {
     std::map<bzn::hash_t, int> piggybacked_request_hashes;
-    for (int i{0}; i < env.piggybacked_requests_size(); ++i)
+    const auto hashes{this->crypto->hash_batch(envelope_pointers(env.piggybacked_requests()))};
+    for (size_t i{0}; i < hashes.size(); ++i)
     {
-        const bzn_envelope request{env.piggybacked_requests(i)};
-        const auto hash{this->crypto->hash(request)};
-        piggybacked_request_hashes[hash] = i;
+        piggybacked_request_hashes[hashes[i]] = static_cast<int>(i);
     }
     return piggybacked_request_hashes;
 }
@@ -1573,6 +2299,7 @@ pbft::handle_newview(const pbft_msg& msg, const bzn_envelope& original_msg)
 
     pbft_msg viewchange;
     viewchange.ParseFromString(msg.viewchange_messages(0).pbft());
+    bzn::expand_quorum_certificates(viewchange);
 
     // this is redundant (but harmless) unless it's a new node
     this->save_checkpoint(viewchange);
@@ -1617,7 +2344,7 @@ pbft::get_status()
     bzn::json_message status;
     std::string status_str;
 
-    std::lock_guard<std::mutex> lock(this->pbft_lock);
+    std::lock_guard<std::shared_mutex> lock(this->pbft_lock);
 
     status_str += "my uuid: " + this->uuid + "\n";
 
@@ -1636,7 +2363,7 @@ pbft::get_status()
     }
 
     status_str += "view: " + std::to_string(this->get_view()) + "\n";
-    status_str += "last exec: "  + std::to_string(this->last_executed_sequence_number) + "\n";
+    status_str += "last exec: "  + std::to_string(this->last_executed_sequence_number.load()) + "\n";
     status_str += "last local cp: "  + std::to_string(this->checkpoint_manager->get_latest_local_checkpoint().first) + "\n";
     status_str += "last stable cp: "  + std::to_string(this->checkpoint_manager->get_latest_stable_checkpoint().first) + "\n";
     if (this->is_primary())
@@ -1654,6 +2381,7 @@ pbft::get_status()
     status["latest_checkpoint"]["hash"] = this->checkpoint_manager->get_latest_local_checkpoint().second;
 
     status["next_issued_sequence_number"] = this->next_issued_sequence_number.value();
+    status["pipeline_window_occupancy"] = this->pipeline_occupancy();
     status["view"] = this->view.value();
 
     status["peer_index"] = bzn::json_message();
@@ -1731,12 +2459,21 @@ pbft::make_viewchange(
     viewchange.set_view(new_view);
     viewchange.set_sequence(base_sequence_number);  // base_sequence_number = n = sequence # of last valid checkpoint
 
-    // C = a set of local 2*f + 1 valid checkpoint messages
+    // C = a set of local 2*f + 1 valid checkpoint messages, sent as one certificate when they agree (as they should)
+    std::vector<bzn_envelope> checkpoint_envelopes;
     for (const auto& msg : stable_checkpoint_proof)
     {
-        bzn_envelope envelope;
-        envelope.ParseFromString(msg.second);
-        *(viewchange.add_checkpoint_messages()) = envelope;
+        checkpoint_envelopes.emplace_back();
+        checkpoint_envelopes.back().ParseFromString(msg.second);
+    }
+
+    if (!bzn::make_quorum_certificate(checkpoint_envelopes, *viewchange.mutable_checkpoint_certificate()))
+    {
+        viewchange.clear_checkpoint_certificate();
+        for (auto& envelope : checkpoint_envelopes)
+        {
+            *(viewchange.add_checkpoint_messages()) = std::move(envelope);
+        }
     }
 
     // P = a set (of client requests) containing a set P_m  for each request m that prepared at i with a sequence # higher than n
@@ -1753,9 +2490,20 @@ pbft::make_viewchange(
         }
 
         prepared_proof->set_allocated_pre_prepare(new bzn_envelope(pre_prepare));
+
+        std::vector<bzn_envelope> prepares;
         for (const auto& sender_envelope : operation.second->get_prepares())
         {
-            *(prepared_proof->add_prepare()) = sender_envelope.second;
+            prepares.push_back(sender_envelope.second);
+        }
+
+        if (!bzn::make_quorum_certificate(prepares, *prepared_proof->mutable_prepare_certificate()))
+        {
+            prepared_proof->clear_prepare_certificate();
+            for (auto& prepare : prepares)
+            {
+                *(prepared_proof->add_prepare()) = std::move(prepare);
+            }
         }
     }
 
@@ -1798,7 +2546,7 @@ void pbft::add_session_to_sessions_waiting(const std::string& msg_hash, std::sha
         this->sessions_waiting_on_forwarded_requests[msg_hash] = session;
         session->add_shutdown_handler([msg_hash, this, session]()
         {
-            std::lock_guard<std::mutex> lock(this->pbft_lock);
+            std::lock_guard<std::shared_mutex> lock(this->pbft_lock);
             auto it = this->sessions_waiting_on_forwarded_requests.find(msg_hash);
             if (it != this->sessions_waiting_on_forwarded_requests.end()
                 && (it->second->get_session_id() == session->get_session_id()))
@@ -21,23 +21,33 @@
 #include <pbft/pbft_persistent_state.hpp>
 #include <pbft/operations/pbft_operation_manager.hpp>
 #include <pbft/pbft_checkpoint_manager.hpp>
+#include <pbft/pbft_verification_stage.hpp>
 #include <storage/storage_base.hpp>
 #include <status/status_provider_base.hpp>
 #include <crypto/crypto_base.hpp>
+#include <crypto/local_hash.hpp>
 #include <proto/audit.pb.h>
 #include <monitor/monitor_base.hpp>
 #include <mutex>
+#include <shared_mutex>
+#include <array>
+#include <atomic>
 #include <gtest/gtest_prod.h>
 #include <options/options_base.hpp>
 #include <include/boost_asio_beast.hpp>
 #include <limits>
+#include <unordered_map>
+#include <set>
 
 namespace
 {
     const std::chrono::milliseconds HEARTBEAT_INTERVAL{std::chrono::milliseconds(5000)};
     const uint64_t CHECKPOINT_INTERVAL = 100; //TODO: KEP-574
     const double HIGH_WATER_INTERVAL_IN_CHECKPOINTS = 200.0; //TODO: KEP-574
+    const size_t SEQUENCE_LOCK_SHARDS = 64;
     const uint64_t MAX_REQUEST_AGE_MS = 3600000; // 1 hour
+    const size_t STATE_TRANSFER_CHUNK_SIZE = 256 * 1024;
+    const std::chrono::milliseconds STATE_TRANSFER_RETRY_DELAY{std::chrono::milliseconds(1000)};
     const std::string NOOP_REQUEST_HASH = "<no op request hash>";
 
     const std::string VIEW_KEY{"view"};
@@ -63,6 +73,7 @@ namespace bzn
         class pbft_test_add_session_to_sessions_waiting_can_add_a_session_and_shutdown_handler_removes_session_from_sessions_waiting_Test;
         class pbft_test_pbft_wrap_message_sets_swarm_id_Test;
         class pbft_test_ensure_save_all_requests_records_requests_Test;
+        class pbft_test_test_agreement_messages_at_or_below_low_water_mark_are_not_recorded_Test;
     }
 
     using request_hash_t = std::string;
@@ -122,6 +133,7 @@ namespace bzn
         bool is_valid_newview_message(const pbft_msg& theirs, const bzn_envelope& original_theirs) const;
 
         bool is_valid_prepared_proof(const prepared_proof& proof, uint64_t valid_checkpoint_sequence) const;
+        std::vector<bool> verify_peer_envelopes(const std::vector<const bzn_envelope*>& envelopes) const;
 
         std::shared_ptr<bzn::node_base> get_node();
 
@@ -153,13 +165,14 @@ namespace bzn
     private:
         bool preliminary_filter_msg(const pbft_msg& msg);
 
+        // expects the request's signature to have been verified already
         void handle_request(const bzn_envelope& request, const std::shared_ptr<session_base>& session = nullptr);
         void handle_preprepare(const pbft_msg& msg, const bzn_envelope& original_msg);
         void handle_prepare(const pbft_msg& msg, const bzn_envelope& original_msg);
         void handle_commit(const pbft_msg& msg, const bzn_envelope& original_msg);
         void handle_checkpoint(const pbft_msg& msg, const bzn_envelope& original_msg);
         void handle_get_state(const pbft_membership_msg& msg, std::shared_ptr<bzn::session_base> session) const;
-        void handle_set_state(const pbft_membership_msg& msg);
+        void handle_set_state(const pbft_membership_msg& msg, const bzn::uuid_t& sender);
         void handle_config_message(const pbft_msg& msg, const std::shared_ptr<pbft_operation>& op);
         void handle_viewchange(const pbft_msg& msg, const bzn_envelope& original_msg);
         void handle_newview(const pbft_msg& msg, const bzn_envelope& original_msg);
@@ -183,10 +196,30 @@ namespace bzn
         void async_signed_broadcast(const audit_message& message);
         void async_signed_broadcast(std::shared_ptr<bzn_envelope> message);
 
+        // for messages that vouch for operation records, which are written behind
+        void broadcast_when_persisted(const pbft_msg& msg);
+        void broadcast_when_persisted(std::shared_ptr<bzn_envelope> message);
+
         pbft_msg common_message_setup(const std::shared_ptr<pbft_operation>& op, pbft_msg_type type);
         std::shared_ptr<pbft_operation> setup_request_operation(const bzn_envelope& msg
             , const bzn::hash_t& request_hash);
-        void forward_request_to_primary(const bzn_envelope& request_env);
+        void forward_request_to_primary(const bzn_envelope& request_env, const bzn::hash_t& request_hash);
+
+        // the primary orders client requests in batches...
+        void add_to_request_batch(const bzn_envelope& request_env, const bzn::hash_t& request_hash);
+        void issue_request_batch();
+        void handle_request_batch_timeout(const boost::system::error_code& ec);
+
+        // sequences between the water marks may be agreed on concurrently and committed in any order; the service
+        // still executes them strictly in sequence order...
+        bool is_in_pipeline_window(uint64_t sequence);
+        std::mutex& sequence_lock(uint64_t sequence);
+        void handle_verified_message(const pbft_msg& msg, const bzn_envelope& original_msg,
+            std::unordered_map<std::string, bool> verified_embedded = {});
+        void dispatch_message(const pbft_msg& msg, const bzn_envelope& original_msg);
+        void handle_verified_request(const bzn_envelope& request_env, const std::shared_ptr<session_base>& session);
+        uint64_t pipeline_occupancy() const;
+        void note_sequence_in_flight(uint64_t sequence);
 
         void broadcast(const bzn_envelope& message);
 
@@ -198,8 +231,15 @@ namespace bzn
 
         void notify_audit_failure_detected();
 
-        std::shared_ptr<std::string> get_checkpoint_state(const checkpoint_t& cp) const;
-        void set_checkpoint_state(const checkpoint_t& cp, const std::string& data);
+        std::optional<bzn::snapshot_chunk_t> get_checkpoint_state_chunk(const checkpoint_t& cp, uint64_t offset,
+            const std::vector<bzn::hash_t>& manifest, bool& delta) const;
+        bool set_checkpoint_state(const checkpoint_t& cp, const std::string& data);
+        bool set_checkpoint_state_chunk(const checkpoint_t& cp, const pbft_membership_msg& msg, const bzn::uuid_t& sender);
+        void request_checkpoint_state_chunk(const checkpoint_t& cp, const bzn::uuid_t& peer);
+        void retry_checkpoint_state_chunk(const checkpoint_t& cp, const bzn::uuid_t& peer);
+        void handle_state_transfer_retry_timeout(const checkpoint_t& cp, const bzn::uuid_t& peer,
+            const boost::system::error_code& ec);
+        bzn::uuid_t next_state_provider(const bzn::uuid_t& sender) const;
 
         inline size_t quorum_size() const;
         size_t max_faulty_nodes() const;
@@ -235,7 +275,8 @@ namespace bzn
         // Using 1 as first value here to distinguish from default value of 0 in protobuf
         persistent<uint64_t> view{storage, uint64_t{1}, VIEW_KEY};
         persistent<uint64_t> next_issued_sequence_number{storage, 1, NEXT_ISSUED_SEQUENCE_NUMBER_KEY};
-        uint64_t last_executed_sequence_number{0};
+        std::atomic<uint64_t> last_executed_sequence_number{0};
+        std::atomic<uint64_t> highest_in_flight_sequence_number{0};
 
         std::shared_ptr<bzn::node_base> node;
 
@@ -244,8 +285,13 @@ namespace bzn
 
         std::shared_ptr<pbft_service_base> service;
 
-        std::mutex pbft_lock;
+        // Agreement messages (preprepare/prepare/commit) hold pbft_lock shared plus the lock of their sequence's
+        // shard, so different sequences are handled in parallel. Everything else, including view changes, holds
+        // pbft_lock exclusively.
+        std::shared_mutex pbft_lock;
+        std::array<std::mutex, SEQUENCE_LOCK_SHARDS> sequence_locks;
 
+        std::mutex accepted_preprepares_lock;
         std::map<bzn::log_key_t, persistent<bzn::operation_key_t>> accepted_preprepares;
 
         std::once_flag start_once;
@@ -254,6 +300,11 @@ namespace bzn
 
         std::unique_ptr<bzn::asio::steady_timer_base> audit_heartbeat_timer;
 
+        std::vector<std::pair<bzn_envelope, bzn::hash_t>> request_batch;
+        size_t request_batch_bytes = 0;
+        size_t request_batch_max_bytes = 0;
+        std::unique_ptr<bzn::asio::steady_timer_base> request_batch_timer;
+
         bool audit_enabled = true;
 
         std::multimap<timestamp_t, std::pair<bzn::uuid_t, request_hash_t>> recent_requests;
@@ -274,6 +325,19 @@ namespace bzn
         std::shared_ptr<bzn::pbft_checkpoint_manager> checkpoint_manager;
         std::shared_ptr<bzn::monitor_base> monitor;
 
+        // progress of the chunked state transfer we are receiving
+        checkpoint_t state_transfer_checkpoint;
+        uint64_t state_transfer_offset = 0;
+        bool state_transfer_delta = false;
+        std::vector<bzn::hash_t> state_transfer_manifest;
+        std::unique_ptr<bzn::asio::steady_timer_base> state_transfer_retry_timer;
+
+        // results from the verification stage for the proofs carried by the message being dispatched, by envelope
+        std::unordered_map<std::string, bool> verified_embedded_envelopes;
+
+        // declared last so its workers are stopped before anything they use is destroyed
+        std::unique_ptr<bzn::pbft_verification_stage> verification_stage;
+
         FRIEND_TEST(pbft_viewchange_test, pbft_with_invalid_view_drops_messages);
         FRIEND_TEST(pbft_viewchange_test, test_make_signed_envelope);
         FRIEND_TEST(pbft_viewchange_test, test_is_peer);
@@ -300,11 +364,12 @@ namespace bzn
         FRIEND_TEST(bzn::test::pbft_test, add_session_to_sessions_waiting_can_add_a_session_and_shutdown_handler_removes_session_from_sessions_waiting);
         FRIEND_TEST(bzn::test::pbft_test, pbft_wrap_message_sets_swarm_id);
         FRIEND_TEST(bzn::test::pbft_test, ensure_save_all_requests_records_requests);
+        FRIEND_TEST(bzn::test::pbft_test, test_agreement_messages_at_or_below_low_water_mark_are_not_recorded);
 
         friend class pbft_proto_test;
         friend class pbft_viewchange_test;
 
-        std::map<bzn::hash_t, std::shared_ptr<bzn::session_base>> sessions_waiting_on_forwarded_requests;
+        std::unordered_map<bzn::hash_t, std::shared_ptr<bzn::session_base>, bzn::digest_hasher> sessions_waiting_on_forwarded_requests;
     };
 
 } // namespace bzn
@@ -0,0 +1,126 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <pbft/pbft_quorum_certificate.hpp>
+
+namespace
+{
+    bool
+    same_message(const bzn_envelope& a, const bzn_envelope& b)
+    {
+        if (a.swarm_id() != b.swarm_id() || a.payload_case() != b.payload_case())
+        {
+            return false;
+        }
+
+        switch (a.payload_case())
+        {
+            case bzn_envelope::kPbft :
+            {
+                return a.pbft() == b.pbft();
+            }
+            case bzn_envelope::kCheckpointMsg :
+            {
+                return a.checkpoint_msg() == b.checkpoint_msg();
+            }
+            default :
+            {
+                // nothing else is collected into quorums
+                return false;
+            }
+        }
+    }
+}
+
+
+bool
+bzn::make_quorum_certificate(const std::vector<bzn_envelope>& envelopes, quorum_certificate& certificate)
+{
+    if (envelopes.empty())
+    {
+        return false;
+    }
+
+    for (const auto& envelope : envelopes)
+    {
+        if (envelope.piggybacked_requests_size() > 0 || !same_message(envelope, envelopes.front()))
+        {
+            return false;
+        }
+    }
+
+    quorum_certificate result;
+    *result.mutable_common() = envelopes.front();
+    result.mutable_common()->clear_sender();
+    result.mutable_common()->clear_timestamp();
+    result.mutable_common()->clear_signature();
+
+    for (const auto& envelope : envelopes)
+    {
+        auto signature = result.add_signatures();
+        signature->set_sender(envelope.sender());
+        signature->set_timestamp(envelope.timestamp());
+        signature->set_signature(envelope.signature());
+    }
+
+    certificate = std::move(result);
+    return true;
+}
+
+
+void
+bzn::expand_quorum_certificate(const quorum_certificate& certificate,
+    google::protobuf::RepeatedPtrField<bzn_envelope>& envelopes)
+{
+    for (const auto& signature : certificate.signatures())
+    {
+        auto envelope = envelopes.Add();
+        *envelope = certificate.common();
+        envelope->set_sender(signature.sender());
+        envelope->set_timestamp(signature.timestamp());
+        envelope->set_signature(signature.signature());
+    }
+}
+
+
+void
+bzn::expand_quorum_certificates(pbft_msg& msg)
+{
+    if (msg.has_checkpoint_certificate())
+    {
+        expand_quorum_certificate(msg.checkpoint_certificate(), *msg.mutable_checkpoint_messages());
+        msg.clear_checkpoint_certificate();
+    }
+
+    for (auto& proof : *msg.mutable_prepared_proofs())
+    {
+        if (proof.has_prepare_certificate())
+        {
+            expand_quorum_certificate(proof.prepare_certificate(), *proof.mutable_prepare());
+            proof.clear_prepare_certificate();
+        }
+    }
+}
+
+
+void
+bzn::expand_quorum_certificates(pbft_membership_msg& msg)
+{
+    if (msg.has_checkpoint_proof_certificate())
+    {
+        expand_quorum_certificate(msg.checkpoint_proof_certificate(), *msg.mutable_checkpoint_proof());
+        msg.clear_checkpoint_proof_certificate();
+    }
+}
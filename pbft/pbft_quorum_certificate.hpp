@@ -0,0 +1,45 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <proto/pbft.pb.h>
+#include <vector>
+
+namespace bzn
+{
+    /*
+     * Compacts envelopes signed by different peers over the same message into a quorum certificate, storing the
+     * message once instead of in every envelope.
+     * @envelopes the signed envelopes
+     * @certificate receives the certificate
+     * @return false (leaving certificate untouched) if the envelopes do not all carry the same message
+     */
+    bool make_quorum_certificate(const std::vector<bzn_envelope>& envelopes, quorum_certificate& certificate);
+
+    /*
+     * Expands a quorum certificate back into the envelopes that were signed, appending them to envelopes
+     */
+    void expand_quorum_certificate(const quorum_certificate& certificate,
+        google::protobuf::RepeatedPtrField<bzn_envelope>& envelopes);
+
+    /*
+     * Expands any quorum certificates in a received message in place, so that the rest of pbft only ever sees
+     * individual signed envelopes
+     */
+    void expand_quorum_certificates(pbft_msg& msg);
+
+    void expand_quorum_certificates(pbft_membership_msg& msg);
+}
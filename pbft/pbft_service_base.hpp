@@ -18,6 +18,7 @@
 #include <include/bluzelle.hpp>
 #include <proto/bluzelle.pb.h>
 #include <pbft/operations/pbft_operation.hpp>
+#include <storage/storage_base.hpp>
 
 namespace bzn
 {
@@ -79,14 +80,39 @@ namespace bzn
         virtual bzn::hash_t service_state_hash(uint64_t sequence_number) const = 0;
 
         /*
-         * Get the full database state at the given sequence number, if available
+         * Get up to max_size bytes of the database state at the given sequence number starting at offset, if available.
+         * A chunk marked not_ready means the state is still being saved and should be asked for again later
          */
-        virtual std::shared_ptr<bzn::service_state_t> get_service_state(uint64_t sequence_number) const = 0;
+        virtual std::optional<bzn::snapshot_chunk_t> get_service_state_chunk(uint64_t sequence_number, uint64_t offset,
+            size_t max_size) const = 0;
 
         /*
-         * Set the full database state at the given sequence number
+         * Set the full database state at the given sequence number. A service that hashes its state only takes one
+         * that hashes to state_hash, the hash the swarm agreed on for the checkpoint
          */
-        virtual bool set_service_state(uint64_t sequence_number, const bzn::service_state_t& data) = 0;
+        virtual bool set_service_state(uint64_t sequence_number, const bzn::service_state_t& data,
+            const bzn::hash_t& state_hash) = 0;
+
+        /*
+         * Get a chunk of a delta that brings a database with the given manifest to the state at the given sequence
+         * number, if one much smaller than the full state is available
+         */
+        virtual std::optional<bzn::snapshot_chunk_t> get_service_state_delta_chunk(uint64_t sequence_number,
+            const std::vector<bzn::hash_t>& manifest, uint64_t offset, size_t max_size) const = 0;
+
+        /*
+         * Get the manifest of the current database state for requesting a delta (empty if deltas are unsupported)
+         */
+        virtual std::vector<bzn::hash_t> get_service_state_manifest() const = 0;
+
+        /*
+         * Set the database state at the given sequence number one chunk at a time; chunks must arrive in order and
+         * the state is set once the chunk ending at total_size has been applied. If delta is set the chunks are of
+         * a delta against the current state rather than of the full state. The state has to hash to state_hash just
+         * as for set_service_state
+         */
+        virtual bool set_service_state_chunk(uint64_t sequence_number, uint64_t offset, const bzn::service_state_t& chunk,
+            uint64_t total_size, bool delta, const bzn::hash_t& state_hash) = 0;
 
         /*
          * Tell the service to checkpoint its state when it reaches this sequence number
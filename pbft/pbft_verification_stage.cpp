@@ -0,0 +1,170 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <pbft/pbft_verification_stage.hpp>
+
+using namespace bzn;
+
+namespace
+{
+    // a flood of prepares/commits is verified in bulk, but in bounded chunks so other workers get a share
+    const size_t MAX_VERIFICATION_BATCH = 32;
+}
+
+pbft_verification_stage::pbft_verification_stage(std::shared_ptr<bzn::asio::io_context_base> io_context,
+    std::shared_ptr<bzn::crypto_base> crypto, std::shared_ptr<bzn::monitor_base> monitor, size_t thread_count,
+    size_t max_pending)
+    : io_context(std::move(io_context))
+    , crypto(std::move(crypto))
+    , monitor(std::move(monitor))
+    , max_pending(max_pending)
+{
+    for (size_t i = 0; i < thread_count; ++i)
+    {
+        this->workers.emplace_back(&pbft_verification_stage::run, this);
+    }
+}
+
+pbft_verification_stage::~pbft_verification_stage()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->lock);
+        this->stopping = true;
+    }
+    this->pending_ready.notify_all();
+
+    for (auto& worker : this->workers)
+    {
+        worker.join();
+    }
+}
+
+bool
+pbft_verification_stage::submit(std::shared_ptr<const bzn_envelope> msg, verified_handler_t handler)
+{
+    if (this->workers.empty())
+    {
+        handler(this->crypto->verify(*msg));
+        return true;
+    }
+
+    return this->submit(std::move(msg), {}, [handler = std::move(handler)](bool valid, const std::vector<bool>& /*embedded_valid*/)
+        {
+            handler(valid);
+        });
+}
+
+bool
+pbft_verification_stage::submit(std::shared_ptr<const bzn_envelope> msg, std::vector<bzn_envelope> embedded,
+    embedded_verified_handler_t handler)
+{
+    if (this->workers.empty())
+    {
+        std::vector<const bzn_envelope*> msgs{msg.get()};
+        for (const auto& envelope : embedded)
+        {
+            msgs.push_back(&envelope);
+        }
+
+        const auto results = this->crypto->verify_batch(msgs);
+        handler(results[0], std::vector<bool>(results.begin() + 1, results.end()));
+        return true;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->lock);
+
+        // pbft recovers lost messages through retransmission and view changes, but not from an unbounded backlog
+        if (this->pending.size() >= this->max_pending)
+        {
+            LOG(warning) << "Dropping message from " << msg->sender() << " because the verification queue is full";
+            this->monitor->send_counter(bzn::statistic::pbft_verification_dropped);
+            return false;
+        }
+
+        auto timer_id = "pbft_verification_" + std::to_string(this->next_timer_id++);
+        this->monitor->start_timer(timer_id);
+        this->pending.push_back({std::move(timer_id), std::move(msg), std::move(embedded), std::move(handler)});
+    }
+    this->pending_ready.notify_one();
+
+    return true;
+}
+
+size_t
+pbft_verification_stage::queued_count()
+{
+    std::lock_guard<std::mutex> lock(this->lock);
+
+    return this->pending.size();
+}
+
+void
+pbft_verification_stage::run()
+{
+    while (true)
+    {
+        std::vector<pending_verification> items;
+        {
+            std::unique_lock<std::mutex> lock(this->lock);
+            this->pending_ready.wait(lock, [&]{ return this->stopping || !this->pending.empty(); });
+
+            if (this->stopping)
+            {
+                return;
+            }
+
+            while (!this->pending.empty() && items.size() < MAX_VERIFICATION_BATCH)
+            {
+                items.emplace_back(std::move(this->pending.front()));
+                this->pending.pop_front();
+            }
+        }
+
+        // each message is followed by the envelopes embedded in it
+        std::vector<const bzn_envelope*> msgs;
+        for (auto& item : items)
+        {
+            this->monitor->finish_timer(bzn::statistic::pbft_verification_queue_latency, item.timer_id);
+            this->monitor->start_timer(item.timer_id);
+            msgs.push_back(item.msg.get());
+            for (const auto& envelope : item.embedded)
+            {
+                msgs.push_back(&envelope);
+            }
+        }
+
+        const auto results = this->crypto->verify_batch(msgs);
+
+        auto result = results.begin();
+        for (auto& item : items)
+        {
+            this->monitor->finish_timer(bzn::statistic::pbft_verification_latency, item.timer_id);
+
+            const bool valid = *result++;
+            std::vector<bool> embedded_valid(result, result + item.embedded.size());
+            result += item.embedded.size();
+
+            // the continuation takes pbft's locks, so it runs on the io_context rather than tying up a verifier
+            this->monitor->start_timer(item.timer_id);
+            this->io_context->post(
+                [monitor = this->monitor, timer_id = std::move(item.timer_id), handler = std::move(item.handler)
+                    , valid, embedded_valid = std::move(embedded_valid)]()
+                {
+                    monitor->finish_timer(bzn::statistic::pbft_verification_handoff_latency, timer_id);
+                    handler(valid, embedded_valid);
+                });
+        }
+    }
+}
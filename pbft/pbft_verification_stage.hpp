@@ -0,0 +1,92 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <include/boost_asio_beast.hpp>
+#include <crypto/crypto_base.hpp>
+#include <monitor/monitor_base.hpp>
+#include <proto/bluzelle.pb.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace bzn
+{
+    /*
+     * Verifies message signatures on a dedicated thread pool so that public key crypto never runs while pbft holds
+     * its locks. A message can bring along the envelopes embedded in it (the proofs in viewchange and newview
+     * messages), which are verified in the same pass and reported one by one. Each result is handed back through
+     * the io_context, where the continuation runs. With no threads configured, messages are verified and continued
+     * on the calling thread.
+     *
+     * Workers take messages in batches, so continuations are not guaranteed to run in the order messages were
+     * submitted; callers have to re-check anything that may have changed while a message was queued. The queue is
+     * bounded, and a message submitted while it is full is dropped rather than holding up the network thread.
+     */
+    class pbft_verification_stage
+    {
+    public:
+        using verified_handler_t = std::function<void(bool valid)>;
+        using embedded_verified_handler_t = std::function<void(bool valid, const std::vector<bool>& embedded_valid)>;
+
+        static constexpr size_t DEFAULT_MAX_PENDING_VERIFICATIONS = 10000;
+
+        pbft_verification_stage(std::shared_ptr<bzn::asio::io_context_base> io_context,
+                std::shared_ptr<bzn::crypto_base> crypto,
+                std::shared_ptr<bzn::monitor_base> monitor,
+                size_t thread_count,
+                size_t max_pending = DEFAULT_MAX_PENDING_VERIFICATIONS);
+
+        ~pbft_verification_stage();
+
+        /*
+         * Queue a message for verification.
+         * @return false if the queue is full and the message was dropped (its handler is never called)
+         */
+        bool submit(std::shared_ptr<const bzn_envelope> msg, verified_handler_t handler);
+
+        bool submit(std::shared_ptr<const bzn_envelope> msg, std::vector<bzn_envelope> embedded,
+            embedded_verified_handler_t handler);
+
+        size_t queued_count();
+
+    private:
+        struct pending_verification
+        {
+            std::string timer_id;
+            std::shared_ptr<const bzn_envelope> msg;
+            std::vector<bzn_envelope> embedded;
+            embedded_verified_handler_t handler;
+        };
+
+        void run();
+
+        std::shared_ptr<bzn::asio::io_context_base> io_context;
+        std::shared_ptr<bzn::crypto_base> crypto;
+        std::shared_ptr<bzn::monitor_base> monitor;
+        const size_t max_pending;
+
+        std::mutex lock;
+        std::condition_variable pending_ready;
+        std::deque<pending_verification> pending;
+        uint64_t next_timer_id{0};
+        bool stopping{false};
+
+        std::vector<std::thread> workers;
+    };
+}
@@ -301,11 +301,93 @@ TEST(database_pbft_service, test_that_set_state_catches_up_backlogged_operations
         .Times(Exactly(2));
 
     // push state for checkpoint at sequence 100
-    EXPECT_CALL(*mock_crud, load_state(_))
+    EXPECT_CALL(*mock_crud, load_state(_, _))
         .Times(Exactly(1))
-        .WillOnce(Invoke([](auto &) {return true;}));
-    dps.set_service_state(100, "state_at_sequence_100");
+        .WillOnce(Invoke([](auto &, auto &) {return true;}));
+
+    // ...and saved so that it can be passed on
+    EXPECT_CALL(*mock_crud, save_state(100)).WillOnce(Return(true));
+    dps.set_service_state(100, "state_at_sequence_100", "100");
 
     // operations applied should be caught up now
     ASSERT_EQ(uint64_t(102), dps.applied_requests_count());
 }
+
+
+TEST(database_pbft_service, test_that_state_hash_is_taken_when_checkpoint_is_saved)
+{
+    auto mem_storage = std::make_shared<bzn::mem_storage>();
+    auto mock_io_context = std::make_shared<NiceMock<bzn::asio::mock_io_context_base>>();
+    auto mock_crud = std::make_shared<NiceMock<bzn::mock_crud_base>>();
+
+    bzn::database_pbft_service dps(mock_io_context, mem_storage, mock_crud, std::make_shared<NiceMock<bzn::mock_monitor>>(), TEST_UUID);
+
+    dps.save_service_state_at(2);
+
+    EXPECT_CALL(*mock_crud, save_state(2)).WillOnce(Return(true));
+    EXPECT_CALL(*mock_crud, get_state_hash()).WillOnce(Return("state_hash_at_2"));
+
+    test::do_operation(1, dps);
+    test::do_operation(2, dps);
+
+    // later requests do not change the hash of the checkpoint...
+    test::do_operation(3, dps);
+
+    EXPECT_EQ("state_hash_at_2", dps.service_state_hash(2));
+    EXPECT_EQ("", dps.service_state_hash(3));
+}
+
+
+TEST(database_pbft_service, test_that_batched_requests_are_executed_in_order_with_their_own_sessions)
+{
+    auto mem_storage = std::make_shared<bzn::mem_storage>();
+    auto mock_io_context = std::make_shared<NiceMock<bzn::asio::mock_io_context_base>>();
+    auto mock_crud = std::make_shared<bzn::mock_crud_base>();
+    auto mock_monitor = std::make_shared<NiceMock<bzn::mock_monitor>>();
+
+    bzn::database_pbft_service dps(mock_io_context, mem_storage, mock_crud, mock_monitor, TEST_UUID);
+
+    pbft_request_batch batch;
+    for (size_t i = 1; i <= 3; ++i)
+    {
+        database_msg msg;
+        msg.mutable_header()->set_db_uuid(TEST_UUID);
+        msg.mutable_header()->set_nonce(i);
+        msg.mutable_create()->set_key("key" + std::to_string(i));
+        msg.mutable_create()->set_value("value" + std::to_string(i));
+
+        bzn_envelope* env = batch.add_requests();
+        env->set_sender("client" + std::to_string(i));
+        env->set_database_msg(msg.SerializeAsString());
+    }
+
+    bzn_envelope batch_env;
+    batch_env.set_pbft_request_batch(batch.SerializeAsString());
+
+    auto operation = std::make_shared<bzn::pbft_memory_operation>(0, 1, "batchhash");
+    operation->record_request(batch_env);
+
+    auto mock_session = std::make_shared<bzn::mock_session_base>();
+    EXPECT_CALL(*mock_session, is_open()).WillRepeatedly(Return(true));
+    operation->set_batch_sessions({{"hash1", nullptr}, {"hash2", mock_session}, {"hash3", nullptr}});
+
+    {
+        InSequence dummy;
+
+        for (size_t i = 1; i <= 3; ++i)
+        {
+            EXPECT_CALL(*mock_crud, handle_request("client" + std::to_string(i), _, _)).WillOnce(Invoke(
+                [i, mock_session](const bzn::caller_id_t& /*caller_id*/, const database_msg& request, const std::shared_ptr<bzn::session_base> session)
+                {
+                    EXPECT_EQ(request.create().key(), "key" + std::to_string(i));
+                    EXPECT_EQ(request.header().request_hash(), "hash" + std::to_string(i));
+                    EXPECT_EQ(session, i == 2 ? mock_session : nullptr);
+                }));
+        }
+    }
+
+    dps.apply_operation(operation);
+
+    // the whole batch takes up a single sequence...
+    EXPECT_EQ(uint64_t(1), dps.applied_requests_count());
+}
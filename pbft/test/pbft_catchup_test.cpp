@@ -41,6 +41,15 @@ namespace bzn
                 && !msg.state_hash().empty();
         }
 
+        uint64_t
+        get_state_offset(std::shared_ptr<bzn_envelope> wrapped_msg)
+        {
+            pbft_membership_msg msg;
+            msg.ParseFromString(wrapped_msg->pbft_membership());
+
+            return msg.state_offset();
+        }
+
         bool
         is_set_state(std::shared_ptr<std::string> wrapped_msg)
         {
@@ -162,13 +171,170 @@ namespace bzn
         run_transaction_through_primary();
         stabilize_checkpoint(100);
 
-        EXPECT_CALL(*this->mock_service, get_service_state(_)).Times(Exactly(1))
-            .WillOnce(Invoke([](auto &) {return std::make_shared<std::string>("dummy_state");}));
+        EXPECT_CALL(*this->mock_service, get_service_state_chunk(100, 0, STATE_TRANSFER_CHUNK_SIZE)).Times(Exactly(1))
+            .WillOnce(Return(bzn::snapshot_chunk_t{"dummy_state", 11}));
         EXPECT_CALL(*mock_session, send_message(ResultOf(is_set_state, Eq(true))))
-            .Times((Exactly(1)));
+            .Times((Exactly(1)))
+            .WillOnce(Invoke([&](auto msg)
+            {
+                auto reply = extract_pbft_membership_msg(*msg);
+                EXPECT_EQ(reply.state_data(), "dummy_state");
+                EXPECT_EQ(reply.state_offset(), 0u);
+                EXPECT_EQ(reply.state_size(), 11u);
+                EXPECT_EQ(reply.state_chunk_hash(), this->crypto->hash(std::string("dummy_state")));
+            }));
         send_get_state_request(100);
     }
 
+    TEST_F(pbft_catchup_test, primary_provides_state_delta)
+    {
+        this->build_pbft();
+
+        for (size_t i = 0; i < 99; i++)
+        {
+            run_transaction_through_primary();
+        }
+        prepare_for_checkpoint(100);
+        run_transaction_through_primary();
+        stabilize_checkpoint(100);
+
+        pbft_membership_msg msg;
+        msg.set_type(PBFT_MMSG_GET_STATE);
+        msg.set_sequence(100);
+        msg.set_state_hash("100");
+        msg.add_state_manifest("range_0");
+        msg.add_state_manifest("range_1");
+
+        EXPECT_CALL(*this->mock_service, get_service_state_delta_chunk(100,
+            std::vector<bzn::hash_t>{"range_0", "range_1"}, 0, STATE_TRANSFER_CHUNK_SIZE))
+            .WillOnce(Return(bzn::snapshot_chunk_t{"dummy_delta", 11}));
+        EXPECT_CALL(*this->mock_service, get_service_state_chunk(_, _, _)).Times(Exactly(0));
+        EXPECT_CALL(*mock_session, send_message(ResultOf(is_set_state, Eq(true))))
+            .WillOnce(Invoke([](auto msg)
+            {
+                auto reply = extract_pbft_membership_msg(*msg);
+                EXPECT_TRUE(reply.state_delta());
+                EXPECT_EQ(reply.state_data(), "dummy_delta");
+            }));
+        this->membership_handler(wrap_pbft_membership_msg(msg, this->pbft->get_uuid()), this->mock_session);
+    }
+
+    TEST_F(pbft_catchup_test, primary_answers_not_ready_while_state_is_saved)
+    {
+        this->build_pbft();
+
+        for (size_t i = 0; i < 99; i++)
+        {
+            run_transaction_through_primary();
+        }
+        prepare_for_checkpoint(100);
+        run_transaction_through_primary();
+        stabilize_checkpoint(100);
+
+        // the service does not wait for the state to be saved, and neither do we
+        EXPECT_CALL(*this->mock_service, get_service_state_chunk(100, 0, STATE_TRANSFER_CHUNK_SIZE))
+            .WillOnce(Return(bzn::snapshot_chunk_t{{}, 0, true}));
+        EXPECT_CALL(*mock_session, send_message(ResultOf(is_set_state, Eq(true))))
+            .WillOnce(Invoke([](auto msg)
+            {
+                auto reply = extract_pbft_membership_msg(*msg);
+                EXPECT_TRUE(reply.state_not_ready());
+                EXPECT_TRUE(reply.state_data().empty());
+            }));
+        send_get_state_request(100);
+    }
+
+    TEST_F(pbft_catchup_test, node_asks_again_for_state_that_is_not_ready)
+    {
+        this->uuid = SECOND_NODE_UUID;
+        this->build_pbft();
+
+        // get the node to request state
+        EXPECT_CALL(*mock_node, send_maybe_signed_message(A<const bzn::uuid_t&>(), ResultOf(is_get_state, Eq(true))))
+            .Times((Exactly(1)));
+
+        auto nodes = TEST_PEER_LIST.begin();
+        size_t req_nodes = 2 * this->faulty_nodes_bound() + 1;
+        for (size_t i = 0; i < req_nodes; i++)
+        {
+            bzn::peer_address_t node(*nodes++);
+            send_checkpoint(node, 100);
+        }
+        this->cp_manager_timer_callbacks.at(0)(boost::system::error_code{});
+
+        const bzn::uuid_t sender{"see_node_asks_again_for_state_that_is_not_ready"};
+
+        pbft_membership_msg reply;
+        reply.set_type(PBFT_MMSG_SET_STATE);
+        reply.set_sequence(100);
+        reply.set_state_hash("100");
+        reply.set_state_not_ready(true);
+
+        // nothing is applied, and the same peer is asked again once the retry delay has passed
+        EXPECT_CALL(*this->mock_service, set_service_state_chunk(_, _, _, _, _, _)).Times(Exactly(0));
+        EXPECT_CALL(*this->mock_service, set_service_state(_, _, _)).Times(Exactly(0));
+        this->membership_handler(wrap_pbft_membership_msg(reply, sender), nullptr);
+
+        EXPECT_CALL(*mock_node, send_maybe_signed_message(TypedEq<const bzn::uuid_t&>(sender),
+            AllOf(ResultOf(is_get_state, Eq(true)), ResultOf(get_state_offset, Eq(0u))))).Times((Exactly(1)));
+        this->cp_manager_timer_callbacks.at(1)(boost::system::error_code{});
+    }
+
+    TEST_F(pbft_catchup_test, node_requests_delta_for_large_state)
+    {
+        this->uuid = SECOND_NODE_UUID;
+        this->build_pbft();
+
+        // get the node to request state
+        EXPECT_CALL(*mock_node, send_maybe_signed_message(A<const bzn::uuid_t&>(), ResultOf(is_get_state, Eq(true))))
+            .Times((Exactly(1)));
+
+        auto nodes = TEST_PEER_LIST.begin();
+        size_t req_nodes = 2 * this->faulty_nodes_bound() + 1;
+        for (size_t i = 0; i < req_nodes; i++)
+        {
+            bzn::peer_address_t node(*nodes++);
+            send_checkpoint(node, 100);
+        }
+        this->cp_manager_timer_callbacks.at(0)(boost::system::error_code{});
+
+        const bzn::uuid_t sender{"see_node_requests_delta_for_large_state"};
+        const std::vector<bzn::hash_t> manifest{"range_0", "range_1"};
+
+        auto has_manifest = [&](std::shared_ptr<bzn_envelope> wrapped_msg)
+        {
+            pbft_membership_msg msg;
+            msg.ParseFromString(wrapped_msg->pbft_membership());
+            return std::vector<bzn::hash_t>(msg.state_manifest().begin(), msg.state_manifest().end()) == manifest
+                && msg.state_offset() == 0;
+        };
+
+        auto send_chunk = [&](const std::string& data, uint64_t size, bool delta)
+        {
+            pbft_membership_msg reply;
+            reply.set_type(PBFT_MMSG_SET_STATE);
+            reply.set_sequence(100);
+            reply.set_state_hash("100");
+            reply.set_state_data(data);
+            reply.set_state_size(size);
+            reply.set_state_chunk_hash(this->crypto->hash(data));
+            reply.set_state_delta(delta);
+            this->membership_handler(wrap_pbft_membership_msg(reply, sender), nullptr);
+        };
+
+        // the first chunk of a large state is answered with our manifest rather than applied...
+        EXPECT_CALL(*this->mock_service, get_service_state_manifest()).WillOnce(Return(manifest));
+        EXPECT_CALL(*mock_node, send_maybe_signed_message(TypedEq<const bzn::uuid_t&>(sender), Truly(has_manifest)))
+            .Times((Exactly(1)));
+        EXPECT_CALL(*this->mock_service, set_service_state_chunk(_, _, _, _, false, _)).Times(Exactly(0));
+        send_chunk(std::string(STATE_TRANSFER_CHUNK_SIZE, 's'), 10 * STATE_TRANSFER_CHUNK_SIZE, false);
+
+        // ...and the delta the sender builds from it is applied
+        EXPECT_CALL(*this->mock_service, set_service_state_chunk(100, 0, "delta", 5, true, "100")).WillOnce(Return(true));
+        send_chunk("delta", 5, true);
+        EXPECT_EQ(this->pbft->latest_stable_checkpoint(), checkpoint_t(100, "100"));
+    }
+
     TEST_F(pbft_catchup_test, node_adopts_requested_checkpoint)
     {
         this->uuid = SECOND_NODE_UUID;
@@ -197,12 +363,109 @@ namespace bzn
         reply.set_state_data("state_100");
         reply.set_allocated_newview_msg(new bzn_envelope(build_newview_msg(new_view, 100)));
         auto wmsg = wrap_pbft_membership_msg(reply, "see_node_adopts_requested_checkpoint");
+        EXPECT_CALL(*this->mock_service, set_service_state(100, "state_100", "100")).WillOnce(Return(true));
         this->membership_handler(wmsg, nullptr);
 
         EXPECT_EQ(this->pbft->latest_stable_checkpoint(), checkpoint_t(100, "100"));
         EXPECT_EQ(this->pbft->get_view(), new_view);
     }
 
+    TEST_F(pbft_catchup_test, node_adopts_requested_checkpoint_in_chunks)
+    {
+        this->uuid = SECOND_NODE_UUID;
+        this->build_pbft();
+
+        // get the node to request state
+        EXPECT_CALL(*mock_node, send_maybe_signed_message(A<const bzn::uuid_t&>(), ResultOf(is_get_state, Eq(true))))
+            .Times((Exactly(1)));
+
+        auto nodes = TEST_PEER_LIST.begin();
+        size_t req_nodes = 2 * this->faulty_nodes_bound() + 1;
+        for (size_t i = 0; i < req_nodes; i++)
+        {
+            bzn::peer_address_t node(*nodes++);
+            send_checkpoint(node, 100);
+        }
+        this->cp_manager_timer_callbacks.at(0)(boost::system::error_code{});
+
+        const std::string state{"state_100"};
+        const bzn::uuid_t sender{"see_node_adopts_requested_checkpoint_in_chunks"};
+        const uint64_t new_view = 3;
+
+        auto send_chunk = [&](uint64_t offset, size_t size, const std::string& hash)
+        {
+            pbft_membership_msg reply;
+            reply.set_type(PBFT_MMSG_SET_STATE);
+            reply.set_sequence(100);
+            reply.set_state_hash("100");
+            reply.set_state_data(state.substr(offset, size));
+            reply.set_state_offset(offset);
+            reply.set_state_size(state.size());
+            reply.set_state_chunk_hash(hash);
+            reply.set_allocated_newview_msg(new bzn_envelope(build_newview_msg(new_view, 100)));
+            this->membership_handler(wrap_pbft_membership_msg(reply, sender), nullptr);
+        };
+
+        // the node asks the same peer for the rest of the state after each chunk
+        EXPECT_CALL(*mock_node, send_maybe_signed_message(TypedEq<const bzn::uuid_t&>(sender), ResultOf(get_state_offset, Eq(4u))))
+            .Times((Exactly(1)));
+        EXPECT_CALL(*this->mock_service, set_service_state_chunk(100, 0, "stat", state.size(), false, "100"))
+            .WillOnce(Return(true));
+        EXPECT_CALL(*this->mock_service, set_service_state_chunk(100, 4, "e_100", state.size(), false, "100"))
+            .WillOnce(Return(true));
+
+        // a chunk failing its hash check is dropped
+        send_chunk(0, 4, "bad hash");
+
+        send_chunk(0, 4, this->crypto->hash(state.substr(0, 4)));
+        EXPECT_NE(this->pbft->get_view(), new_view);
+
+        send_chunk(4, 5, this->crypto->hash(state.substr(4, 5)));
+        EXPECT_EQ(this->pbft->latest_stable_checkpoint(), checkpoint_t(100, "100"));
+        EXPECT_EQ(this->pbft->get_view(), new_view);
+    }
+
+    TEST_F(pbft_catchup_test, node_doesnt_adopt_state_that_doesnt_hash_to_checkpoint)
+    {
+        this->uuid = SECOND_NODE_UUID;
+        this->build_pbft();
+
+        // get the node to request state
+        EXPECT_CALL(*mock_node, send_maybe_signed_message(A<const bzn::uuid_t&>(), ResultOf(is_get_state, Eq(true))))
+            .Times((Exactly(1)));
+
+        auto nodes = TEST_PEER_LIST.begin();
+        size_t req_nodes = 2 * this->faulty_nodes_bound() + 1;
+        for (size_t i = 0; i < req_nodes; i++)
+        {
+            bzn::peer_address_t node(*nodes++);
+            send_checkpoint(node, 100);
+        }
+        this->cp_manager_timer_callbacks.at(0)(boost::system::error_code{});
+
+        const std::string state{"state_100"};
+        const bzn::uuid_t sender{TEST_PEER_LIST.begin()->uuid};
+        const uint64_t new_view = 3;
+
+        pbft_membership_msg reply;
+        reply.set_type(PBFT_MMSG_SET_STATE);
+        reply.set_sequence(100);
+        reply.set_state_hash("100");
+        reply.set_state_data(state);
+        reply.set_state_size(state.size());
+        reply.set_state_chunk_hash(this->crypto->hash(state));
+        reply.set_allocated_newview_msg(new bzn_envelope(build_newview_msg(new_view, 100)));
+
+        // the service refuses the complete state, so the node asks another replica that attested the checkpoint
+        EXPECT_CALL(*this->mock_service, set_service_state_chunk(100, 0, state, state.size(), false, "100"))
+            .WillOnce(Return(false));
+        EXPECT_CALL(*mock_node, send_maybe_signed_message(Matcher<const bzn::uuid_t&>(Ne(sender)),
+            AllOf(ResultOf(is_get_state, Eq(true)), ResultOf(get_state_offset, Eq(0u))))).Times((Exactly(1)));
+        this->membership_handler(wrap_pbft_membership_msg(reply, sender), nullptr);
+
+        EXPECT_NE(this->pbft->get_view(), new_view);
+    }
+
     TEST_F(pbft_catchup_test, node_doesnt_adopt_wrong_checkpoint)
     {
         this->uuid = SECOND_NODE_UUID;
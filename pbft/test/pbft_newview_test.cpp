@@ -45,6 +45,17 @@ namespace bzn
                                                return envelope.sender() + "_" + std::to_string(current_sequence) + "_" + std::to_string(envelope.timestamp());
                                            }));
 
+            EXPECT_CALL(*mockcrypto, hash_batch(_))
+                    .WillRepeatedly(Invoke([&](const std::vector<const bzn_envelope*>& envelopes)
+                                           {
+                                               std::vector<std::string> hashes;
+                                               for (const auto envelope : envelopes)
+                                               {
+                                                   hashes.emplace_back(envelope->sender() + "_" + std::to_string(current_sequence) + "_" + std::to_string(envelope->timestamp()));
+                                               }
+                                               return hashes;
+                                           }));
+
             EXPECT_CALL(*mockcrypto, sign(_)).WillRepeatedly(Return(true));
             EXPECT_CALL(*mockcrypto, verify(_)).WillRepeatedly(Return(true));
 
@@ -0,0 +1,127 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <pbft/pbft_quorum_certificate.hpp>
+#include <gtest/gtest.h>
+
+using namespace ::testing;
+
+namespace
+{
+    const size_t QUORUM_SIZE = 7;
+
+    std::vector<bzn_envelope>
+    make_prepares()
+    {
+        pbft_msg prepare;
+        prepare.set_type(PBFT_MSG_PREPARE);
+        prepare.set_view(3);
+        prepare.set_sequence(42);
+        prepare.set_request_hash(std::string(32, 'h'));
+
+        std::vector<bzn_envelope> prepares;
+        for (size_t i = 0; i < QUORUM_SIZE; ++i)
+        {
+            bzn_envelope env;
+            env.set_swarm_id("swarm");
+            env.set_pbft(prepare.SerializeAsString());
+            env.set_sender("peer_" + std::to_string(i));
+            env.set_timestamp(1000 + i);
+            env.set_signature(std::string(72, 'a' + i));
+            prepares.push_back(env);
+        }
+
+        return prepares;
+    }
+}
+
+
+TEST(pbft_quorum_certificate, test_that_certificate_expands_to_the_signed_envelopes)
+{
+    const auto prepares = make_prepares();
+
+    quorum_certificate certificate;
+    ASSERT_TRUE(bzn::make_quorum_certificate(prepares, certificate));
+    EXPECT_EQ(certificate.signatures_size(), static_cast<int>(QUORUM_SIZE));
+
+    google::protobuf::RepeatedPtrField<bzn_envelope> expanded;
+    bzn::expand_quorum_certificate(certificate, expanded);
+
+    ASSERT_EQ(expanded.size(), static_cast<int>(QUORUM_SIZE));
+    for (size_t i = 0; i < QUORUM_SIZE; ++i)
+    {
+        EXPECT_EQ(expanded.Get(i).SerializeAsString(), prepares[i].SerializeAsString());
+    }
+}
+
+
+TEST(pbft_quorum_certificate, test_that_certificate_is_smaller_than_the_envelopes)
+{
+    const auto prepares = make_prepares();
+
+    prepared_proof full;
+    for (const auto& prepare : prepares)
+    {
+        *full.add_prepare() = prepare;
+    }
+
+    prepared_proof compact;
+    ASSERT_TRUE(bzn::make_quorum_certificate(prepares, *compact.mutable_prepare_certificate()));
+
+    EXPECT_LT(compact.ByteSizeLong(), full.ByteSizeLong());
+}
+
+
+TEST(pbft_quorum_certificate, test_that_differing_messages_are_not_compacted)
+{
+    auto prepares = make_prepares();
+    prepares.back().set_pbft("something else");
+
+    quorum_certificate certificate;
+    EXPECT_FALSE(bzn::make_quorum_certificate(prepares, certificate));
+    EXPECT_FALSE(bzn::make_quorum_certificate({}, certificate));
+
+    prepares = make_prepares();
+    *prepares.front().add_piggybacked_requests() = prepares.back();
+    EXPECT_FALSE(bzn::make_quorum_certificate(prepares, certificate));
+
+    EXPECT_EQ(certificate.signatures_size(), 0);
+}
+
+
+TEST(pbft_quorum_certificate, test_that_received_messages_are_expanded_in_place)
+{
+    const auto prepares = make_prepares();
+
+    pbft_msg viewchange;
+    viewchange.set_type(PBFT_MSG_VIEWCHANGE);
+    auto proof = viewchange.add_prepared_proofs();
+    ASSERT_TRUE(bzn::make_quorum_certificate(prepares, *proof->mutable_prepare_certificate()));
+    ASSERT_TRUE(bzn::make_quorum_certificate(prepares, *viewchange.mutable_checkpoint_certificate()));
+
+    bzn::expand_quorum_certificates(viewchange);
+
+    EXPECT_FALSE(viewchange.has_checkpoint_certificate());
+    EXPECT_FALSE(viewchange.prepared_proofs(0).has_prepare_certificate());
+    EXPECT_EQ(viewchange.checkpoint_messages_size(), static_cast<int>(QUORUM_SIZE));
+    EXPECT_EQ(viewchange.prepared_proofs(0).prepare_size(), static_cast<int>(QUORUM_SIZE));
+
+    pbft_membership_msg set_state;
+    ASSERT_TRUE(bzn::make_quorum_certificate(prepares, *set_state.mutable_checkpoint_proof_certificate()));
+    bzn::expand_quorum_certificates(set_state);
+
+    EXPECT_FALSE(set_state.has_checkpoint_proof_certificate());
+    EXPECT_EQ(set_state.checkpoint_proof_size(), static_cast<int>(QUORUM_SIZE));
+}
@@ -14,6 +14,7 @@
 
 #include <pbft/test/pbft_test_common.hpp>
 #include <set>
+#include <thread>
 #include <mocks/mock_session_base.hpp>
 #include <utils/make_endpoint.hpp>
 #include <gtest/gtest.h>
@@ -40,6 +41,64 @@ namespace bzn::test
         pbft->handle_database_message(this->request_msg, this->mock_session);
     }
 
+    TEST_F(pbft_test, test_batched_requests_share_one_preprepare)
+    {
+        this->options->get_mutable_simple_options().set(bzn::option_names::PBFT_BATCH_MAX_REQUESTS, "3");
+        this->build_pbft();
+
+        pbft_request_batch batch;
+        EXPECT_CALL(*mock_node, send_maybe_signed_message(A<const boost::asio::ip::tcp::endpoint&>(), ResultOf(is_preprepare, Eq(true))))
+                .Times(Exactly(TEST_PEER_LIST.size()))
+                .WillRepeatedly(Invoke(
+                    [&](auto /*ep*/, auto msg)
+                    {
+                        ASSERT_EQ(msg->piggybacked_requests_size(), 1);
+                        EXPECT_TRUE(batch.ParseFromString(msg->piggybacked_requests(0).pbft_request_batch()));
+                    }));
+
+        for (uint64_t nonce = 1; nonce <= 3; ++nonce)
+        {
+            database_msg req;
+            req.mutable_header()->set_nonce(nonce);
+            pbft->handle_database_message(wrap_request(req), this->mock_session);
+        }
+
+        EXPECT_EQ(batch.requests_size(), 3);
+        EXPECT_EQ(1u, this->operation_manager->held_operations_count());
+    }
+
+    TEST_F(pbft_test, test_request_batch_fits_in_a_stored_value)
+    {
+        // the fixture's operations are persisted, so a batch that storage refuses could not be ordered
+        this->options->get_mutable_simple_options().set(bzn::option_names::PBFT_BATCH_MAX_REQUESTS, "10");
+        this->options->get_mutable_simple_options().set(bzn::option_names::PBFT_BATCH_MAX_BYTES, std::to_string(1024 * 1024));
+        this->build_pbft();
+
+        pbft_request_batch batch;
+        EXPECT_CALL(*mock_node, send_maybe_signed_message(A<const boost::asio::ip::tcp::endpoint&>(), ResultOf(is_preprepare, Eq(true))))
+                .Times(Exactly(TEST_PEER_LIST.size()))
+                .WillRepeatedly(Invoke(
+                    [&](auto /*ep*/, auto msg)
+                    {
+                        ASSERT_EQ(msg->piggybacked_requests_size(), 1);
+                        EXPECT_LE(msg->piggybacked_requests(0).ByteSizeLong(), bzn::MAX_VALUE_SIZE);
+                        EXPECT_TRUE(batch.ParseFromString(msg->piggybacked_requests(0).pbft_request_batch()));
+                    }));
+
+        // three requests of nearly 100KB each do not fit in one value
+        for (uint64_t nonce = 1; nonce <= 3; ++nonce)
+        {
+            database_msg req;
+            req.mutable_header()->set_nonce(nonce);
+            req.mutable_create()->set_key("key");
+            req.mutable_create()->set_value(std::string(100000, 'a'));
+            EXPECT_NO_THROW(pbft->handle_database_message(wrap_request(req), this->mock_session));
+        }
+
+        EXPECT_EQ(batch.requests_size(), 2);
+        EXPECT_EQ(1u, this->operation_manager->held_operations_count());
+    }
+
     TEST_F(pbft_test, test_forwarded_to_primary_when_not_primary)
     {
         EXPECT_CALL(*mock_node, send_signed_message(A<const boost::asio::ip::tcp::endpoint&>(), A<std::shared_ptr<bzn_envelope>>())).Times(1).WillRepeatedly(Invoke(
@@ -57,6 +116,17 @@ namespace bzn::test
 
     }
 
+    TEST_F(pbft_test, test_forwarded_request_is_hashed_once)
+    {
+        this->uuid = SECOND_NODE_UUID;
+        this->build_pbft();
+
+        EXPECT_CALL(*this->monitor, send_counter(_, _)).Times(AnyNumber());
+        EXPECT_CALL(*this->monitor, send_counter(bzn::statistic::hash_computed, _)).Times(Exactly(1));
+
+        pbft->handle_database_message(this->request_msg, this->mock_session);
+    }
+
     std::set<uint64_t> seen_sequences;
 
     void
@@ -92,6 +162,103 @@ namespace bzn::test
         this->pbft->handle_message(this->preprepare_msg, default_original_msg);
     }
 
+    TEST_F(pbft_test, test_different_sequences_agree_concurrently)
+    {
+        const uint64_t sequences = 8;
+
+        this->build_pbft();
+        EXPECT_CALL(*mock_node, send_maybe_signed_message(A<const boost::asio::ip::tcp::endpoint&>(), ResultOf(is_prepare, Eq(true))))
+                .Times(Exactly(TEST_PEER_LIST.size() * sequences));
+        EXPECT_CALL(*mock_node, send_maybe_signed_message(A<const boost::asio::ip::tcp::endpoint&>(), ResultOf(is_commit, Eq(true))))
+                .Times(Exactly(TEST_PEER_LIST.size() * sequences));
+
+        std::vector<std::thread> threads;
+        for (uint64_t seq = 1; seq <= sequences; ++seq)
+        {
+            threads.emplace_back([this, seq]()
+            {
+                pbft_msg preprepare(this->preprepare_msg);
+                preprepare.set_sequence(seq);
+                preprepare.set_request_hash("hash" + std::to_string(seq));
+                this->pbft->handle_message(preprepare, default_original_msg);
+
+                for (const auto& peer : TEST_PEER_LIST)
+                {
+                    pbft_msg prepare(preprepare);
+                    prepare.set_type(PBFT_MSG_PREPARE);
+                    this->pbft->handle_message(prepare, from(peer.uuid));
+                }
+            });
+        }
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        EXPECT_EQ(this->operation_manager->held_operations_count(), sequences);
+    }
+
+    TEST_F(pbft_test, test_preprepare_outside_water_marks_rejected)
+    {
+        this->build_pbft();
+        EXPECT_CALL(*mock_node, send_maybe_signed_message(A<const boost::asio::ip::tcp::endpoint&>(), _)).Times(Exactly(0));
+
+        pbft_msg preprepare2(this->preprepare_msg);
+        preprepare2.set_sequence(this->pbft->get_high_water_mark() + 1);
+        this->pbft->handle_message(preprepare2, default_original_msg);
+
+        preprepare2.set_sequence(this->pbft->get_low_water_mark());
+        this->pbft->handle_message(preprepare2, default_original_msg);
+    }
+
+    TEST_F(pbft_test, test_agreement_messages_at_or_below_low_water_mark_are_not_recorded)
+    {
+        this->build_pbft();
+        const auto held = this->operation_manager->held_operations_count();
+
+        pbft_msg late(this->preprepare_msg);
+        late.set_sequence(this->pbft->get_low_water_mark());
+
+        late.set_type(PBFT_MSG_PREPARE);
+        EXPECT_FALSE(this->pbft->preliminary_filter_msg(late));
+        this->pbft->handle_message(late, default_original_msg);
+
+        late.set_type(PBFT_MSG_COMMIT);
+        EXPECT_FALSE(this->pbft->preliminary_filter_msg(late));
+        this->pbft->handle_message(late, default_original_msg);
+
+        EXPECT_EQ(this->operation_manager->held_operations_count(), held);
+
+        late.set_sequence(this->pbft->get_low_water_mark() + 1);
+        EXPECT_TRUE(this->pbft->preliminary_filter_msg(late));
+    }
+
+    TEST_F(pbft_test, test_window_occupancy_tracks_sequences_in_flight)
+    {
+        this->build_pbft();
+
+        std::vector<uint64_t> occupancy;
+        EXPECT_CALL(*this->monitor, send_gauge(bzn::statistic::pbft_window_occupancy, _)).WillRepeatedly(Invoke(
+            [&](auto /*stat*/, uint64_t value)
+            {
+                occupancy.push_back(value);
+            }));
+
+        // sequences may be agreed on out of order; the window spans up to the highest one
+        pbft_msg preprepare2(this->preprepare_msg);
+        preprepare2.set_sequence(3);
+        preprepare2.set_request_hash("hash3");
+        this->pbft->handle_message(preprepare2, default_original_msg);
+
+        preprepare2.set_sequence(2);
+        preprepare2.set_request_hash("hash2");
+        this->pbft->handle_message(preprepare2, default_original_msg);
+
+        EXPECT_EQ(occupancy, std::vector<uint64_t>({3, 3}));
+        EXPECT_EQ(this->pbft->get_status()["pipeline_window_occupancy"].asUInt64(), 3u);
+    }
+
     TEST_F(pbft_test, test_wrong_view_preprepare_rejected)
     {
         this->build_pbft();
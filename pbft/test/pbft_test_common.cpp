@@ -140,6 +140,7 @@ namespace bzn::test
         this->options->get_mutable_simple_options().set("listener_port", std::to_string(TEST_NODE_LISTEN_PORT));
         this->options->get_mutable_simple_options().set("crypto_enabled_incoming", std::to_string(false));
         this->options->get_mutable_simple_options().set("crypto_enabled_outgoing", std::to_string(false));
+        this->options->get_mutable_simple_options().set(bzn::option_names::PBFT_VERIFIER_THREADS, "0");
 
         preprepare_msg = pbft_msg();
         preprepare_msg.set_type(PBFT_MSG_PREPREPARE);
@@ -79,8 +79,9 @@ namespace bzn::test
                 std::make_shared<NiceMock<bzn::mock_session_base>>();
         std::shared_ptr<bzn::storage_base> storage = std::make_shared<bzn::mem_storage>();
 
+        // records are written as they are made, so that messages are sent before the handler returns
         std::shared_ptr<bzn::pbft_operation_manager> operation_manager =
-                std::make_shared<bzn::pbft_operation_manager>(static_peers_beacon_for(TEST_PEER_LIST), storage);
+                std::make_shared<bzn::pbft_operation_manager>(static_peers_beacon_for(TEST_PEER_LIST), storage, nullptr, false);
 
         std::shared_ptr<bzn::options_base> options = std::make_shared<bzn::options>();
         std::shared_ptr<bzn::mock_monitor> monitor = std::make_shared<NiceMock<bzn::mock_monitor>>();
@@ -0,0 +1,209 @@
+// Copyright (C) 2018 Bluzelle
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License, version 3,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include <pbft/pbft_verification_stage.hpp>
+#include <mocks/mock_boost_asio_beast.hpp>
+#include <mocks/mock_crypto_base.hpp>
+#include <mocks/mock_monitor.hpp>
+#include <gtest/gtest.h>
+#include <chrono>
+#include <future>
+#include <optional>
+#include <thread>
+
+using namespace ::testing;
+
+namespace
+{
+    bzn_envelope
+    make_envelope(const std::string& sender)
+    {
+        bzn_envelope env;
+        env.set_sender(sender);
+        return env;
+    }
+}
+
+TEST(pbft_verification_stage, test_that_messages_are_verified_inline_without_threads)
+{
+    auto mock_io_context = std::make_shared<bzn::asio::mock_io_context_base>();
+    auto mock_crypto = std::make_shared<bzn::mock_crypto_base>();
+    auto mock_monitor = std::make_shared<NiceMock<bzn::mock_monitor>>();
+
+    EXPECT_CALL(*mock_crypto, verify(_)).WillRepeatedly(Invoke([](const bzn_envelope& msg){ return msg.sender() == "good"; }));
+    EXPECT_CALL(*mock_io_context, post(_)).Times(0);
+
+    bzn::pbft_verification_stage stage(mock_io_context, mock_crypto, mock_monitor, 0);
+
+    std::vector<bool> results;
+    stage.submit(std::make_shared<const bzn_envelope>(make_envelope("good")), [&](bool valid){ results.push_back(valid); });
+    stage.submit(std::make_shared<const bzn_envelope>(make_envelope("bad")), [&](bool valid){ results.push_back(valid); });
+
+    EXPECT_EQ(results, std::vector<bool>({true, false}));
+}
+
+TEST(pbft_verification_stage, test_that_results_are_handed_back_through_io_context)
+{
+    const size_t MESSAGES = 20;
+
+    auto mock_io_context = std::make_shared<bzn::asio::mock_io_context_base>();
+    auto mock_crypto = std::make_shared<bzn::mock_crypto_base>();
+    auto mock_monitor = std::make_shared<NiceMock<bzn::mock_monitor>>();
+
+    EXPECT_CALL(*mock_crypto, verify_batch(_)).WillRepeatedly(Invoke([](const std::vector<const bzn_envelope*>& msgs)
+    {
+        std::vector<bool> results;
+        for (const auto msg : msgs)
+        {
+            results.push_back(msg->sender() == "good");
+        }
+        return results;
+    }));
+
+    std::mutex posted_lock;
+    std::vector<bzn::asio::task> posted;
+    EXPECT_CALL(*mock_io_context, post(_)).WillRepeatedly(Invoke([&](bzn::asio::task task)
+    {
+        std::lock_guard<std::mutex> lock(posted_lock);
+        posted.push_back(std::move(task));
+    }));
+
+    EXPECT_CALL(*mock_monitor, finish_timer(bzn::statistic::pbft_verification_queue_latency, _)).Times(MESSAGES);
+    EXPECT_CALL(*mock_monitor, finish_timer(bzn::statistic::pbft_verification_latency, _)).Times(MESSAGES);
+    EXPECT_CALL(*mock_monitor, finish_timer(bzn::statistic::pbft_verification_handoff_latency, _)).Times(MESSAGES);
+
+    bzn::pbft_verification_stage stage(mock_io_context, mock_crypto, mock_monitor, 4);
+
+    size_t valid_count = 0;
+    size_t invalid_count = 0;
+    for (size_t i = 0; i < MESSAGES; ++i)
+    {
+        stage.submit(std::make_shared<const bzn_envelope>(make_envelope(i % 2 ? "good" : "bad")),
+            [&](bool valid){ valid ? ++valid_count : ++invalid_count; });
+    }
+
+    // nothing is continued on the verifier threads themselves
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (std::chrono::steady_clock::now() < deadline)
+    {
+        {
+            std::lock_guard<std::mutex> lock(posted_lock);
+            if (posted.size() == MESSAGES)
+            {
+                break;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(valid_count + invalid_count, 0u);
+    EXPECT_EQ(stage.queued_count(), 0u);
+
+    std::lock_guard<std::mutex> lock(posted_lock);
+    ASSERT_EQ(posted.size(), MESSAGES);
+    for (const auto& task : posted)
+    {
+        task();
+    }
+
+    EXPECT_EQ(valid_count, MESSAGES / 2);
+    EXPECT_EQ(invalid_count, MESSAGES / 2);
+}
+
+TEST(pbft_verification_stage, test_that_embedded_envelopes_are_verified_with_their_message)
+{
+    auto mock_io_context = std::make_shared<bzn::asio::mock_io_context_base>();
+    auto mock_crypto = std::make_shared<bzn::mock_crypto_base>();
+    auto mock_monitor = std::make_shared<NiceMock<bzn::mock_monitor>>();
+
+    // a message and what it carries go through one verification pass
+    EXPECT_CALL(*mock_crypto, verify_batch(_)).WillOnce(Invoke([](const std::vector<const bzn_envelope*>& msgs)
+    {
+        EXPECT_EQ(msgs.size(), 3u);
+        std::vector<bool> results;
+        for (const auto msg : msgs)
+        {
+            results.push_back(msg->sender() == "good");
+        }
+        return results;
+    }));
+
+    std::vector<bzn::asio::task> posted;
+    EXPECT_CALL(*mock_io_context, post(_)).WillRepeatedly(Invoke([&](bzn::asio::task task)
+    {
+        posted.push_back(std::move(task));
+    }));
+
+    std::optional<bool> valid_result;
+    std::vector<bool> embedded_results;
+    {
+        bzn::pbft_verification_stage stage(mock_io_context, mock_crypto, mock_monitor, 1);
+
+        stage.submit(std::make_shared<const bzn_envelope>(make_envelope("good")),
+            {make_envelope("bad"), make_envelope("good")},
+            [&](bool valid, const std::vector<bool>& embedded_valid)
+            {
+                valid_result = valid;
+                embedded_results = embedded_valid;
+            });
+
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (stage.queued_count() > 0 && std::chrono::steady_clock::now() < deadline)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    ASSERT_EQ(posted.size(), 1u);
+    posted.front()();
+
+    EXPECT_EQ(valid_result, std::optional<bool>(true));
+    EXPECT_EQ(embedded_results, std::vector<bool>({false, true}));
+}
+
+TEST(pbft_verification_stage, test_that_messages_are_dropped_when_the_queue_is_full)
+{
+    auto mock_io_context = std::make_shared<NiceMock<bzn::asio::mock_io_context_base>>();
+    auto mock_crypto = std::make_shared<bzn::mock_crypto_base>();
+    auto mock_monitor = std::make_shared<NiceMock<bzn::mock_monitor>>();
+
+    // the worker is held up by the first message while the rest queue behind it
+    std::promise<void> release;
+    std::shared_future<void> released(release.get_future());
+    EXPECT_CALL(*mock_crypto, verify_batch(_)).WillRepeatedly(Invoke([released](const std::vector<const bzn_envelope*>& msgs)
+    {
+        released.wait();
+        return std::vector<bool>(msgs.size(), true);
+    }));
+
+    EXPECT_CALL(*mock_monitor, send_counter(bzn::statistic::pbft_verification_dropped, 1)).Times(1);
+
+    {
+        bzn::pbft_verification_stage stage(mock_io_context, mock_crypto, mock_monitor, 1, 2);
+
+        EXPECT_TRUE(stage.submit(std::make_shared<const bzn_envelope>(make_envelope("good")), [](bool){}));
+
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (stage.queued_count() > 0 && std::chrono::steady_clock::now() < deadline)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        EXPECT_TRUE(stage.submit(std::make_shared<const bzn_envelope>(make_envelope("good")), [](bool){}));
+        EXPECT_TRUE(stage.submit(std::make_shared<const bzn_envelope>(make_envelope("good")), [](bool){}));
+        EXPECT_FALSE(stage.submit(std::make_shared<const bzn_envelope>(make_envelope("good")), [](bool){}));
+        EXPECT_EQ(stage.queued_count(), 2u);
+
+        release.set_value();
+    }
+}
@@ -16,6 +16,7 @@
 #include <mocks/mock_node_base.hpp>
 #include <mocks/mock_session_base.hpp>
 #include <mocks/mock_crypto_base.hpp>
+#include <pbft/pbft_quorum_certificate.hpp>
 #include <mocks/mock_options_base.hpp>
 #include <pbft/test/pbft_proto_test.hpp>
 #include <utils/make_endpoint.hpp>
@@ -106,11 +107,22 @@ namespace bzn
         message.set_type(PBFT_MSG_COMMIT);
         EXPECT_FALSE(this->pbft->preliminary_filter_msg(message));
 
+        message.set_view(this->pbft->get_view() + 1);
+
         message.set_type(PBFT_MSG_VIEWCHANGE);
         EXPECT_TRUE(this->pbft->preliminary_filter_msg(message));
 
         message.set_type(PBFT_MSG_NEWVIEW);
         EXPECT_TRUE(this->pbft->preliminary_filter_msg(message));
+
+        // ...but not ones that have been overtaken by the current view
+        message.set_view(this->pbft->get_view());
+
+        message.set_type(PBFT_MSG_VIEWCHANGE);
+        EXPECT_FALSE(this->pbft->preliminary_filter_msg(message));
+
+        message.set_type(PBFT_MSG_NEWVIEW);
+        EXPECT_FALSE(this->pbft->preliminary_filter_msg(message));
     }
 
     TEST_F(pbft_viewchange_test, test_is_peer)
@@ -138,6 +150,7 @@ namespace bzn
             {
                 pbft_msg viewchange;
                 viewchange.ParseFromString(viewchange_env->pbft());
+                bzn::expand_quorum_certificates(viewchange);
                 EXPECT_EQ(PBFT_MSG_VIEWCHANGE, viewchange.type());
 
                 std::map<bzn::checkpoint_t, std::set<bzn::uuid_t>> checkpoints = this->pbft->validate_and_extract_checkpoint_hashes(
@@ -180,6 +193,7 @@ namespace bzn
             {
                 pbft_msg viewchange;
                 EXPECT_TRUE(viewchange.ParseFromString(viewchange_env->pbft())); // this will be valid.
+                bzn::expand_quorum_certificates(viewchange);
                 viewchange_env->set_sender(this->pbft->get_uuid());
                 EXPECT_TRUE(this->pbft->is_valid_viewchange_message(viewchange, *viewchange_env));
             }));
@@ -202,6 +216,11 @@ namespace bzn
         pbft_msg viewchange;
         viewchange.ParseFromString(viewchange_env->pbft());
 
+        // the agreeing checkpoint messages travel as one certificate
+        EXPECT_EQ(0, viewchange.checkpoint_messages_size());
+        EXPECT_EQ(3, viewchange.checkpoint_certificate().signatures_size());
+
+        bzn::expand_quorum_certificates(viewchange);
         EXPECT_EQ(PBFT_MSG_VIEWCHANGE, viewchange.type());
         EXPECT_EQ(current_sequence, viewchange.sequence());
         EXPECT_EQ(3, viewchange.checkpoint_messages_size());
@@ -330,7 +349,7 @@ namespace bzn
         auto peers = static_peers_beacon_for(TEST_PEER_LIST);
 
         auto storage2 = std::make_shared<bzn::mem_storage>();
-        auto manager2 = std::make_shared<bzn::pbft_operation_manager>(peers, storage2);
+        auto manager2 = std::make_shared<bzn::pbft_operation_manager>(peers, storage2, nullptr, false);
         auto monitor = std::make_shared<NiceMock<bzn::mock_monitor>>();
 
         auto pbft2 = std::make_shared<bzn::pbft>(mock_node2, mock_io_context2, peers, mock_options, mock_service2
@@ -362,6 +381,7 @@ namespace bzn
                 {
                    pbft_msg msg;
                    ASSERT_TRUE(msg.ParseFromString(wmsg->pbft()));
+                   bzn::expand_quorum_certificates(msg);
                    wmsg->set_sender(p.uuid);
                    for (const auto& peer : TEST_PEER_LIST)
                    {
@@ -61,6 +61,38 @@ mem_storage::create(const bzn::uuid_t& uuid, const bzn::key_t& key, const bzn::v
 }
 
 
+bzn::storage_result
+mem_storage::create_batch(const std::vector<bzn::storage_record_t>& records)
+{
+    std::lock_guard<std::shared_mutex> lock(this->kv_store_lock); // lock for write access
+
+    for (const auto& record : records)
+    {
+        if (record.value.size() > bzn::MAX_VALUE_SIZE)
+        {
+            return bzn::storage_result::value_too_large;
+        }
+
+        if (record.key.size() > bzn::MAX_KEY_SIZE)
+        {
+            return bzn::storage_result::key_too_large;
+        }
+    }
+
+    for (const auto& record : records)
+    {
+        auto& inner_db = this->kv_store[record.uuid];
+
+        if (inner_db.second.emplace(record.key, record.value).second)
+        {
+            inner_db.first += record.value.size() + record.key.size();
+        }
+    }
+
+    return bzn::storage_result::ok;
+}
+
+
 std::optional<bzn::value_t>
 mem_storage::read(const bzn::uuid_t& uuid, const bzn::key_t& key)
 {
@@ -231,7 +263,7 @@ mem_storage::remove(const bzn::uuid_t& uuid)
 
 
 bool
-mem_storage::create_snapshot()
+mem_storage::create_snapshot(uint64_t checkpoint)
 {
     std::shared_lock<std::shared_mutex> lock(this->kv_store_lock); // lock for read access
 
@@ -241,6 +273,7 @@ mem_storage::create_snapshot()
         boost::archive::text_oarchive archive(strm);
         archive << this->kv_store;
         this->latest_snapshot = std::make_shared<std::string>(strm.str());
+        this->latest_snapshot_checkpoint = checkpoint;
 
         return true;
     }
@@ -262,7 +295,7 @@ mem_storage::get_snapshot()
 
 
 bool
-mem_storage::load_snapshot(const std::string& data)
+mem_storage::load_snapshot(const std::string& data, const bzn::hash_t& /*state_hash*/)
 {
     std::shared_lock<std::shared_mutex> lock(this->kv_store_lock); // lock for write access
 
@@ -271,7 +304,6 @@ mem_storage::load_snapshot(const std::string& data)
         std::stringstream strm(data);
         boost::archive::text_iarchive archive(strm);
         archive >> this->kv_store;
-        this->latest_snapshot = std::make_shared<std::string>(data);
 
         return true;
     }
@@ -284,6 +316,98 @@ mem_storage::load_snapshot(const std::string& data)
 }
 
 
+std::optional<bzn::snapshot_chunk_t>
+mem_storage::get_snapshot_chunk(uint64_t checkpoint, uint64_t offset, size_t max_size)
+{
+    std::shared_lock<std::shared_mutex> lock(this->kv_store_lock); // lock for read access
+
+    // snapshots are taken in place, so only the latest one is ever available...
+    if (!this->latest_snapshot || checkpoint != this->latest_snapshot_checkpoint
+        || offset > this->latest_snapshot->size())
+    {
+        return std::nullopt;
+    }
+
+    return bzn::snapshot_chunk_t{this->latest_snapshot->substr(offset, max_size), this->latest_snapshot->size()};
+}
+
+
+bool
+mem_storage::load_snapshot_chunk(uint64_t checkpoint, uint64_t offset, const std::string& data,
+    uint64_t total_size, bool delta, const bzn::hash_t& /*state_hash*/)
+{
+    if (delta)
+    {
+        LOG(error) << "snapshot deltas are not supported";
+
+        return false;
+    }
+
+    std::string snapshot;
+
+    {
+        std::lock_guard<std::shared_mutex> lock(this->kv_store_lock); // lock for write access
+
+        // a transfer of another checkpoint is given up once this one starts...
+        if (offset == 0)
+        {
+            this->transfer_snapshot.clear();
+            this->transfer_checkpoint = checkpoint;
+        }
+
+        if (checkpoint != this->transfer_checkpoint || offset != this->transfer_snapshot.size()
+            || offset + data.size() > total_size)
+        {
+            LOG(error) << "snapshot chunk at " << offset << " does not follow the " << this->transfer_snapshot.size()
+                << " bytes received";
+
+            return false;
+        }
+
+        this->transfer_snapshot.append(data);
+
+        if (this->transfer_snapshot.size() < total_size)
+        {
+            return true;
+        }
+
+        snapshot.swap(this->transfer_snapshot);
+    }
+
+    return this->load_snapshot(snapshot);
+}
+
+
+std::vector<bzn::hash_t>
+mem_storage::get_state_manifest()
+{
+    // always transfer the full snapshot...
+    return {};
+}
+
+
+std::optional<bzn::snapshot_chunk_t>
+mem_storage::get_snapshot_delta_chunk(uint64_t /*checkpoint*/, const std::vector<bzn::hash_t>& /*manifest*/,
+    uint64_t /*offset*/, size_t /*max_size*/)
+{
+    return std::nullopt;
+}
+
+
+bzn::hash_t
+mem_storage::get_state_hash()
+{
+    // state is not hashed...
+    return {};
+}
+
+
+void
+mem_storage::set_local_namespaces(const std::vector<bzn::uuid_t>& /*uuids*/)
+{
+}
+
+
 void
 mem_storage::remove_range(const bzn::uuid_t& uuid, const bzn::key_t& first, const bzn::key_t& last)
 {
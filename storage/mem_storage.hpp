@@ -28,6 +28,8 @@ namespace bzn
 
         bzn::storage_result create(const bzn::uuid_t& uuid, const bzn::key_t& key, const bzn::value_t& value) override;
 
+        bzn::storage_result create_batch(const std::vector<bzn::storage_record_t>& records) override;
+
         std::optional<bzn::value_t> read(const bzn::uuid_t& uuid, const bzn::key_t& key) override;
 
         bzn::storage_result update(const bzn::uuid_t& uuid, const bzn::key_t& key, const bzn::value_t& value) override;
@@ -44,11 +46,26 @@ namespace bzn
 
         bzn::storage_result remove(const bzn::uuid_t& uuid) override;
 
-        bool create_snapshot() override;
+        bool create_snapshot(uint64_t checkpoint = 0) override;
 
         std::shared_ptr<std::string> get_snapshot() override;
 
-        bool load_snapshot(const std::string& data) override;
+        bool load_snapshot(const std::string& data, const bzn::hash_t& state_hash = {}) override;
+
+        std::optional<bzn::snapshot_chunk_t> get_snapshot_chunk(uint64_t checkpoint, uint64_t offset, size_t max_size)
+            override;
+
+        bool load_snapshot_chunk(uint64_t checkpoint, uint64_t offset, const std::string& data, uint64_t total_size,
+            bool delta, const bzn::hash_t& state_hash = {}) override;
+
+        std::vector<bzn::hash_t> get_state_manifest() override;
+
+        std::optional<bzn::snapshot_chunk_t> get_snapshot_delta_chunk(uint64_t checkpoint,
+            const std::vector<bzn::hash_t>& manifest, uint64_t offset, size_t max_size) override;
+
+        bzn::hash_t get_state_hash() override;
+
+        void set_local_namespaces(const std::vector<bzn::uuid_t>& uuids) override;
 
         void remove_range(const bzn::uuid_t& uuid, const bzn::key_t& first, const bzn::key_t& last) override;
 
@@ -66,6 +83,9 @@ namespace bzn
         std::shared_mutex kv_store_lock; // for multi-reader and single writer access
 
         std::shared_ptr<std::string> latest_snapshot;
+        uint64_t latest_snapshot_checkpoint = 0;
+        std::string transfer_snapshot;
+        uint64_t transfer_checkpoint = 0;
 
         void do_if(const bzn::uuid_t& uuid, const bzn::key_t& first, const bzn::key_t& last,
             std::optional<std::function<bool(const bzn::key_t&, const bzn::value_t&)>> predicate,
@@ -15,6 +15,16 @@
 #include <storage/rocksdb_storage.hpp>
 #include <boost/filesystem.hpp>
 #include <rocksdb/db_dump_tool.h>
+#include <rocksdb/experimental.h>
+#include <rocksdb/filter_policy.h>
+#include <rocksdb/table.h>
+#include <rocksdb/utilities/checkpoint.h>
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <set>
 #include <thread>
 
 using namespace bzn;
@@ -24,524 +34,2780 @@ namespace
     const bzn::key_t METADATA_UUID{"METADATA"};
     const bzn::key_t NAMESPACE_KEY{"NAMESPACE"};
     const bzn::key_t SIZE_KEY{"SIZE"};
+    const bzn::key_t COUNT_KEY{"COUNT"};
+    const int BLOOM_FILTER_BITS_PER_KEY{10};
 
-    inline bzn::key_t generate_key(const bzn::uuid_t& uuid, const bzn::key_t& key)
+    // a leading 0xff can never start a length prefixed key...
+    const bzn::key_t KEY_ENCODING_KEY{"\xff" "KEY_ENCODING"};
+    const bzn::value_t KEY_ENCODING_LENGTH_PREFIXED{"1"};
+
+    inline bzn::key_t encode_namespace(const bzn::uuid_t& uuid)
+    {
+        // fixed width big endian length so that no namespace can be a prefix of another...
+        const auto size = static_cast<uint32_t>(uuid.size());
+
+        return bzn::key_t{char(size >> 24), char(size >> 16), char(size >> 8), char(size)} + uuid;
+    }
+
+    // records are split into ranges by a hash of their key for comparing states...
+    const size_t STATE_RANGE_COUNT{256};
+    const size_t STATE_DIGEST_SIZE{2048};
+
+    // lagging replicas each have their own manifest, and each resumes its transfer with it...
+    const size_t MAX_SNAPSHOT_DELTAS{4};
+
+    // the latest exports are kept for the checkpoints replicas are likely to ask for, older ones only while a transfer
+    // of them is still going on...
+    const size_t MAX_SNAPSHOT_EXPORTS{2};
+    const std::chrono::seconds SNAPSHOT_TRANSFER_TIMEOUT{std::chrono::seconds(120)};
+
+    inline size_t state_range(const rocksdb::Slice& key)
+    {
+        // fnv-1a is stable across platforms and releases, unlike std::hash...
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < key.size(); ++i)
+        {
+            hash = (hash ^ static_cast<unsigned char>(key[i])) * 16777619u;
+        }
+
+        return hash % STATE_RANGE_COUNT;
+    }
+
+    // the digest of each range is kept under a reserved key and updated along with every write...
+    const bzn::key_t STATE_DIGEST_KEY{"\xff" "STATE_DIGEST"};
+    const bzn::key_t LOCAL_NAMESPACES_KEY{"\xff" "LOCAL_NAMESPACES"};
+
+    inline bzn::key_t state_digest_key(size_t range)
+    {
+        return STATE_DIGEST_KEY + char(range);
+    }
+
+    // a range removal is recorded until the records it removed have been accounted for, along with the kind of
+    // removal and its namespace...
+    const bzn::key_t RANGE_ACCOUNTING_KEY{"\xff" "RANGE_ACCOUNTING"};
+    const char RANGE_REMOVED{'r'};
+    const char NAMESPACE_REMOVED{'n'};
+
+    inline bzn::key_t range_accounting_key(uint64_t sequence)
+    {
+        bzn::key_t key(RANGE_ACCOUNTING_KEY);
+        for (int shift = 56; shift >= 0; shift -= 8)
+        {
+            key += char(sequence >> shift);
+        }
+
+        return key;
+    }
+
+    // key counts of namespaces written before counts were kept, computed once by this node...
+    const bzn::key_t KEY_COUNT_CACHE_KEY{"\xff" "KEY_COUNT"};
+
+    inline bzn::key_t key_count_cache_key(const bzn::uuid_t& uuid)
+    {
+        return KEY_COUNT_CACHE_KEY + encode_namespace(uuid);
+    }
+
+    inline bool reserved_key(const rocksdb::Slice& key)
+    {
+        return key.size() > 0 && static_cast<unsigned char>(key[0]) == 0xff;
+    }
+
+    std::optional<bzn::uuid_t> decode_namespace(const char* data, size_t size)
+    {
+        if (size < 4)
+        {
+            return std::nullopt;
+        }
+
+        const uint32_t uuid_size = (uint32_t(uint8_t(data[0])) << 24) | (uint32_t(uint8_t(data[1])) << 16)
+            | (uint32_t(uint8_t(data[2])) << 8) | uint32_t(uint8_t(data[3]));
+
+        if (size - 4 < uuid_size)
+        {
+            return std::nullopt;
+        }
+
+        return bzn::uuid_t(data + 4, uuid_size);
+    }
+
+    std::optional<bzn::uuid_t> key_namespace(const rocksdb::Slice& key)
+    {
+        auto uuid = decode_namespace(key.data(), key.size());
+
+        // metadata belongs to the namespace it describes...
+        if (uuid && uuid->compare(0, METADATA_UUID.size(), METADATA_UUID) == 0)
+        {
+            if (auto described = decode_namespace(uuid->data() + METADATA_UUID.size(), uuid->size() - METADATA_UUID.size()))
+            {
+                return described;
+            }
+        }
+
+        return uuid;
+    }
+
+    bzn::value_t encode_namespaces(const std::vector<bzn::uuid_t>& uuids)
+    {
+        bzn::value_t value;
+        for (const auto& uuid : uuids)
+        {
+            value += encode_namespace(uuid);
+        }
+
+        return value;
+    }
+
+    std::vector<bzn::uuid_t> decode_namespaces(const bzn::value_t& value)
+    {
+        std::vector<bzn::uuid_t> uuids;
+        for (size_t pos = 0; auto uuid = decode_namespace(value.data() + pos, value.size() - pos);)
+        {
+            pos += 4 + uuid->size();
+            uuids.emplace_back(std::move(*uuid));
+        }
+
+        return uuids;
+    }
+
+    // records of node local namespaces differ between replicas and are left out of the state...
+    bool hashed_record(const rocksdb::Slice& key, const std::vector<bzn::uuid_t>& local_namespaces)
+    {
+        if (reserved_key(key))
+        {
+            return false;
+        }
+
+        if (local_namespaces.empty())
+        {
+            return true;
+        }
+
+        const auto uuid = key_namespace(key);
+
+        return !uuid || !std::binary_search(local_namespaces.begin(), local_namespaces.end(), *uuid);
+    }
+
+    class record_hasher
+    {
+    public:
+        record_hasher()
+            : context(EVP_MD_CTX_new(), &EVP_MD_CTX_free)
+        {
+        }
+
+        bzn::hash_t operator()(const rocksdb::Slice& key, const rocksdb::Slice& value)
+        {
+            const uint32_t key_size = static_cast<uint32_t>(key.size());
+            const unsigned char key_size_bytes[] = {
+                uint8_t(key_size >> 24), uint8_t(key_size >> 16), uint8_t(key_size >> 8), uint8_t(key_size)};
+            bzn::hash_t digest(STATE_DIGEST_SIZE, '\0');
+
+            const bool success =
+                (bool) this->context
+                && (1 == EVP_DigestInit_ex(this->context.get(), EVP_shake256(), NULL))
+                && (1 == EVP_DigestUpdate(this->context.get(), key_size_bytes, sizeof(key_size_bytes)))
+                && (1 == EVP_DigestUpdate(this->context.get(), key.data(), key.size()))
+                && (1 == EVP_DigestUpdate(this->context.get(), value.data(), value.size()))
+                && (1 == EVP_DigestFinalXOF(this->context.get(), reinterpret_cast<unsigned char*>(digest.data()), digest.size()));
+
+            if (!success)
+            {
+                throw std::runtime_error("failed to compute record digest");
+            }
+
+            return digest;
+        }
+
+    private:
+        std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> context;
+    };
+
+    // a range digest is the lane wise sum of its records' digests, so records can come and go in any order. A plain
+    // sum of sha256 values is open to generalized birthday attacks; 1024 lanes of 16 bits (lthash16) are not...
+    inline uint16_t digest_lane(const bzn::hash_t& digest, size_t lane)
+    {
+        return uint16_t(uint8_t(digest[2 * lane])) | uint16_t(uint8_t(digest[2 * lane + 1])) << 8;
+    }
+
+    inline void set_digest_lane(bzn::hash_t& digest, size_t lane, uint16_t value)
+    {
+        digest[2 * lane] = char(value & 0xff);
+        digest[2 * lane + 1] = char(value >> 8);
+    }
+
+    void add_digest(bzn::hash_t& sum, const bzn::hash_t& digest)
+    {
+        for (size_t lane = 0; lane < STATE_DIGEST_SIZE / 2; ++lane)
+        {
+            set_digest_lane(sum, lane, uint16_t(digest_lane(sum, lane) + digest_lane(digest, lane)));
+        }
+    }
+
+    void subtract_digest(bzn::hash_t& sum, const bzn::hash_t& digest)
+    {
+        for (size_t lane = 0; lane < STATE_DIGEST_SIZE / 2; ++lane)
+        {
+            set_digest_lane(sum, lane, uint16_t(digest_lane(sum, lane) - digest_lane(digest, lane)));
+        }
+    }
+
+    // ...and is compressed to a sha256 leaf for the manifest and the hash tree over it
+    std::vector<bzn::hash_t> state_manifest(const std::vector<bzn::hash_t>& digests)
+    {
+        std::vector<bzn::hash_t> manifest;
+        manifest.reserve(digests.size());
+
+        unsigned char md[SHA256_DIGEST_LENGTH];
+        for (const auto& digest : digests)
+        {
+            if (1 != EVP_Digest(digest.data(), digest.size(), md, nullptr, EVP_sha256(), nullptr))
+            {
+                throw std::runtime_error("failed to compute state manifest");
+            }
+
+            manifest.emplace_back(reinterpret_cast<const char*>(md), sizeof(md));
+        }
+
+        return manifest;
+    }
+
+    std::vector<bzn::hash_t> compute_state_digests(rocksdb::DB& db, const std::vector<bzn::uuid_t>& local_namespaces)
+    {
+        std::vector<bzn::hash_t> digests(STATE_RANGE_COUNT, bzn::hash_t(STATE_DIGEST_SIZE, '\0'));
+        record_hasher hasher;
+
+        std::unique_ptr<rocksdb::Iterator> iter(db.NewIterator(rocksdb::ReadOptions()));
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next())
+        {
+            if (hashed_record(iter->key(), local_namespaces))
+            {
+                add_digest(digests[state_range(iter->key())], hasher(iter->key(), iter->value()));
+            }
+        }
+
+        return digests;
+    }
+
+    bzn::hash_t merkle_root(std::vector<bzn::hash_t> level)
+    {
+        // the range digests are the leaves of a binary hash tree...
+        unsigned char md[SHA256_DIGEST_LENGTH];
+
+        while (level.size() > 1)
+        {
+            std::vector<bzn::hash_t> parents;
+            for (size_t i = 0; i + 1 < level.size(); i += 2)
+            {
+                const bzn::hash_t children = level[i] + level[i + 1];
+
+                if (1 != EVP_Digest(children.data(), children.size(), md, nullptr, EVP_sha256(), nullptr))
+                {
+                    throw std::runtime_error("failed to compute state hash");
+                }
+
+                parents.emplace_back(reinterpret_cast<const char*>(md), sizeof(md));
+            }
+
+            level = std::move(parents);
+        }
+
+        return level.front();
+    }
+
+    // the point and range writes of a batch, in the order they are applied...
+    class batch_operations : public rocksdb::WriteBatch::Handler
+    {
+    public:
+        struct operation
+        {
+            bzn::key_t key;
+            std::optional<bzn::value_t> value;
+            std::optional<bzn::key_t> range_end;
+        };
+
+        rocksdb::Status PutCF(uint32_t /*column_family_id*/, const rocksdb::Slice& key, const rocksdb::Slice& value) override
+        {
+            this->operations.push_back({key.ToString(), value.ToString(), std::nullopt});
+            return rocksdb::Status::OK();
+        }
+
+        rocksdb::Status DeleteCF(uint32_t /*column_family_id*/, const rocksdb::Slice& key) override
+        {
+            this->operations.push_back({key.ToString(), std::nullopt, std::nullopt});
+            return rocksdb::Status::OK();
+        }
+
+        rocksdb::Status SingleDeleteCF(uint32_t column_family_id, const rocksdb::Slice& key) override
+        {
+            return this->DeleteCF(column_family_id, key);
+        }
+
+        rocksdb::Status DeleteRangeCF(uint32_t /*column_family_id*/, const rocksdb::Slice& begin, const rocksdb::Slice& end) override
+        {
+            this->operations.push_back({begin.ToString(), std::nullopt, end.ToString()});
+            return rocksdb::Status::OK();
+        }
+
+        rocksdb::Status MergeCF(uint32_t /*column_family_id*/, const rocksdb::Slice& /*key*/, const rocksdb::Slice& /*value*/) override
+        {
+            return rocksdb::Status::NotSupported("merge operands cannot be digested");
+        }
+
+        std::vector<operation> operations;
+    };
+
+    inline void write_u32(std::ostream& out, uint32_t value)
+    {
+        const char bytes[] = {char(value >> 24), char(value >> 16), char(value >> 8), char(value)};
+        out.write(bytes, sizeof(bytes));
+    }
+
+    inline bool read_u32(std::istream& in, uint32_t& value)
+    {
+        unsigned char bytes[4];
+        if (!in.read(reinterpret_cast<char*>(bytes), sizeof(bytes)))
+        {
+            return false;
+        }
+
+        value = (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) | (uint32_t(bytes[2]) << 8) | uint32_t(bytes[3]);
+        return true;
+    }
+
+    std::optional<bzn::snapshot_chunk_t> read_file_chunk(const std::string& path, uint64_t offset, size_t max_size)
+    {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+
+        if (!file)
+        {
+            LOG(error) << "failed to open: " << path;
+
+            return std::nullopt;
+        }
+
+        bzn::snapshot_chunk_t chunk;
+        chunk.total_size = static_cast<uint64_t>(file.tellg());
+
+        if (offset > chunk.total_size)
+        {
+            LOG(error) << "offset " << offset << " is beyond the " << chunk.total_size << " bytes of: " << path;
+
+            return std::nullopt;
+        }
+
+        chunk.data.resize(std::min<uint64_t>(max_size, chunk.total_size - offset));
+
+        if (!file.seekg(offset) || !file.read(chunk.data.data(), chunk.data.size()))
+        {
+            LOG(error) << "failed to read " << path << " at offset " << offset;
+
+            return std::nullopt;
+        }
+
+        return chunk;
+    }
+
+    inline bzn::key_t prefix_successor(bzn::key_t prefix)
+    {
+        // smallest key that sorts after every key starting with prefix...
+        while (!prefix.empty() && static_cast<unsigned char>(prefix.back()) == 0xff)
+        {
+            prefix.pop_back();
+        }
+
+        if (!prefix.empty())
+        {
+            ++prefix.back();
+        }
+
+        return prefix;
+    }
+}
+
+
+rocksdb_storage::rocksdb_storage(const std::string& state_dir, const std::string& db_name, const bzn::uuid_t& uuid,
+    std::chrono::microseconds group_commit_window, size_t group_commit_max_batch, std::shared_ptr<bzn::monitor_base> monitor,
+    bool hash_state)
+    : hash_state(hash_state)
+    , group_commit_window(group_commit_window)
+    , group_commit_max_batch(std::max<size_t>(group_commit_max_batch, 1))
+    , monitor(std::move(monitor))
+    , db_path(boost::filesystem::path(state_dir).append(uuid).append(db_name).string())
+    , snapshot_file(boost::filesystem::path(state_dir).append(uuid).append("SNAPSHOT." + db_name).string())
+{
+    this->remove_stale_checkpoints();
+    this->open();
+}
+
+
+rocksdb_storage::~rocksdb_storage()
+{
+    this->wait_for_snapshot_export();
+
+    if (this->snapshot_exporter.joinable())
+    {
+        this->snapshot_exporter.join();
+    }
+}
+
+
+void
+rocksdb_storage::open()
+{
+    rocksdb::Options options;
+
+    options.IncreaseParallelism(std::thread::hardware_concurrency());
+    options.OptimizeLevelStyleCompaction();
+    options.create_if_missing = true;
+
+    // bloom filters let point lookups for absent keys skip the sst files entirely...
+    rocksdb::BlockBasedTableOptions table_options;
+    table_options.filter_policy.reset(rocksdb::NewBloomFilterPolicy(BLOOM_FILTER_BITS_PER_KEY, false));
+    options.table_factory.reset(rocksdb::NewBlockBasedTableFactory(table_options));
+
+    rocksdb::DB* rocksdb;
+
+    boost::filesystem::create_directories(db_path);
+
+    LOG(info) << "database path: " << db_path;
+
+    rocksdb::Status s = rocksdb::DB::Open(options, db_path, &rocksdb);
+
+    if (!s.ok())
+    {
+        throw std::runtime_error("Could not open database: " + s.ToString());
+    }
+
+    this->db.reset(rocksdb);
+
+    ++this->open_generation;
+
+    this->select_key_encoding();
+    this->load_state_digests();
+    this->settle_range_accounting();
+}
+
+
+void
+rocksdb_storage::select_key_encoding()
+{
+    bzn::value_t encoding;
+
+    if (this->db->Get(rocksdb::ReadOptions(), KEY_ENCODING_KEY, &encoding).ok())
+    {
+        this->legacy_key_encoding = false;
+        return;
+    }
+
+    std::unique_ptr<rocksdb::Iterator> iter(this->db->NewIterator(rocksdb::ReadOptions()));
+    iter->SeekToFirst();
+
+    if (iter->Valid())
+    {
+        iter.reset();
+
+        // existing data was written as plain uuid+key; it is migrated if every key can be attributed to one namespace...
+        this->legacy_key_encoding = !this->migrate_legacy_keys();
+
+        if (this->legacy_key_encoding)
+        {
+            LOG(warning) << "database uses the legacy key encoding and its state cannot be hashed: " << this->db_path;
+        }
+
+        return;
+    }
+
+    rocksdb::WriteOptions write_options;
+    write_options.sync = true;
+
+    if (!this->db->Put(write_options, KEY_ENCODING_KEY, KEY_ENCODING_LENGTH_PREFIXED).ok())
+    {
+        throw std::runtime_error("Could not initialize database key encoding: " + this->db_path);
+    }
+
+    this->legacy_key_encoding = false;
+}
+
+
+bool
+rocksdb_storage::migrate_legacy_keys()
+{
+    // namespaces are known from their size and count metadata, written along with their first record...
+    const std::vector<bzn::key_t> namespace_suffixes{NAMESPACE_KEY + SIZE_KEY, NAMESPACE_KEY + COUNT_KEY};
+
+    std::set<bzn::uuid_t> namespaces;
+    std::set<size_t> namespace_sizes;
+
+    std::unique_ptr<rocksdb::Iterator> iter(this->db->NewIterator(rocksdb::ReadOptions()));
+    for (iter->Seek(METADATA_UUID); iter->Valid() && iter->key().starts_with(METADATA_UUID); iter->Next())
+    {
+        const auto key = iter->key().ToString();
+        for (const auto& suffix : namespace_suffixes)
+        {
+            if (key.size() >= METADATA_UUID.size() + suffix.size() && key.compare(key.size() - suffix.size(), suffix.size(), suffix) == 0)
+            {
+                auto uuid = key.substr(METADATA_UUID.size(), key.size() - METADATA_UUID.size() - suffix.size());
+                namespace_sizes.insert(uuid.size());
+                namespaces.insert(std::move(uuid));
+            }
+        }
+    }
+
+    // every way a raw key can be read as a record or metadata of a known namespace, in the new encoding...
+    const auto encodings = [&](const bzn::key_t& key)
+    {
+        std::vector<bzn::key_t> result;
+        for (const auto size : namespace_sizes)
+        {
+            if (key.size() >= size && namespaces.count(key.substr(0, size)))
+            {
+                result.emplace_back(encode_namespace(key.substr(0, size)) + key.substr(size));
+            }
+
+            if (key.compare(0, METADATA_UUID.size(), METADATA_UUID) != 0 || key.size() < METADATA_UUID.size() + size
+                || !namespaces.count(key.substr(METADATA_UUID.size(), size)))
+            {
+                continue;
+            }
+
+            const auto uuid = key.substr(METADATA_UUID.size(), size);
+            const auto rest = key.substr(METADATA_UUID.size() + size);
+            for (const auto& metadata_key : {NAMESPACE_KEY, SIZE_KEY})
+            {
+                if (rest.compare(0, metadata_key.size(), metadata_key) == 0)
+                {
+                    result.emplace_back(encode_namespace(METADATA_UUID + encode_namespace(uuid) + metadata_key)
+                        + rest.substr(metadata_key.size()));
+                }
+            }
+        }
+
+        return result;
+    };
+
+    // done in one synced batch, so a crash leaves the database as it was...
+    rocksdb::WriteBatch batch;
+    size_t migrated = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next())
+    {
+        if (reserved_key(iter->key()))
+        {
+            continue;
+        }
+
+        const auto key = iter->key().ToString();
+        const auto new_keys = encodings(key);
+        if (new_keys.size() != 1)
+        {
+            LOG(error) << "cannot migrate the legacy key encoding, " << new_keys.size() << " namespaces could hold: "
+                << key.substr(0, MAX_MESSAGE_SIZE);
+
+            return false;
+        }
+
+        batch.Delete(key);
+        batch.Put(new_keys.front(), iter->value());
+        ++migrated;
+    }
+
+    batch.Put(KEY_ENCODING_KEY, KEY_ENCODING_LENGTH_PREFIXED);
+
+    rocksdb::WriteOptions write_options;
+    write_options.sync = true;
+
+    if (auto s = this->db->Write(write_options, &batch); !s.ok())
+    {
+        LOG(error) << "failed to migrate the legacy key encoding: " << s.ToString();
+
+        return false;
+    }
+
+    LOG(info) << "migrated " << migrated << " records of " << namespaces.size() << " namespaces to the new key encoding: "
+        << this->db_path;
+
+    return true;
+}
+
+
+void
+rocksdb_storage::load_state_digests()
+{
+    this->state_digests.clear();
+
+    // raw legacy keys cannot be attributed to a namespace...
+    if (!this->hash_state || this->legacy_key_encoding)
+    {
+        this->drop_state_digests();
+        return;
+    }
+
+    bzn::value_t value;
+    const auto stored_local_namespaces = this->db->Get(rocksdb::ReadOptions(), LOCAL_NAMESPACES_KEY, &value).ok()
+        ? decode_namespaces(value) : std::vector<bzn::uuid_t>{};
+
+    if (!this->local_namespaces_configured)
+    {
+        this->local_namespaces = stored_local_namespaces;
+    }
+
+    std::vector<bzn::hash_t> digests(STATE_RANGE_COUNT);
+    for (size_t range = 0; range < STATE_RANGE_COUNT; ++range)
+    {
+        if (!this->db->Get(rocksdb::ReadOptions(), state_digest_key(range), &digests[range]).ok()
+            || digests[range].size() != STATE_DIGEST_SIZE)
+        {
+            this->rebuild_state_digests();
+            return;
+        }
+    }
+
+    if (stored_local_namespaces != this->local_namespaces)
+    {
+        this->rebuild_state_digests();
+        return;
+    }
+
+    this->state_digests = std::move(digests);
+}
+
+
+void
+rocksdb_storage::rebuild_state_digests()
+{
+    LOG(info) << "computing state digests: " << this->db_path;
+
+    auto digests = compute_state_digests(*this->db, this->local_namespaces);
+
+    rocksdb::WriteBatch batch;
+    for (size_t range = 0; range < STATE_RANGE_COUNT; ++range)
+    {
+        batch.Put(state_digest_key(range), digests[range]);
+    }
+    batch.Put(LOCAL_NAMESPACES_KEY, encode_namespaces(this->local_namespaces));
+
+    rocksdb::WriteOptions write_options;
+    write_options.sync = true;
+
+    if (auto s = this->db->Write(write_options, &batch); !s.ok())
+    {
+        throw std::runtime_error("Could not store state digests: " + s.ToString());
+    }
+
+    this->state_digests = std::move(digests);
+    ++this->digest_generation;
+}
+
+
+void
+rocksdb_storage::drop_state_digests()
+{
+    // digests kept while the state was hashed would be stale by the time it is hashed again...
+    bzn::value_t digest;
+    if (!this->db->Get(rocksdb::ReadOptions(), state_digest_key(0), &digest).ok())
+    {
+        return;
+    }
+
+    rocksdb::WriteBatch batch;
+    batch.DeleteRange(STATE_DIGEST_KEY, prefix_successor(STATE_DIGEST_KEY));
+    batch.Delete(LOCAL_NAMESPACES_KEY);
+
+    rocksdb::WriteOptions write_options;
+    write_options.sync = true;
+
+    if (auto s = this->db->Write(write_options, &batch); !s.ok())
+    {
+        throw std::runtime_error("Could not remove state digests: " + s.ToString());
+    }
+}
+
+
+void
+rocksdb_storage::set_local_namespaces(const std::vector<bzn::uuid_t>& uuids)
+{
+    std::lock_guard<std::shared_mutex> lock(this->lock); // lock for write access
+
+    auto local_namespaces = uuids;
+    std::sort(local_namespaces.begin(), local_namespaces.end());
+    local_namespaces.erase(std::unique(local_namespaces.begin(), local_namespaces.end()), local_namespaces.end());
+
+    this->local_namespaces_configured = true;
+
+    if (local_namespaces == this->local_namespaces)
+    {
+        return;
+    }
+
+    this->local_namespaces = std::move(local_namespaces);
+
+    if (this->hash_state && !this->legacy_key_encoding)
+    {
+        this->rebuild_state_digests();
+    }
+}
+
+
+bzn::hash_t
+rocksdb_storage::get_state_hash()
+{
+    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+    this->wait_for_durable_writes();
+
+    if (this->state_digests.empty())
+    {
+        return {};
+    }
+
+    return merkle_root(state_manifest(this->state_digests));
+}
+
+
+rocksdb::Status
+rocksdb_storage::write_batch(rocksdb::WriteBatch& batch, const rocksdb::WriteOptions& write_options,
+    const std::map<size_t, bzn::hash_t>& removed_digests)
+{
+    if (this->state_digests.empty())
+    {
+        return this->db->Write(write_options, &batch);
+    }
+
+    batch_operations batch_ops;
+    if (auto s = batch.Iterate(&batch_ops); !s.ok())
+    {
+        return s;
+    }
+
+    // hashed records as the batch leaves them, read from the db the first time each is touched...
+    std::map<bzn::key_t, std::optional<bzn::value_t>> records;
+    std::set<size_t> changed_ranges;
+    auto digests = this->state_digests;
+    record_hasher hasher;
+
+    // records under range tombstones are digested by the caller from a snapshot, see count_removed()...
+    for (const auto& [range, digest] : removed_digests)
+    {
+        subtract_digest(digests[range], digest);
+        changed_ranges.insert(range);
+    }
+
+    const auto replace = [&](const bzn::key_t& key, std::optional<bzn::value_t> value)
+    {
+        if (!hashed_record(key, this->local_namespaces))
+        {
+            return;
+        }
+
+        auto [record, inserted] = records.try_emplace(key);
+        if (inserted)
+        {
+            bzn::value_t previous;
+            if (this->db->Get(rocksdb::ReadOptions(), key, &previous).ok())
+            {
+                record->second = std::move(previous);
+            }
+        }
+
+        const auto range = state_range(key);
+
+        if (record->second)
+        {
+            subtract_digest(digests[range], hasher(key, *record->second));
+        }
+
+        if (value)
+        {
+            add_digest(digests[range], hasher(key, *value));
+        }
+
+        record->second = std::move(value);
+        changed_ranges.insert(range);
+    };
+
+    for (auto& op : batch_ops.operations)
+    {
+        // ...as is everything a range tombstone covers
+        if (!op.range_end)
+        {
+            replace(op.key, std::move(op.value));
+        }
+    }
+
+    for (const auto range : changed_ranges)
+    {
+        batch.Put(state_digest_key(range), digests[range]);
+    }
+
+    auto s = this->db->Write(write_options, &batch);
+
+    if (s.ok())
+    {
+        this->state_digests = std::move(digests);
+    }
+
+    return s;
+}
+
+
+bzn::key_t
+rocksdb_storage::generate_key(const bzn::uuid_t& uuid, const bzn::key_t& key) const
+{
+    return (this->legacy_key_encoding ? uuid : encode_namespace(uuid)) + key;
+}
+
+
+bzn::key_t
+rocksdb_storage::metadata_namespace(const bzn::uuid_t& uuid, const bzn::key_t& metadata_key) const
+{
+    return METADATA_UUID + (this->legacy_key_encoding ? uuid : encode_namespace(uuid)) + metadata_key;
+}
+
+
+bzn::storage_result
+rocksdb_storage::create(const bzn::uuid_t& uuid, const bzn::key_t& key, const bzn::value_t& value)
+{
+    if (value.size() > bzn::MAX_VALUE_SIZE)
+    {
+        return bzn::storage_result::value_too_large;
+    }
+
+    if (key.size() > bzn::MAX_KEY_SIZE)
+    {
+        return bzn::storage_result::key_too_large;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(this->lock); // lock for write access
+
+    if (!this->has_priv(uuid, key))
+    {
+        const uint32_t ns_prev_size = this->get_metadata_size(uuid, NAMESPACE_KEY, SIZE_KEY);
+        const uint64_t ns_prev_count = this->get_key_count(uuid);
+
+        rocksdb::WriteBatch batch;
+        batch.Put(this->generate_key(uuid, key), value);
+
+        // update metadata...
+        this->update_metadata_size(batch, uuid, NAMESPACE_KEY, SIZE_KEY, ns_prev_size + value.size() + key.size());
+        this->update_metadata_size(batch, uuid, SIZE_KEY, key, value.size() + key.size());
+        this->update_key_count(batch, uuid, ns_prev_count + 1);
+
+        auto s = this->commit(batch, lock);
+
+        if (!s.ok())
+        {
+            LOG(error) << "save failed: " << uuid << ":" << key << ":" <<
+                value.substr(0,MAX_MESSAGE_SIZE) << "... - " << s.ToString();
+
+            return bzn::storage_result::not_saved;
+        }
+
+#ifdef __APPLE__
+        this->db_flush();
+#endif
+
+        return bzn::storage_result::ok;
+    }
+
+    return bzn::storage_result::exists;
+}
+
+
+bzn::storage_result
+rocksdb_storage::create_batch(const std::vector<bzn::storage_record_t>& records)
+{
+    for (const auto& record : records)
+    {
+        if (record.value.size() > bzn::MAX_VALUE_SIZE)
+        {
+            return bzn::storage_result::value_too_large;
+        }
+
+        if (record.key.size() > bzn::MAX_KEY_SIZE)
+        {
+            return bzn::storage_result::key_too_large;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(this->lock); // lock for write access
+
+    // namespace sizes and key counts as they will be once the batch is written
+    std::map<bzn::uuid_t, std::pair<uint32_t, uint64_t>> namespace_totals;
+    std::set<std::pair<bzn::uuid_t, bzn::key_t>> batched;
+
+    rocksdb::WriteBatch batch;
+    for (const auto& record : records)
+    {
+        if (!batched.emplace(record.uuid, record.key).second || this->has_priv(record.uuid, record.key))
+        {
+            continue;
+        }
+
+        auto totals = namespace_totals.find(record.uuid);
+        if (totals == namespace_totals.end())
+        {
+            totals = namespace_totals.emplace(record.uuid, std::make_pair(
+                this->get_metadata_size(record.uuid, NAMESPACE_KEY, SIZE_KEY), this->get_key_count(record.uuid))).first;
+        }
+
+        batch.Put(this->generate_key(record.uuid, record.key), record.value);
+        this->update_metadata_size(batch, record.uuid, SIZE_KEY, record.key, record.value.size() + record.key.size());
+        totals->second.first += record.value.size() + record.key.size();
+        totals->second.second++;
+    }
+
+    if (namespace_totals.empty())
+    {
+        return bzn::storage_result::ok;
+    }
+
+    for (const auto& totals : namespace_totals)
+    {
+        this->update_metadata_size(batch, totals.first, NAMESPACE_KEY, SIZE_KEY, totals.second.first);
+        this->update_key_count(batch, totals.first, totals.second.second);
+    }
+
+    auto s = this->commit(batch, lock);
+
+    if (!s.ok())
+    {
+        LOG(error) << "save of " << records.size() << " records failed: " << s.ToString();
+
+        return bzn::storage_result::not_saved;
+    }
+
+#ifdef __APPLE__
+    this->db_flush();
+#endif
+
+    return bzn::storage_result::ok;
+}
+
+
+void
+rocksdb_storage::db_flush() const
+{
+    rocksdb::FlushOptions flush_options;
+    flush_options.wait = false;
+    db->Flush(flush_options);
+}
+
+
+std::optional<bzn::value_t>
+rocksdb_storage::read(const bzn::uuid_t& uuid, const bzn::key_t& key)
+{
+    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+    this->wait_for_durable_writes();
+
+    bzn::value_t value;
+    auto s = this->db->Get(rocksdb::ReadOptions(), this->generate_key(uuid, key), &value);
+
+    if (!s.ok())
+    {
+        return std::nullopt;
+    }
+
+    return value;
+}
+
+
+bzn::storage_result
+rocksdb_storage::update(const bzn::uuid_t& uuid, const bzn::key_t& key, const bzn::value_t& value)
+{
+    if (value.size() > bzn::MAX_VALUE_SIZE)
+    {
+        return bzn::storage_result::value_too_large;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(this->lock); // lock for write access
+
+    if (this->has_priv(uuid, key))
+    {
+        const uint32_t prev_size = this->get_metadata_size(uuid, SIZE_KEY, key);
+        const uint32_t ns_prev_size = this->get_metadata_size(uuid, NAMESPACE_KEY, SIZE_KEY);
+
+        rocksdb::WriteBatch batch;
+        batch.Put(this->generate_key(uuid, key), value);
+
+        // update metadata...
+        this->update_metadata_size(batch, uuid, NAMESPACE_KEY, SIZE_KEY, ns_prev_size - prev_size + value.size() + key.size());
+        this->update_metadata_size(batch, uuid, SIZE_KEY, key, value.size() + key.size());
+
+        auto s = this->commit(batch, lock);
+
+        if (!s.ok())
+        {
+            LOG(error) << "update failed: " << uuid << ":" << key << ":" <<
+                value.substr(0,MAX_MESSAGE_SIZE) << "... - " << s.ToString();
+
+            return bzn::storage_result::not_saved;
+        }
+
+#ifdef __APPLE__
+        this->db_flush();
+#endif
+
+        return bzn::storage_result::ok;
+    }
+
+    return bzn::storage_result::not_found;
+}
+
+
+bzn::storage_result
+rocksdb_storage::remove(const bzn::uuid_t& uuid, const bzn::key_t& key)
+{
+    std::unique_lock<std::shared_mutex> lock(this->lock); // lock for write access
+
+    if (this->has_priv(uuid, key))
+    {
+        const uint32_t prev_size = this->get_metadata_size(uuid, SIZE_KEY, key);
+        const uint32_t ns_prev_size = this->get_metadata_size(uuid, NAMESPACE_KEY, SIZE_KEY);
+        const uint64_t ns_prev_count = this->get_key_count(uuid);
+
+        rocksdb::WriteBatch batch;
+        batch.Delete(this->generate_key(uuid, key));
+
+        // update metadata...
+        this->update_metadata_size(batch, uuid, NAMESPACE_KEY, SIZE_KEY, ns_prev_size - prev_size);
+        this->delete_metadata_size(batch, uuid, SIZE_KEY, key);
+        this->update_key_count(batch, uuid, ns_prev_count - std::min<uint64_t>(ns_prev_count, 1));
+
+        auto s = this->commit(batch, lock);
+
+        if (!s.ok())
+        {
+            LOG(error) << "delete failed: " << uuid << ":" << key << " - " << s.ToString();
+
+            return bzn::storage_result::not_found;
+        }
+
+        return bzn::storage_result::ok;
+    }
+
+    return bzn::storage_result::not_found;
+}
+
+
+std::vector<bzn::key_t>
+rocksdb_storage::get_keys(const bzn::uuid_t& uuid)
+{
+    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+    this->wait_for_durable_writes();
+
+    std::unique_ptr<rocksdb::Iterator> iter(this->db->NewIterator(rocksdb::ReadOptions()));
+
+    const auto prefix = this->generate_key(uuid, "");
+
+    std::vector<bzn::key_t> v;
+    for (iter->Seek(prefix); iter->Valid() && iter->key().starts_with(prefix); iter->Next())
+    {
+        v.emplace_back(iter->key().ToString().substr(prefix.size()));
+    }
+
+    return v;
+}
+
+
+bool
+rocksdb_storage::has(const bzn::uuid_t& uuid, const bzn::key_t& key)
+{
+    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+    this->wait_for_durable_writes();
+
+    return this->has_priv(uuid, key);
+}
+
+
+std::pair<std::size_t, std::size_t>
+rocksdb_storage::get_size(const bzn::uuid_t& uuid)
+{
+    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+    this->wait_for_durable_writes();
+
+    return std::make_pair(this->get_key_count(uuid), this->get_metadata_size(uuid, NAMESPACE_KEY, SIZE_KEY));
+}
+
+
+std::optional<std::size_t>
+rocksdb_storage::get_key_size(const bzn::uuid_t& uuid, const bzn::key_t& key)
+{
+    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+    this->wait_for_durable_writes();
+
+    if (this->has_priv(uuid, key))
+    {
+        return this->get_metadata_size(uuid, SIZE_KEY, key);
+    }
+
+    return std::nullopt;
+}
+
+
+bzn::storage_result
+rocksdb_storage::remove(const bzn::uuid_t& uuid)
+{
+    std::unique_lock<std::shared_mutex> lock(this->lock); // lock for write access
+
+    const auto prefix = this->generate_key(uuid, "");
+
+    bool found;
+    {
+        std::unique_ptr<rocksdb::Iterator> iter(this->db->NewIterator(rocksdb::ReadOptions()));
+        iter->Seek(prefix);
+        found = iter->Valid() && iter->key().starts_with(prefix);
+    }
+
+    const std::vector<bzn::key_t> prefixes = this->legacy_key_encoding
+        ? std::vector<bzn::key_t>{prefix, METADATA_UUID + uuid}
+        : std::vector<bzn::key_t>{prefix, this->generate_key(this->metadata_namespace(uuid, NAMESPACE_KEY), ""),
+            this->generate_key(this->metadata_namespace(uuid, SIZE_KEY), "")};
+
+    // range tombstones keep the write small no matter how many keys the database holds...
+    std::vector<std::pair<bzn::key_t, bzn::key_t>> ranges;
+    rocksdb::WriteBatch batch;
+
+    for (const auto& range_prefix : prefixes)
+    {
+        ranges.emplace_back(range_prefix, prefix_successor(range_prefix));
+        batch.DeleteRange(ranges.back().first, ranges.back().second);
+    }
+
+    batch.Delete(key_count_cache_key(uuid));
+
+    // ...and the removed records leave the digests once they have been read back from a snapshot
+    const rocksdb::Snapshot* covered = nullptr;
+    bzn::key_t marker;
+    std::vector<bzn::uuid_t> local_namespaces;
+    const uint64_t generation = this->open_generation;
+    const uint64_t digest_generation = this->digest_generation;
+
+    if (!this->state_digests.empty())
+    {
+        covered = this->take_covered_snapshot();
+        marker = range_accounting_key(covered->GetSequenceNumber());
+        local_namespaces = this->local_namespaces;
+
+        batch.Put(marker, NAMESPACE_REMOVED + uuid);
+    }
+
+    auto s = this->commit(batch, lock);
+
+    if (lock.owns_lock())
+    {
+        lock.unlock();
+    }
+
+    if (covered)
+    {
+        std::map<size_t, bzn::hash_t> removed_digests;
+
+        if (s.ok())
+        {
+            for (const auto& range : ranges)
+            {
+                this->count_removed(covered, range.first, range.second, 0, local_namespaces, &removed_digests);
+            }
+        }
+
+        this->release_covered_snapshot(covered);
+
+        lock.lock();
+
+        if (s.ok() && generation == this->open_generation)
+        {
+            rocksdb::WriteBatch settle;
+            settle.Delete(marker);
+
+            // digests rebuilt meanwhile were taken without the removed records...
+            if (auto ss = this->commit(settle, lock, digest_generation == this->digest_generation
+                ? removed_digests : std::map<size_t, bzn::hash_t>{}); !ss.ok())
+            {
+                LOG(error) << "delete accounting failed: " << uuid << ":" << ss.ToString();
+            }
+        }
+
+        if (lock.owns_lock())
+        {
+            lock.unlock();
+        }
+    }
+
+    if (!s.ok())
+    {
+        LOG(error) << "delete failed: " << uuid << ":" <<  s.ToString();
+
+        return bzn::storage_result::not_found;
+    }
+
+    // compaction only needs the db to stay open...
+    std::shared_lock<std::shared_mutex> compact_lock(this->lock);
+
+    // have the background compaction threads reclaim the dead ranges...
+    for (const auto& range : ranges)
+    {
+        const rocksdb::Slice begin(range.first);
+        const rocksdb::Slice end(range.second);
+
+        if (auto cs = rocksdb::experimental::SuggestCompactRange(this->db.get(), &begin, &end); !cs.ok())
+        {
+            LOG(warning) << "failed to schedule compaction of removed database: " << uuid << ":" << cs.ToString();
+        }
+    }
+
+    return found ? bzn::storage_result::ok : bzn::storage_result::not_found;
+}
+
+bool
+rocksdb_storage::has_priv(const bzn::uuid_t& uuid, const bzn::key_t& key)
+{
+    const bzn::key_t has_key = this->generate_key(uuid, key);
+
+    // cheap negative check against the memtables and bloom filters...
+    std::string value;
+    if (!this->db->KeyMayExist(rocksdb::ReadOptions(), has_key, &value))
+    {
+        return false;
+    }
+
+    rocksdb::PinnableSlice pinned_value;
+
+    return this->db->Get(rocksdb::ReadOptions(), this->db->DefaultColumnFamily(), has_key, &pinned_value).ok();
+}
+
+
+bool
+rocksdb_storage::create_snapshot(uint64_t checkpoint)
+{
+    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+    this->wait_for_durable_writes();
+
+    std::lock_guard<std::mutex> snapshot_lock(this->snapshot_lock);
+
+    const std::string checkpoint_dir(this->snapshot_file + ".checkpoint." + std::to_string(++this->snapshot_generation));
+
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(checkpoint_dir, ec);
+
+    // hard links the live sst files and copies the wal instead of flushing, so the cost does not grow with the data...
+    rocksdb::Checkpoint* checkpoint_ptr;
+    if (auto s = rocksdb::Checkpoint::Create(this->db.get(), &checkpoint_ptr); !s.ok())
+    {
+        LOG(error) << "failed to create checkpoint: " << s.ToString();
+
+        return false;
+    }
+
+    std::unique_ptr<rocksdb::Checkpoint> db_checkpoint(checkpoint_ptr);
+
+    if (auto s = db_checkpoint->CreateCheckpoint(checkpoint_dir, std::numeric_limits<uint64_t>::max()); !s.ok())
+    {
+        LOG(error) << "failed to create checkpoint: " << s.ToString();
+
+        return false;
+    }
+
+    // a newer checkpoint supersedes one that has not been exported yet...
+    if (!this->pending_checkpoint.empty())
+    {
+        boost::filesystem::remove_all(this->pending_checkpoint, ec);
+    }
+
+    this->pending_checkpoint = checkpoint_dir;
+    this->pending_checkpoint_sequence = checkpoint;
+
+    this->start_snapshot_exporter();
+
+    return true;
+}
+
+
+void
+rocksdb_storage::start_snapshot_exporter()
+{
+    // caller holds snapshot_lock...
+    if (!this->snapshot_exporting)
+    {
+        if (this->snapshot_exporter.joinable())
+        {
+            this->snapshot_exporter.join();
+        }
+
+        this->snapshot_exporting = true;
+        this->snapshot_exporter = std::thread(&rocksdb_storage::export_snapshots, this);
+    }
+}
+
+
+void
+rocksdb_storage::export_snapshots()
+{
+    std::unique_lock<std::mutex> lock(this->snapshot_lock);
+
+    while (!this->pending_checkpoint.empty() || this->snapshot_deltas_requested)
+    {
+        // deltas are built one at a time, so that a checkpoint waiting to be exported goes first...
+        if (this->pending_checkpoint.empty())
+        {
+            this->snapshot_deltas_requested = false;
+
+            lock.unlock();
+
+            const bool built = this->build_next_snapshot_delta();
+
+            lock.lock();
+
+            this->snapshot_deltas_requested |= built;
+
+            continue;
+        }
+
+        const std::string checkpoint_dir = this->pending_checkpoint;
+        this->pending_checkpoint.clear();
+        this->exporting_checkpoint_sequence = this->pending_checkpoint_sequence;
+        this->pending_checkpoint_sequence.reset();
+
+        lock.unlock();
+
+        const std::string tmp_snapshot(this->snapshot_file + ".export");
+
+        rocksdb::DumpOptions dump_options;
+
+        dump_options.db_path = checkpoint_dir;
+        dump_options.dump_location = tmp_snapshot;
+        dump_options.anonymous = true;
+
+        boost::system::error_code ec;
+
+        const bool exported = rocksdb::DbDumpTool().Run(dump_options);
+
+        if (!exported)
+        {
+            LOG(error) << "failed to export checkpoint: " << checkpoint_dir;
+        }
+
+        // publish the export along with the checkpoint kept to build deltas from...
+        std::lock_guard<std::mutex> delta_lock(this->snapshot_delta_lock);
+
+        lock.lock();
+
+        // a checkpoint saved again keeps the export it has, which transfers may be reading...
+        if (exported && this->snapshot_exports.count(*this->exporting_checkpoint_sequence))
+        {
+            boost::filesystem::remove(tmp_snapshot, ec);
+        }
+        else if (exported)
+        {
+            const uint64_t checkpoint = *this->exporting_checkpoint_sequence;
+
+            snapshot_export snapshot;
+            snapshot.file = this->snapshot_export_file(checkpoint);
+            snapshot.checkpoint_dir = snapshot.file + ".checkpoint";
+
+            boost::filesystem::rename(tmp_snapshot, snapshot.file, ec);
+
+            if (ec)
+            {
+                LOG(error) << "failed to publish snapshot: " << ec.message();
+            }
+            else
+            {
+                boost::filesystem::rename(checkpoint_dir, snapshot.checkpoint_dir, ec);
+
+                if (ec)
+                {
+                    // the export can still be served in full...
+                    snapshot.checkpoint_dir.clear();
+                }
+
+                this->snapshot_exports.emplace(checkpoint, std::move(snapshot));
+                this->prune_snapshot_exports();
+            }
+        }
+
+        this->exporting_checkpoint_sequence.reset();
+
+        boost::filesystem::remove_all(checkpoint_dir, ec);
+    }
+
+    this->snapshot_exporting = false;
+    this->snapshot_cv.notify_all();
+}
+
+
+void
+rocksdb_storage::wait_for_snapshot_export()
+{
+    std::unique_lock<std::mutex> lock(this->snapshot_lock);
+
+    this->snapshot_cv.wait(lock, [&]()
+    {
+        return !this->snapshot_exporting;
+    });
+}
+
+
+bool
+rocksdb_storage::snapshot_export_pending(uint64_t checkpoint) const
+{
+    // caller holds snapshot_lock...
+    return this->pending_checkpoint_sequence == checkpoint || this->exporting_checkpoint_sequence == checkpoint;
+}
+
+
+std::string
+rocksdb_storage::snapshot_export_file(uint64_t checkpoint) const
+{
+    return this->snapshot_file + ".at." + std::to_string(checkpoint);
+}
+
+
+void
+rocksdb_storage::prune_snapshot_exports()
+{
+    // caller holds snapshot_delta_lock and snapshot_lock...
+    const auto now = std::chrono::steady_clock::now();
+
+    size_t remaining = this->snapshot_exports.size();
+    for (auto it = this->snapshot_exports.begin(); it != this->snapshot_exports.end(); --remaining)
+    {
+        // ...and a transfer that has not asked for a chunk within the timeout has been given up on
+        if (remaining <= MAX_SNAPSHOT_EXPORTS || now - it->second.last_served < SNAPSHOT_TRANSFER_TIMEOUT)
+        {
+            ++it;
+            continue;
+        }
+
+        LOG(info) << "removing snapshot of checkpoint " << it->first;
+
+        this->remove_snapshot_export(it->second);
+        it = this->snapshot_exports.erase(it);
+    }
+}
+
+
+void
+rocksdb_storage::remove_snapshot_export(const snapshot_export& snapshot)
+{
+    boost::system::error_code ec;
+    boost::filesystem::remove(snapshot.file, ec);
+
+    if (!snapshot.checkpoint_dir.empty())
+    {
+        boost::filesystem::remove_all(snapshot.checkpoint_dir, ec);
+    }
+
+    for (const auto& delta : snapshot.deltas)
+    {
+        if (!delta.file.empty())
+        {
+            boost::filesystem::remove(delta.file, ec);
+        }
+    }
+}
+
+
+std::shared_ptr<std::string>
+rocksdb_storage::get_snapshot()
+{
+    // only the latest checkpoint is of interest...
+    this->wait_for_snapshot_export();
+
+    std::lock_guard<std::mutex> lock(this->snapshot_lock);
+
+    if (this->snapshot_exports.empty())
+    {
+        return {};
+    }
+
+    std::stringstream snapshot;
+
+    // check if file exists...
+    try
+    {
+        std::ifstream s(this->snapshot_exports.rbegin()->second.file);
+        snapshot << s.rdbuf();
+    }
+    catch (std::exception& ex)
+    {
+        LOG(error) << "Exception reading snapshot: " << ex.what();
+
+        return {};
+    }
+
+    return std::make_shared<std::string>(snapshot.str());
+}
+
+
+bool
+rocksdb_storage::load_snapshot(const std::string& data, const bzn::hash_t& state_hash)
+{
+    std::lock_guard<std::shared_mutex> lock(this->lock); // lock for write access
+
+    const std::string tmp_snapshot(this->snapshot_file + ".tmp");
+
+    try
+    {
+        std::ofstream snapshot(tmp_snapshot);
+        snapshot << data;
+    }
+    catch (std::exception& ex)
+    {
+        LOG(error) << "saving snapshot failed: " << ex.what();
+
+        return false;
+    }
+
+    return this->load_snapshot_file(tmp_snapshot, state_hash);
+}
+
+
+std::optional<bzn::snapshot_chunk_t>
+rocksdb_storage::get_snapshot_chunk(uint64_t checkpoint, uint64_t offset, size_t max_size)
+{
+    // callers may hold locks that writers need, so this never waits for an export to finish...
+    std::lock_guard<std::mutex> lock(this->snapshot_lock);
+
+    if (auto it = this->snapshot_exports.find(checkpoint); it != this->snapshot_exports.end())
+    {
+        // ...and keeps the export from being removed while the transfer goes on
+        it->second.last_served = std::chrono::steady_clock::now();
+
+        return read_file_chunk(it->second.file, offset, max_size);
+    }
+
+    if (this->snapshot_export_pending(checkpoint))
+    {
+        return bzn::snapshot_chunk_t{{}, 0, true};
+    }
+
+    return std::nullopt;
+}
+
+
+bool
+rocksdb_storage::load_snapshot_chunk(uint64_t checkpoint, uint64_t offset, const std::string& data,
+    uint64_t total_size, bool delta, const bzn::hash_t& state_hash)
+{
+    // chunks are staged on disk so a large snapshot never has to be held in memory...
+    std::lock_guard<std::mutex> transfer_lock(this->snapshot_transfer_lock);
+
+    const std::string transfer_snapshot(
+        this->snapshot_file + ".transfer." + std::to_string(checkpoint) + (delta ? ".delta" : ""));
+
+    boost::system::error_code ec;
+
+    // ...and a transfer of anything else is given up once this one starts
+    if (offset == 0 && transfer_snapshot != this->snapshot_transfer_file)
+    {
+        if (!this->snapshot_transfer_file.empty())
+        {
+            boost::filesystem::remove(this->snapshot_transfer_file, ec);
+        }
+
+        this->snapshot_transfer_file = transfer_snapshot;
+    }
+
+    const uint64_t received = offset && transfer_snapshot == this->snapshot_transfer_file
+        ? boost::filesystem::file_size(transfer_snapshot, ec) : 0;
+
+    if (ec || received != offset || offset + data.size() > total_size)
+    {
+        LOG(error) << "snapshot chunk at " << offset << " does not follow the " << received << " bytes received";
+
+        return false;
+    }
+
+    try
+    {
+        std::ofstream snapshot(transfer_snapshot, std::ios::binary | (offset ? std::ios::app : std::ios::trunc));
+        snapshot.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+        snapshot.write(data.data(), data.size());
+    }
+    catch (std::exception& ex)
+    {
+        LOG(error) << "saving snapshot chunk failed: " << ex.what();
+
+        return false;
+    }
+
+    if (offset + data.size() < total_size)
+    {
+        return true;
+    }
+
+    // the staged file is used up either way...
+    this->snapshot_transfer_file.clear();
+
+    if (delta)
+    {
+        const bool applied = this->apply_snapshot_delta(transfer_snapshot, state_hash);
+
+        boost::filesystem::remove(transfer_snapshot, ec);
+
+        return applied;
+    }
+
+    std::lock_guard<std::shared_mutex> lock(this->lock); // lock for write access
+
+    return this->load_snapshot_file(transfer_snapshot, state_hash);
+}
+
+
+bool
+rocksdb_storage::load_snapshot_file(const std::string& snapshot_path, const bzn::hash_t& state_hash)
+{
+    // bring down the database once pending group commits have synced and removed ranges have been counted...
+    this->group_commit_drain();
+    {
+        std::unique_lock<std::mutex> lock(this->range_accounting_lock);
+
+        this->range_accounting_cv.wait(lock, [&]()
+        {
+            return this->range_accounting_in_progress == 0;
+        });
+    }
+    this->db.reset();
+
+    // move current database out of the way...
+    const std::string tmp_path(this->db_path + ".tmp");
+
+    boost::system::error_code ec;
+    boost::filesystem::rename(this->db_path, tmp_path, ec);
+
+    if (ec)
+    {
+        LOG(error) << "creating temporary db backup failed: " << ec.message();
+
+        // bring db back online...
+        this->open();
+
+        return false;
+    }
+
+    rocksdb::UndumpOptions undump_options;
+
+    undump_options.db_path = this->db_path;
+    undump_options.dump_location = snapshot_path;
+    undump_options.compact_db = true;
+
+    if (rocksdb::DbUndumpTool().Run(undump_options))
+    {
+        // bring db back online...
+        this->open();
+
+        // ...with digests of the records it holds rather than the ones that came with them
+        if (!this->state_digests.empty())
+        {
+            this->rebuild_state_digests();
+        }
+
+        if (state_hash.empty() || this->state_digests.empty() || merkle_root(state_manifest(this->state_digests)) == state_hash)
+        {
+            boost::filesystem::remove_all(tmp_path, ec);
+
+            if (ec)
+            {
+                LOG(error) << "failed to remove temporary db backup: " << ec.message();
+            }
+
+            // the snapshot we serve is still that of the checkpoint it was taken at...
+            boost::filesystem::remove(snapshot_path, ec);
+
+            return true;
+        }
+
+        LOG(error) << "loaded snapshot is not of the expected state";
+
+        this->db.reset();
+    }
+    else
+    {
+        LOG(error) << "failed to load snapshot";
+    }
+
+    // any exceptions will be fatal...
+    boost::filesystem::remove_all(this->db_path);
+    boost::filesystem::rename(tmp_path, this->db_path);
+    boost::filesystem::remove(snapshot_path);
+
+    // bring db back online...
+    this->open();
+
+    return false;
+}
+
+std::vector<bzn::hash_t>
+rocksdb_storage::get_state_manifest()
+{
+    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+
+    // empty for the legacy key encoding, whose raw keys do not line up with other databases...
+    return state_manifest(this->state_digests);
+}
+
+
+std::optional<bzn::snapshot_chunk_t>
+rocksdb_storage::get_snapshot_delta_chunk(uint64_t checkpoint, const std::vector<bzn::hash_t>& manifest,
+    uint64_t offset, size_t max_size)
+{
+    if (manifest.empty())
+    {
+        return std::nullopt;
+    }
+
+    // exports are not removed while we hold the delta lock, and we never wait for one (or for a delta)...
+    std::lock_guard<std::mutex> lock(this->snapshot_delta_lock);
+
+    std::map<uint64_t, snapshot_export>::iterator snapshot;
+    {
+        std::lock_guard<std::mutex> snapshot_lock(this->snapshot_lock);
+
+        snapshot = this->snapshot_exports.find(checkpoint);
+
+        if (snapshot == this->snapshot_exports.end())
+        {
+            return this->snapshot_export_pending(checkpoint) ? std::optional(bzn::snapshot_chunk_t{{}, 0, true})
+                : std::nullopt;
+        }
+
+        snapshot->second.last_served = std::chrono::steady_clock::now();
+    }
+
+    auto& deltas = snapshot->second.deltas;
+
+    // a requester resuming a transfer sends the same manifest, so each delta is only built once...
+    auto delta = std::find_if(deltas.begin(), deltas.end(), [&](const auto& delta)
+    {
+        return delta.manifest == manifest;
+    });
+
+    if (delta != deltas.end())
+    {
+        deltas.splice(deltas.begin(), deltas, delta);
+    }
+    else
+    {
+        // ...on the exporter thread, and the requester asks again once it is done
+        deltas.push_front(snapshot_delta{manifest, {}, false});
+
+        // ...while other requesters keep theirs
+        if (deltas.size() > MAX_SNAPSHOT_DELTAS)
+        {
+            if (!deltas.back().file.empty())
+            {
+                boost::system::error_code ec;
+                boost::filesystem::remove(deltas.back().file, ec);
+            }
+
+            deltas.pop_back();
+        }
+
+        std::lock_guard<std::mutex> snapshot_lock(this->snapshot_lock);
+
+        this->snapshot_deltas_requested = true;
+        this->start_snapshot_exporter();
+    }
+
+    if (!deltas.front().built)
+    {
+        return bzn::snapshot_chunk_t{{}, 0, true};
+    }
+
+    if (deltas.front().file.empty())
+    {
+        return std::nullopt;
+    }
+
+    return read_file_chunk(deltas.front().file, offset, max_size);
+}
+
+
+bool
+rocksdb_storage::build_next_snapshot_delta()
+{
+    // only the exporter thread removes exports, so the one we build from stays while we do...
+    const snapshot_export* snapshot = nullptr;
+    uint64_t snapshot_checkpoint = 0;
+    std::vector<bzn::hash_t> manifest;
+    std::vector<bzn::hash_t> snapshot_manifest;
+    std::string delta_file;
+    {
+        std::lock_guard<std::mutex> lock(this->snapshot_delta_lock);
+
+        for (const auto& [checkpoint, candidate] : this->snapshot_exports)
+        {
+            auto delta = std::find_if(candidate.deltas.begin(), candidate.deltas.end(), [](const auto& delta)
+            {
+                return !delta.built;
+            });
+
+            if (delta != candidate.deltas.end())
+            {
+                snapshot = &candidate;
+                snapshot_checkpoint = checkpoint;
+                manifest = delta->manifest;
+                snapshot_manifest = candidate.manifest;
+                delta_file = this->snapshot_file + ".delta." + std::to_string(++this->snapshot_delta_count);
+                break;
+            }
+        }
+    }
+
+    if (!snapshot)
     {
-        return uuid+key;
+        return false;
     }
-}
 
+    std::vector<bzn::uuid_t> local_namespaces;
+    {
+        std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
 
-rocksdb_storage::rocksdb_storage(const std::string& state_dir, const std::string& db_name, const bzn::uuid_t& uuid)
-    : db_path(boost::filesystem::path(state_dir).append(uuid).append(db_name).string())
-    , snapshot_file(boost::filesystem::path(state_dir).append(uuid).append("SNAPSHOT." + db_name).string())
-{
-    this->open();
+        local_namespaces = this->local_namespaces;
+    }
+
+    boost::system::error_code ec;
+    if (!this->build_snapshot_delta(*snapshot, snapshot_manifest, manifest, local_namespaces, delta_file))
+    {
+        boost::filesystem::remove(delta_file, ec);
+        delta_file.clear();
+    }
+
+    std::lock_guard<std::mutex> lock(this->snapshot_delta_lock);
+
+    auto& export_entry = this->snapshot_exports.at(snapshot_checkpoint);
+    if (export_entry.manifest.empty())
+    {
+        export_entry.manifest = std::move(snapshot_manifest);
+    }
+
+    // the delta may have been evicted by newer requests while we built it...
+    auto delta = std::find_if(export_entry.deltas.begin(), export_entry.deltas.end(), [&](const auto& delta)
+    {
+        return !delta.built && delta.manifest == manifest;
+    });
+
+    if (delta == export_entry.deltas.end())
+    {
+        if (!delta_file.empty())
+        {
+            boost::filesystem::remove(delta_file, ec);
+        }
+
+        return true;
+    }
+
+    delta->file = std::move(delta_file);
+    delta->built = true;
+
+    return true;
 }
 
 
-void
-rocksdb_storage::open()
+bool
+rocksdb_storage::build_snapshot_delta(const snapshot_export& snapshot, std::vector<bzn::hash_t>& snapshot_manifest,
+    const std::vector<bzn::hash_t>& manifest, const std::vector<bzn::uuid_t>& local_namespaces,
+    const std::string& delta_file)
 {
-    rocksdb::Options options;
+    if (manifest.size() != STATE_RANGE_COUNT || snapshot.checkpoint_dir.empty()
+        || !boost::filesystem::exists(snapshot.checkpoint_dir))
+    {
+        return false;
+    }
 
-    options.IncreaseParallelism(std::thread::hardware_concurrency());
-    options.OptimizeLevelStyleCompaction();
-    options.create_if_missing = true;
+    rocksdb::DB* checkpoint_ptr;
+    if (auto s = rocksdb::DB::OpenForReadOnly(rocksdb::Options(), snapshot.checkpoint_dir, &checkpoint_ptr); !s.ok())
+    {
+        LOG(error) << "failed to open snapshot checkpoint: " << s.ToString();
 
-    rocksdb::DB* rocksdb;
+        return false;
+    }
 
-    boost::filesystem::create_directories(db_path);
+    std::unique_ptr<rocksdb::DB> checkpoint(checkpoint_ptr);
 
-    LOG(info) << "database path: " << db_path;
+    bzn::value_t encoding;
+    if (!checkpoint->Get(rocksdb::ReadOptions(), KEY_ENCODING_KEY, &encoding).ok())
+    {
+        return false;
+    }
 
-    rocksdb::Status s = rocksdb::DB::Open(options, db_path, &rocksdb);
+    if (snapshot_manifest.empty())
+    {
+        // the checkpoint carries the digests that were current when it was taken...
+        std::vector<bzn::hash_t> digests(STATE_RANGE_COUNT);
+        for (size_t range = 0; range < STATE_RANGE_COUNT; ++range)
+        {
+            if (!checkpoint->Get(rocksdb::ReadOptions(), state_digest_key(range), &digests[range]).ok())
+            {
+                return false;
+            }
+        }
 
-    if (!s.ok())
+        snapshot_manifest = state_manifest(digests);
+    }
+
+    std::vector<bool> changed(STATE_RANGE_COUNT);
+    std::vector<uint32_t> changed_ranges;
+    for (size_t range = 0; range < STATE_RANGE_COUNT; ++range)
     {
-        throw std::runtime_error("Could not open database: " + s.ToString());
+        if (manifest[range] != snapshot_manifest[range])
+        {
+            changed[range] = true;
+            changed_ranges.emplace_back(range);
+        }
     }
 
-    this->db.reset(rocksdb);
+    // the delta has to save at least half of what sending the snapshot would cost...
+    boost::system::error_code ec;
+    const uint64_t max_delta_size = boost::filesystem::file_size(snapshot.file, ec) / 2;
+
+    if (ec)
+    {
+        return false;
+    }
+
+    try
+    {
+        std::ofstream delta(delta_file, std::ios::binary | std::ios::trunc);
+        delta.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+
+        // the snapshot's manifest lets the receiver check the result...
+        for (const auto& digest : snapshot_manifest)
+        {
+            delta.write(digest.data(), digest.size());
+        }
+
+        write_u32(delta, changed_ranges.size());
+        for (const auto range : changed_ranges)
+        {
+            write_u32(delta, range);
+        }
+
+        std::unique_ptr<rocksdb::Iterator> iter(checkpoint->NewIterator(rocksdb::ReadOptions()));
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next())
+        {
+            if (!changed[state_range(iter->key())] || !hashed_record(iter->key(), local_namespaces))
+            {
+                continue;
+            }
+
+            write_u32(delta, iter->key().size());
+            delta.write(iter->key().data(), iter->key().size());
+            write_u32(delta, iter->value().size());
+            delta.write(iter->value().data(), iter->value().size());
+
+            if (static_cast<uint64_t>(delta.tellp()) > max_delta_size)
+            {
+                LOG(info) << "snapshot delta for " << changed_ranges.size() << " ranges is too large to be worthwhile";
+
+                return false;
+            }
+        }
+    }
+    catch (std::exception& ex)
+    {
+        LOG(error) << "failed to build snapshot delta: " << ex.what();
+
+        return false;
+    }
+
+    LOG(info) << "built snapshot delta for " << changed_ranges.size() << " of " << STATE_RANGE_COUNT << " ranges";
+
+    return true;
 }
 
 
-bzn::storage_result
-rocksdb_storage::create(const bzn::uuid_t& uuid, const bzn::key_t& key, const bzn::value_t& value)
+bool
+rocksdb_storage::apply_snapshot_delta(const std::string& delta_file, const bzn::hash_t& state_hash)
 {
-    if (value.size() > bzn::MAX_VALUE_SIZE)
+    std::ifstream delta(delta_file, std::ios::binary);
+
+    std::vector<bzn::hash_t> snapshot_manifest(STATE_RANGE_COUNT, bzn::hash_t(SHA256_DIGEST_LENGTH, '\0'));
+    for (auto& digest : snapshot_manifest)
     {
-        return bzn::storage_result::value_too_large;
+        if (!delta.read(digest.data(), digest.size()))
+        {
+            LOG(error) << "snapshot delta is truncated";
+
+            return false;
+        }
     }
 
-    if (key.size() > bzn::MAX_KEY_SIZE)
+    if (!state_hash.empty() && merkle_root(snapshot_manifest) != state_hash)
     {
-        return bzn::storage_result::key_too_large;
+        LOG(error) << "snapshot delta is not of the expected state";
+
+        return false;
     }
 
-    rocksdb::WriteOptions write_options;
-    write_options.sync = true;
+    uint32_t range_count;
+    if (!read_u32(delta, range_count) || range_count > STATE_RANGE_COUNT)
+    {
+        LOG(error) << "snapshot delta is malformed";
 
-    std::lock_guard<std::shared_mutex> lock(this->lock); // lock for write access
+        return false;
+    }
 
-    if (!this->has_priv(uuid, key))
+    std::vector<bool> changed(STATE_RANGE_COUNT);
+    for (uint32_t i = 0; i < range_count; ++i)
     {
-        const uint32_t ns_prev_size = this->get_metadata_size(uuid, NAMESPACE_KEY, SIZE_KEY);
+        uint32_t range;
+        if (!read_u32(delta, range) || range >= STATE_RANGE_COUNT)
+        {
+            LOG(error) << "snapshot delta is malformed";
 
-        auto s = this->db->Put(write_options, generate_key(uuid, key), value);
+            return false;
+        }
 
-        if (!s.ok())
+        changed[range] = true;
+    }
+
+    std::vector<bzn::uuid_t> local_namespaces;
+    const rocksdb::Snapshot* covered;
+    uint64_t generation;
+    {
+        std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+
+        if (this->legacy_key_encoding || this->state_digests.empty())
         {
-            LOG(error) << "save failed: " << uuid << ":" << key << ":" <<
-                value.substr(0,MAX_MESSAGE_SIZE) << "... - " << s.ToString();
+            LOG(error) << "cannot apply a snapshot delta to a database whose state is not hashed";
 
-            return bzn::storage_result::not_saved;
+            return false;
         }
 
-        // update metadata...
-        this->update_metadata_size(uuid, NAMESPACE_KEY, SIZE_KEY, ns_prev_size + value.size() + key.size());
-        this->update_metadata_size(uuid, SIZE_KEY, key, value.size() + key.size());
+        local_namespaces = this->local_namespaces;
+        generation = this->open_generation;
+        covered = this->take_covered_snapshot();
+    }
 
-#ifdef __APPLE__
-        this->db_flush();
-#endif
+    // the snapshot's records for the changed ranges replace ours, so they alone make up those ranges' digests...
+    std::vector<std::pair<bzn::key_t, bzn::value_t>> records;
+    std::vector<bzn::hash_t> digests(STATE_RANGE_COUNT, bzn::hash_t(STATE_DIGEST_SIZE, '\0'));
+    record_hasher hasher;
 
-        return bzn::storage_result::ok;
+    uint32_t key_size;
+    bool valid = true;
+    while (valid && read_u32(delta, key_size))
+    {
+        bzn::key_t key(key_size, '\0');
+        uint32_t value_size;
+
+        if (!delta.read(key.data(), key.size()) || !read_u32(delta, value_size) || !changed[state_range(key)]
+            || !hashed_record(key, local_namespaces))
+        {
+            LOG(error) << "snapshot delta is malformed";
+
+            valid = false;
+            break;
+        }
+
+        bzn::value_t value(value_size, '\0');
+
+        if (!delta.read(value.data(), value.size()))
+        {
+            LOG(error) << "snapshot delta is truncated";
+
+            valid = false;
+            break;
+        }
+
+        add_digest(digests[state_range(key)], hasher(key, value));
+        records.emplace_back(std::move(key), std::move(value));
     }
 
-    return bzn::storage_result::exists;
-}
+    // the records of ours to drop are found without holding the write lock...
+    const auto find_stale = [&](const rocksdb::ReadOptions& read_options)
+    {
+        std::vector<bzn::key_t> stale;
 
+        std::unique_ptr<rocksdb::Iterator> iter(this->db->NewIterator(read_options));
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next())
+        {
+            if (changed[state_range(iter->key())] && hashed_record(iter->key(), local_namespaces))
+            {
+                stale.emplace_back(iter->key().ToString());
+            }
+        }
 
-void
-rocksdb_storage::db_flush() const
-{
-    rocksdb::FlushOptions flush_options;
-    flush_options.wait = false;
-    db->Flush(flush_options);
-}
+        return stale;
+    };
 
+    std::vector<bzn::key_t> stale;
+    const uint64_t covered_sequence = covered->GetSequenceNumber();
 
-std::optional<bzn::value_t>
-rocksdb_storage::read(const bzn::uuid_t& uuid, const bzn::key_t& key)
-{
-    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+    if (valid)
+    {
+        rocksdb::ReadOptions read_options;
+        read_options.snapshot = covered;
 
-    bzn::value_t value;
-    auto s = this->db->Get(rocksdb::ReadOptions(), generate_key(uuid, key), &value);
+        stale = find_stale(read_options);
+    }
 
-    if (!s.ok())
+    this->release_covered_snapshot(covered);
+
+    if (!valid)
     {
-        return std::nullopt;
+        return false;
     }
 
-    return value;
-}
+    std::lock_guard<std::shared_mutex> lock(this->lock); // lock for write access
 
+    if (generation != this->open_generation)
+    {
+        LOG(error) << "database was replaced while applying a snapshot delta";
 
-bzn::storage_result
-rocksdb_storage::update(const bzn::uuid_t& uuid, const bzn::key_t& key, const bzn::value_t& value)
-{
-    if (value.size() > bzn::MAX_VALUE_SIZE)
+        return false;
+    }
+
+    // nothing is written unless it leaves us with exactly the snapshot's state...
+    for (size_t range = 0; range < STATE_RANGE_COUNT; ++range)
     {
-        return bzn::storage_result::value_too_large;
+        if (!changed[range])
+        {
+            digests[range] = this->state_digests[range];
+        }
     }
 
-    std::lock_guard<std::shared_mutex> lock(this->lock); // lock for write access
+    if (state_manifest(digests) != snapshot_manifest)
+    {
+        LOG(error) << "snapshot delta does not lead to the state of its snapshot";
 
-    if (this->has_priv(uuid, key))
+        return false;
+    }
+
+    // ...and anything written since we looked has to be found again
+    if (this->db->GetLatestSequenceNumber() != covered_sequence)
     {
-        const uint32_t prev_size = this->get_metadata_size(uuid, SIZE_KEY, key);
-        const uint32_t ns_prev_size = this->get_metadata_size(uuid, NAMESPACE_KEY, SIZE_KEY);
+        stale = find_stale(rocksdb::ReadOptions());
+    }
 
-        rocksdb::WriteOptions write_options;
-        write_options.sync = true;
+    rocksdb::WriteBatch batch;
+
+    for (const auto& key : stale)
+    {
+        batch.Delete(key);
+    }
 
-        auto s = this->db->Put(write_options, generate_key(uuid, key), value);
+    for (const auto& [key, value] : records)
+    {
+        batch.Put(key, value);
+    }
 
-        if (!s.ok())
+    for (size_t range = 0; range < STATE_RANGE_COUNT; ++range)
+    {
+        if (changed[range])
         {
-            LOG(error) << "update failed: " << uuid << ":" << key << ":" <<
-                value.substr(0,MAX_MESSAGE_SIZE) << "... - " << s.ToString();
+            batch.Put(state_digest_key(range), digests[range]);
+        }
+    }
 
-            return bzn::storage_result::not_saved;
+    // counts this node kept for namespaces without a stored count may no longer match their records...
+    batch.DeleteRange(KEY_COUNT_CACHE_KEY, prefix_successor(KEY_COUNT_CACHE_KEY));
+
+    // the digests are already known, so the batch is written as is...
+    rocksdb::WriteOptions write_options;
+    write_options.sync = true;
+
+    if (auto s = this->db->Write(write_options, &batch); !s.ok())
+    {
+        LOG(error) << "failed to apply snapshot delta: " << s.ToString();
+
+        return false;
+    }
+
+    this->state_digests = std::move(digests);
+
+    return true;
+}
+
+void
+rocksdb_storage::remove_stale_checkpoints()
+{
+    // checkpoints that a previous run took but never exported, the deltas it built and the transfers it staged...
+    const boost::filesystem::path snapshot_path(this->snapshot_file);
+    const std::string snapshot_name(snapshot_path.filename().string());
+    const std::vector<std::string> stale_prefixes{snapshot_name + ".checkpoint.", snapshot_name + ".delta.",
+        snapshot_name + ".transfer."};
+    const std::string export_prefix(snapshot_name + ".at.");
+    const std::string checkpoint_suffix(".checkpoint");
+
+    boost::system::error_code ec;
+    if (!boost::filesystem::is_directory(snapshot_path.parent_path(), ec))
+    {
+        return;
+    }
+
+    std::vector<boost::filesystem::path> stale;
+    std::multimap<uint64_t, boost::filesystem::path> exports;
+    std::optional<uint64_t> latest_export;
+    for (boost::filesystem::directory_iterator it(snapshot_path.parent_path(), ec), end; !ec && it != end; it.increment(ec))
+    {
+        const auto filename = it->path().filename().string();
+
+        if (std::any_of(stale_prefixes.begin(), stale_prefixes.end(), [&](const auto& prefix)
+            {
+                return filename.compare(0, prefix.size(), prefix) == 0;
+            }) || filename == snapshot_name)
+        {
+            stale.emplace_back(it->path());
         }
+        else if (filename.compare(0, export_prefix.size(), export_prefix) == 0)
+        {
+            // ...and all but the latest of its exports, which are named for their checkpoint sequence
+            auto sequence = filename.substr(export_prefix.size());
+            const bool checkpoint_dir = sequence.size() > checkpoint_suffix.size()
+                && sequence.compare(sequence.size() - checkpoint_suffix.size(), checkpoint_suffix.size(), checkpoint_suffix) == 0;
+
+            if (checkpoint_dir)
+            {
+                sequence.resize(sequence.size() - checkpoint_suffix.size());
+            }
+
+            if (sequence.empty() || sequence.size() > 19 || sequence.find_first_not_of("0123456789") != std::string::npos)
+            {
+                stale.emplace_back(it->path());
+                continue;
+            }
+
+            const uint64_t checkpoint = std::stoull(sequence);
+
+            exports.emplace(checkpoint, it->path());
+
+            if (!checkpoint_dir)
+            {
+                latest_export = std::max(latest_export.value_or(0), checkpoint);
+            }
+        }
+    }
 
-        // update metadata...
-        this->update_metadata_size(uuid, NAMESPACE_KEY, SIZE_KEY, ns_prev_size - prev_size + value.size() + key.size());
-        this->update_metadata_size(uuid, SIZE_KEY, key, value.size() + key.size());
+    for (const auto& [checkpoint, path] : exports)
+    {
+        if (checkpoint != latest_export)
+        {
+            stale.emplace_back(path);
+        }
+    }
 
-#ifdef __APPLE__
-        this->db_flush();
-#endif
+    if (latest_export)
+    {
+        // ...which is still the state of its checkpoint
+        snapshot_export snapshot;
+        snapshot.file = this->snapshot_export_file(*latest_export);
+        snapshot.checkpoint_dir = snapshot.file + checkpoint_suffix;
 
-        return bzn::storage_result::ok;
+        if (!boost::filesystem::is_directory(snapshot.checkpoint_dir, ec))
+        {
+            snapshot.checkpoint_dir.clear();
+        }
+
+        this->snapshot_exports.emplace(*latest_export, std::move(snapshot));
     }
 
-    return bzn::storage_result::not_found;
+    for (const auto& path : stale)
+    {
+        LOG(info) << "removing stale snapshot file: " << path.string();
+
+        boost::filesystem::remove_all(path, ec);
+    }
 }
 
 
-bzn::storage_result
-rocksdb_storage::remove(const bzn::uuid_t& uuid, const bzn::key_t& key)
+void
+rocksdb_storage::remove_range(const bzn::uuid_t& uuid, const bzn::key_t& first, const bzn::key_t& last)
 {
-    rocksdb::WriteOptions write_options;
-    write_options.sync = true;
+    std::unique_lock<std::shared_mutex> lock(this->lock); // lock for write access
 
-    std::lock_guard<std::shared_mutex> lock(this->lock); // lock for write access
+    const auto prefix = this->generate_key(uuid, "");
+    const auto begin_str = this->generate_key(uuid, first);
+    const auto end_str = this->generate_key(uuid, last);
 
-    if (this->has_priv(uuid, key))
     {
-        const uint32_t prev_size = this->get_metadata_size(uuid, SIZE_KEY, key);
-        const uint32_t ns_prev_size = this->get_metadata_size(uuid, NAMESPACE_KEY, SIZE_KEY);
+        std::unique_ptr<rocksdb::Iterator> iter(this->db->NewIterator(rocksdb::ReadOptions()));
+        iter->Seek(begin_str);
 
-        auto s = this->db->Delete(write_options, generate_key(uuid, key));
-
-        if (!s.ok())
+        if (!iter->Valid() || iter->key().compare(end_str) >= 0)
         {
-            return bzn::storage_result::not_found;
+            return;
         }
+    }
 
-        // update metadata...
-        this->update_metadata_size(uuid, NAMESPACE_KEY, SIZE_KEY, ns_prev_size - prev_size);
-        this->delete_metadata_size(uuid, SIZE_KEY, key);
+    const auto size_namespace = this->metadata_namespace(uuid, SIZE_KEY);
+    const auto size_begin = this->generate_key(size_namespace, first);
+    const auto size_end = this->generate_key(size_namespace, last);
+
+    // with the write lock held the tombstones cover exactly what this snapshot holds of the range...
+    const rocksdb::Snapshot* covered = this->take_covered_snapshot();
+    const auto marker = range_accounting_key(covered->GetSequenceNumber());
+    const uint64_t generation = this->open_generation;
+    const uint64_t digest_generation = this->digest_generation;
+    const bool digested = !this->state_digests.empty();
+    const auto local_namespaces = this->local_namespaces;
+
+    rocksdb::WriteBatch batch;
+    batch.DeleteRange(begin_str, end_str);
+    batch.DeleteRange(size_begin, size_end);
+    batch.Put(marker, RANGE_REMOVED + uuid);
+
+    // the count the removed keys come off has to be stored before they are gone...
+    this->update_key_count(batch, uuid, this->get_key_count(uuid));
+
+    auto s = this->commit(batch, lock);
+
+    if (lock.owns_lock())
+    {
+        lock.unlock();
+    }
+
+    removed_records removed;
+    std::map<size_t, bzn::hash_t> removed_digests;
+
+    if (s.ok())
+    {
+        removed = this->count_removed(covered, begin_str, end_str, prefix.size(), local_namespaces,
+            digested ? &removed_digests : nullptr);
 
-        return bzn::storage_result::ok;
+        if (digested)
+        {
+            this->count_removed(covered, size_begin, size_end, 0, local_namespaces, &removed_digests);
+        }
     }
 
-    return bzn::storage_result::not_found;
-}
+    this->release_covered_snapshot(covered);
 
+    if (!s.ok())
+    {
+        // the marker, if it was written, has the namespace recounted when the database is next opened...
+        LOG(error) << "delete range failed: " << uuid << ":" << s.ToString();
 
-std::vector<bzn::key_t>
-rocksdb_storage::get_keys(const bzn::uuid_t& uuid)
-{
-    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+        return;
+    }
 
-    std::unique_ptr<rocksdb::Iterator> iter(this->db->NewIterator(rocksdb::ReadOptions()));
+    lock.lock();
 
-    std::vector<bzn::key_t> v;
-    for (iter->Seek(uuid); iter->Valid() && iter->key().starts_with(uuid); iter->Next())
+    if (generation != this->open_generation)
     {
-        v.emplace_back(iter->key().ToString().substr(uuid.size()));
+        // a snapshot loaded meanwhile replaced the database...
+        return;
     }
 
-    return v;
-}
+    const uint32_t ns_prev_size = this->get_metadata_size(uuid, NAMESPACE_KEY, SIZE_KEY);
+    const uint64_t ns_prev_count = this->get_key_count(uuid);
 
+    rocksdb::WriteBatch settle;
+    this->update_metadata_size(settle, uuid, NAMESPACE_KEY, SIZE_KEY, ns_prev_size - std::min<uint64_t>(ns_prev_size, removed.bytes));
+    this->update_key_count(settle, uuid, ns_prev_count - std::min(ns_prev_count, removed.keys));
+    settle.Delete(marker);
 
-bool
-rocksdb_storage::has(const bzn::uuid_t& uuid, const bzn::key_t& key)
-{
-    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+    // digests rebuilt meanwhile were taken without the removed records...
+    s = this->commit(settle, lock, digest_generation == this->digest_generation
+        ? removed_digests : std::map<size_t, bzn::hash_t>{});
 
-    return this->has_priv(uuid, key);
+    if (!s.ok())
+    {
+        LOG(error) << "delete range accounting failed: " << uuid << ":" << s.ToString();
+    }
 }
 
 
-std::pair<std::size_t, std::size_t>
-rocksdb_storage::get_size(const bzn::uuid_t& uuid)
+rocksdb_storage::removed_records
+rocksdb_storage::count_removed(const rocksdb::Snapshot* covered, const bzn::key_t& begin, const bzn::key_t& end,
+    size_t prefix_size, const std::vector<bzn::uuid_t>& local_namespaces, std::map<size_t, bzn::hash_t>* digests)
 {
-    std::unique_ptr<rocksdb::Iterator> iter(this->db->NewIterator(rocksdb::ReadOptions()));
+    // the snapshot keeps the removed records readable, and loading a snapshot waits for us to release it...
+    rocksdb::ReadOptions read_options;
+    read_options.snapshot = covered;
 
-    std::size_t keys{};
+    removed_records removed;
+    record_hasher hasher;
 
-    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
-
-    for (iter->Seek(uuid); iter->Valid() && iter->key().starts_with(uuid); iter->Next())
+    std::unique_ptr<rocksdb::Iterator> iter(this->db->NewIterator(read_options));
+    for (iter->Seek(begin); iter->Valid() && iter->key().compare(end) < 0; iter->Next())
     {
-        ++keys;
+        ++removed.keys;
+        removed.bytes += iter->key().size() - prefix_size + iter->value().size();
+
+        if (digests && hashed_record(iter->key(), local_namespaces))
+        {
+            auto digest = digests->try_emplace(state_range(iter->key()), bzn::hash_t(STATE_DIGEST_SIZE, '\0')).first;
+            add_digest(digest->second, hasher(iter->key(), iter->value()));
+        }
     }
 
-    return std::make_pair(keys, this->get_metadata_size(uuid, NAMESPACE_KEY, SIZE_KEY));
+    return removed;
 }
 
 
-std::optional<std::size_t>
-rocksdb_storage::get_key_size(const bzn::uuid_t& uuid, const bzn::key_t& key)
+const rocksdb::Snapshot*
+rocksdb_storage::take_covered_snapshot()
 {
-    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+    // caller holds the lock, the write lock if the snapshot has to be of what a write it is about to make covers...
+    std::lock_guard<std::mutex> lock(this->range_accounting_lock);
 
-    if (this->has_priv(uuid, key))
-    {
-        return this->get_metadata_size(uuid, SIZE_KEY, key);
-    }
+    ++this->range_accounting_in_progress;
 
-    return std::nullopt;
+    return this->db->GetSnapshot();
 }
 
 
-bzn::storage_result
-rocksdb_storage::remove(const bzn::uuid_t& uuid)
+void
+rocksdb_storage::release_covered_snapshot(const rocksdb::Snapshot* covered)
 {
-    rocksdb::WriteOptions write_options;
-    write_options.sync = true;
+    this->db->ReleaseSnapshot(covered);
 
-    std::unique_ptr<rocksdb::Iterator> iter(this->db->NewIterator(rocksdb::ReadOptions()));
+    std::lock_guard<std::mutex> lock(this->range_accounting_lock);
 
-    std::lock_guard<std::shared_mutex> lock(this->lock); // lock for write access
+    --this->range_accounting_in_progress;
+    this->range_accounting_cv.notify_all();
+}
 
-    std::size_t keys_removed{};
 
-    for (iter->Seek(uuid); iter->Valid() && iter->key().starts_with(uuid); iter->Next())
+void
+rocksdb_storage::settle_range_accounting()
+{
+    // a crash between removing a range and accounting for it leaves its marker behind...
+    std::map<bzn::key_t, bzn::value_t> markers;
     {
-        auto s = this->db->Delete(write_options, iter->key());
-
-        if (!s.ok())
+        std::unique_ptr<rocksdb::Iterator> iter(this->db->NewIterator(rocksdb::ReadOptions()));
+        for (iter->Seek(RANGE_ACCOUNTING_KEY); iter->Valid() && iter->key().starts_with(RANGE_ACCOUNTING_KEY); iter->Next())
         {
-            LOG(error) << "delete failed: " << uuid << ":" <<  s.ToString();
+            markers.emplace(iter->key().ToString(), iter->value().ToString());
         }
+    }
 
-        ++keys_removed;
+    if (markers.empty())
+    {
+        return;
     }
 
-    for (iter->Seek(METADATA_UUID+uuid); iter->Valid() && iter->key().starts_with(METADATA_UUID+uuid); iter->Next())
+    rocksdb::WriteBatch batch;
+    std::set<bzn::uuid_t> recounted;
+
+    for (const auto& [marker, removal] : markers)
     {
-        auto s = this->db->Delete(write_options, iter->key());
+        batch.Delete(marker);
 
-        if (!s.ok())
+        // ...and a namespace that lost part of its keys is recounted, one that was removed has nothing to count
+        if (removal.empty() || removal.front() != RANGE_REMOVED || !recounted.insert(removal.substr(1)).second)
+        {
+            continue;
+        }
+
+        const auto uuid = removal.substr(1);
+        const auto prefix = this->generate_key(uuid, "");
+
+        uint64_t keys{};
+        uint64_t bytes{};
+
+        std::unique_ptr<rocksdb::Iterator> iter(this->db->NewIterator(rocksdb::ReadOptions()));
+        for (iter->Seek(prefix); iter->Valid() && iter->key().starts_with(prefix); iter->Next())
         {
-            LOG(error) << "metadata delete failed: " << uuid << ":" <<  s.ToString();
+            ++keys;
+            bytes += iter->key().size() - prefix.size() + iter->value().size();
         }
+
+        LOG(info) << "recounted " << keys << " keys of " << uuid << " after an interrupted range removal";
+
+        this->update_metadata_size(batch, uuid, NAMESPACE_KEY, SIZE_KEY, bytes);
+        this->update_key_count(batch, uuid, keys);
     }
 
-    return (keys_removed) ? bzn::storage_result::ok : bzn::storage_result::not_found;
-}
+    rocksdb::WriteOptions write_options;
+    write_options.sync = true;
 
+    if (auto s = this->write_batch(batch, write_options); !s.ok())
+    {
+        throw std::runtime_error("Could not settle removed ranges: " + s.ToString());
+    }
 
-bool
-rocksdb_storage::has_priv(const bzn::uuid_t& uuid, const bzn::key_t& key)
+    // the removed records never left the digests...
+    if (!this->state_digests.empty())
+    {
+        this->rebuild_state_digests();
+    }
+}
+
+void
+rocksdb_storage::do_if(const bzn::uuid_t& uuid, const bzn::key_t& first, const bzn::key_t& last,
+    std::optional<std::function<bool(const bzn::key_t&, const bzn::value_t&)>> predicate,
+    std::function<void(const bzn::key_t&, const bzn::value_t&)> action)
 {
-    const bzn::key_t has_key = generate_key(uuid, key);
+    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+    this->wait_for_durable_writes();
+
+    const auto prefix = this->generate_key(uuid, "");
+    const auto start_key = this->generate_key(uuid, first);
+    const auto end_key = last.empty() ? "" : this->generate_key(uuid, last);
 
     std::unique_ptr<rocksdb::Iterator> iter(this->db->NewIterator(rocksdb::ReadOptions()));
 
-    for (iter->Seek(uuid); iter->Valid() && iter->key().starts_with(uuid); iter->Next())
+    for (iter->Seek(start_key); iter->Valid() && iter->key().starts_with(prefix) && iter->key().ToString() >= start_key
+        && (end_key.empty() || iter->key().ToString() < end_key); iter->Next())
     {
-        if (iter->key() == has_key)
+        if (!predicate || (*predicate)(iter->key().ToString().substr(prefix.size()), iter->value().ToString()))
         {
-            return true;
+            action(iter->key().ToString().substr(prefix.size()), iter->value().ToString());
         }
     }
-
-    return false;
 }
 
 
-bool
-rocksdb_storage::create_snapshot()
+std::vector<std::pair<bzn::key_t, bzn::value_t>>
+rocksdb_storage::read_if(const bzn::uuid_t& uuid, const bzn::key_t& first, const bzn::key_t& last,
+    std::optional<std::function<bool(const bzn::key_t&, const bzn::value_t&)>> predicate)
 {
-    rocksdb::DumpOptions dump_options;
-
-    dump_options.db_path = this->db_path;
-    dump_options.dump_location = this->snapshot_file;
-    dump_options.anonymous = true;
+    std::vector<std::pair<bzn::key_t, bzn::value_t>> matches;
 
-    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+    this->do_if(uuid, first, last, predicate, [&](auto key, auto value)
+    {
+        matches.emplace_back(std::make_pair(key, value));
+    });
 
-    return rocksdb::DbDumpTool().Run(dump_options);
+    return matches;
 }
 
 
-std::shared_ptr<std::string>
-rocksdb_storage::get_snapshot()
+std::vector<bzn::key_t>
+rocksdb_storage::get_keys_if(const bzn::uuid_t& uuid, const bzn::key_t& first, const bzn::key_t& last,
+    std::optional<std::function<bool(const bzn::key_t&, const bzn::value_t&)>> predicate)
 {
-    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
+    std::vector<bzn::key_t> keys;
+    this->do_if(uuid, first, last, predicate, [&](auto key, auto /*value*/)
+    {
+        keys.emplace_back(key);
+    });
 
-    std::stringstream snapshot;
+    return keys;
+}
 
-    // check if file exists...
-    try
+
+void
+rocksdb_storage::update_metadata_size(rocksdb::WriteBatch& batch, const bzn::uuid_t& uuid, const bzn::key_t& metadata_key,
+    const bzn::key_t& key, uint32_t size)
+{
+    if (!batch.Put(this->generate_key(this->metadata_namespace(uuid, metadata_key), key), std::to_string(size)).ok())
     {
-        std::ifstream s(this->snapshot_file);
-        snapshot << s.rdbuf();
+        LOG(error) << "update namespace metadata key size failed: " << uuid << ":" << key.substr(0, MAX_MESSAGE_SIZE);
     }
-    catch (std::exception& ex)
-    {
-        LOG(error) << "Exception reading snapshot: " << ex.what();
+}
 
-        return {};
-    }
 
-    return std::make_shared<std::string>(snapshot.str());
+void
+rocksdb_storage::delete_metadata_size(rocksdb::WriteBatch& batch, const bzn::uuid_t& uuid, const bzn::key_t& metadata_key,
+    const bzn::key_t& key)
+{
+    if (!batch.Delete(this->generate_key(this->metadata_namespace(uuid, metadata_key), key)).ok())
+    {
+        LOG(error) << "delete namespace metadata key size failed: " << uuid << ":" << key.substr(0, MAX_MESSAGE_SIZE);
+    }
 }
 
 
-bool
-rocksdb_storage::load_snapshot(const std::string& data)
+void
+rocksdb_storage::update_key_count(rocksdb::WriteBatch& batch, const bzn::uuid_t& uuid, uint64_t count)
 {
-    std::lock_guard<std::shared_mutex> lock(this->lock); // lock for write access
+    if (!batch.Put(this->generate_key(this->metadata_namespace(uuid, NAMESPACE_KEY), COUNT_KEY), std::to_string(count)).ok())
+    {
+        LOG(error) << "update namespace metadata key count failed: " << uuid;
+    }
+}
 
-    const std::string tmp_snapshot(this->snapshot_file + ".tmp");
 
-    try
+uint64_t
+rocksdb_storage::get_key_count(const bzn::uuid_t& uuid)
+{
+    bzn::value_t value;
+
+    if (this->db->Get(rocksdb::ReadOptions(), this->generate_key(this->metadata_namespace(uuid, NAMESPACE_KEY), COUNT_KEY), &value).ok())
     {
-        std::ofstream snapshot(tmp_snapshot);
-        snapshot << data;
+        return boost::lexical_cast<uint64_t>(value);
     }
-    catch (std::exception& ex)
-    {
-        LOG(error) << "saving snapshot failed: " << ex.what();
 
-        return false;
+    // namespaces written before key counts were kept are counted once. the count is kept out of the state, replicas
+    // would count at different times...
+    const auto cache_key = key_count_cache_key(uuid);
+
+    if (this->db->Get(rocksdb::ReadOptions(), cache_key, &value).ok())
+    {
+        return boost::lexical_cast<uint64_t>(value);
     }
 
-    // bring down the database...
-    this->db.reset();
+    std::unique_ptr<rocksdb::Iterator> iter(this->db->NewIterator(rocksdb::ReadOptions()));
 
-    // move current database out of the way...
-    const std::string tmp_path(this->db_path + ".tmp");
+    const auto prefix = this->generate_key(uuid, "");
 
-    boost::system::error_code ec;
-    boost::filesystem::rename(this->db_path, tmp_path, ec);
+    uint64_t keys{};
+    for (iter->Seek(prefix); iter->Valid() && iter->key().starts_with(prefix); iter->Next())
+    {
+        ++keys;
+    }
 
-    if (ec)
+    // readers only share the lock with each other, and they all arrive at the same count...
+    if (auto s = this->db->Put(rocksdb::WriteOptions(), cache_key, std::to_string(keys)); !s.ok())
     {
-        LOG(error) << "creating temporary db backup failed: " << ec.message();
+        LOG(warning) << "failed to keep the key count of " << uuid << ": " << s.ToString();
+    }
 
-        // bring db back online...
-        this->open();
+    return keys;
+}
 
-        return false;
-    }
 
-    rocksdb::UndumpOptions undump_options;
+rocksdb::Status
+rocksdb_storage::commit(rocksdb::WriteBatch& batch, std::unique_lock<std::shared_mutex>& write_lock,
+    const std::map<size_t, bzn::hash_t>& removed_digests)
+{
+    // data and metadata are applied atomically with a single wal sync...
+    rocksdb::WriteOptions write_options;
+    write_options.sync = this->group_commit_window.count() == 0;
 
-    undump_options.db_path = this->db_path;
-    undump_options.dump_location = tmp_snapshot;
-    undump_options.compact_db = true;
+    auto s = this->write_batch(batch, write_options, removed_digests);
 
-    if (rocksdb::DbUndumpTool().Run(undump_options))
+    if (!s.ok() || write_options.sync)
     {
-        boost::system::error_code ec;
-        boost::filesystem::remove_all(tmp_path, ec);
-        boost::filesystem::remove(this->snapshot_file);
-        boost::filesystem::rename(tmp_snapshot, this->snapshot_file);
+        return s;
+    }
 
-        if (ec)
-        {
-            LOG(error) << "failed to remove temporary db backup: " << ec.message();
-        }
+    // tickets are handed out under the write lock so they follow wal order...
+    uint64_t ticket;
+    {
+        std::lock_guard<std::mutex> lock(this->group_commit_lock);
 
-        // bring db back online...
-        this->open();
+        ticket = ++this->group_commit_last_ticket;
 
-        return true;
+        if (this->group_commit_last_ticket - this->group_commit_synced_ticket >= this->group_commit_max_batch)
+        {
+            this->group_commit_cv.notify_all();
+        }
     }
 
-    LOG(error) << "failed to load snapshot";
+    // let the next writer in while we wait for the wal to be synced; readers let in meanwhile wait for the sync too...
+    write_lock.unlock();
 
-    // any exceptions will be fatal...
-    boost::filesystem::remove_all(this->db_path);
-    boost::filesystem::rename(tmp_path, this->db_path);
-    boost::filesystem::remove(tmp_snapshot);
-
-    // bring db back online...
-    this->open();
-
-    return false;
+    return this->group_commit_sync(ticket);
 }
 
 
-void
-rocksdb_storage::remove_range(const bzn::uuid_t& uuid, const bzn::key_t& first, const bzn::key_t& last)
+rocksdb::Status
+rocksdb_storage::group_commit_sync(uint64_t ticket)
 {
-    std::lock_guard<std::shared_mutex> lock(this->lock); // lock for write access
+    std::unique_lock<std::mutex> lock(this->group_commit_lock);
 
-    std::vector<bzn::key_t> v;
+    while (this->group_commit_synced_ticket < ticket)
+    {
+        if (this->group_commit_in_progress)
+        {
+            // another writer is leading this group...
+            this->group_commit_cv.wait(lock);
+            continue;
+        }
 
-    auto begin_str = generate_key(uuid, first);
-    rocksdb::Slice begin(begin_str);
+        this->group_commit_in_progress = true;
 
-    auto end_str = generate_key(uuid, last);
-    rocksdb::Slice end(end_str);
+        const auto start = std::chrono::steady_clock::now();
+        const auto timer_id = "storage.group_commit." + this->db_path + "." + std::to_string(++this->group_commit_count);
 
-    rocksdb::WriteOptions write_options;
-    write_options.sync = true;
+        if (this->monitor)
+        {
+            this->monitor->start_timer(timer_id);
+        }
 
-    // TODO: Normal db usage does not use delete range.
-    // If it ever does then namespace metadata will need to know each key
-    // removed so that it can account for it.
+        this->group_commit_cv.wait_until(lock, start + this->group_commit_window, [&]()
+        {
+            return this->group_commit_last_ticket - this->group_commit_synced_ticket >= this->group_commit_max_batch
+                || this->group_commit_readers_waiting > 0;
+        });
 
-    this->db->DeleteRange(write_options, nullptr, begin, end);
-}
+        const uint64_t first = this->group_commit_synced_ticket + 1;
+        const uint64_t target = this->group_commit_last_ticket;
+        const uint64_t batch_size = target - this->group_commit_synced_ticket;
 
+        lock.unlock();
+        auto s = this->db->SyncWAL();
+        lock.lock();
 
-void
-rocksdb_storage::do_if(const bzn::uuid_t& uuid, const bzn::key_t& first, const bzn::key_t& last,
-    std::optional<std::function<bool(const bzn::key_t&, const bzn::value_t&)>> predicate,
-    std::function<void(const bzn::key_t&, const bzn::value_t&)> action)
-{
-    const auto start_key = uuid + first;
-    const auto end_key = last.empty() ? "" : uuid + last;
+        if (!s.ok())
+        {
+            LOG(error) << "group commit wal sync failed: " << s.ToString();
+            this->group_commit_failures[target] = group_commit_failure{first, s, batch_size};
+        }
 
-    std::shared_lock<std::shared_mutex> lock(this->lock); // lock for read access
-    std::unique_ptr<rocksdb::Iterator> iter(this->db->NewIterator(rocksdb::ReadOptions()));
+        this->group_commit_synced_ticket = target;
+        this->group_commit_in_progress = false;
+        this->group_commit_cv.notify_all();
 
-    for (iter->Seek(start_key); iter->Valid() && iter->key().starts_with(uuid) && iter->key().ToString() >= start_key
-        && (end_key.empty() || iter->key().ToString() < end_key); iter->Next())
-    {
-        if (!predicate || (*predicate)(iter->key().ToString().substr(uuid.size()), iter->value().ToString()))
+        LOG(trace) << "group commit synced " << batch_size << " writes in "
+            << std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() << "us";
+
+        if (this->monitor)
         {
-            action(iter->key().ToString().substr(uuid.size()), iter->value().ToString());
+            this->monitor->finish_timer(bzn::statistic::storage_group_commit_latency, timer_id);
+            this->monitor->send_counter(bzn::statistic::storage_group_commit_batches);
+            this->monitor->send_counter(bzn::statistic::storage_group_commit_writes, batch_size);
         }
     }
+
+    return this->group_commit_result(ticket);
 }
 
 
-std::vector<std::pair<bzn::key_t, bzn::value_t>>
-rocksdb_storage::read_if(const bzn::uuid_t& uuid, const bzn::key_t& first, const bzn::key_t& last,
-    std::optional<std::function<bool(const bzn::key_t&, const bzn::value_t&)>> predicate)
+rocksdb::Status
+rocksdb_storage::group_commit_result(uint64_t ticket)
 {
-    std::vector<std::pair<bzn::key_t, bzn::value_t>> matches;
+    // caller holds group_commit_lock; only the sync that covered this ticket decides its result...
+    auto failure = this->group_commit_failures.lower_bound(ticket);
+    if (failure == this->group_commit_failures.end() || failure->second.first_ticket > ticket)
+    {
+        return rocksdb::Status::OK();
+    }
 
-    this->do_if(uuid, first, last, predicate, [&](auto key, auto value)
+    const auto status = failure->second.status;
+    if (--failure->second.uncollected == 0)
     {
-        matches.emplace_back(std::make_pair(key, value));
-    });
+        this->group_commit_failures.erase(failure);
+    }
 
-    return matches;
+    return status;
 }
 
 
-std::vector<bzn::key_t>
-rocksdb_storage::get_keys_if(const bzn::uuid_t& uuid, const bzn::key_t& first, const bzn::key_t& last,
-    std::optional<std::function<bool(const bzn::key_t&, const bzn::value_t&)>> predicate)
+void
+rocksdb_storage::wait_for_durable_writes()
 {
-    std::vector<bzn::key_t> keys;
-    this->do_if(uuid, first, last, predicate, [&](auto key, auto /*value*/)
+    // caller holds the read lock, so no write can be issued while we wait. Without the wait a reader could build a
+    // response or checkpoint on a write that is lost if the sync fails or the node crashes first...
+    if (this->group_commit_window.count() == 0)
     {
-        keys.emplace_back(key);
-    });
+        return;
+    }
 
-    return keys;
-}
+    std::unique_lock<std::mutex> lock(this->group_commit_lock);
 
+    const uint64_t target = this->group_commit_last_ticket;
+    if (this->group_commit_synced_ticket >= target)
+    {
+        return;
+    }
 
-void
-rocksdb_storage::update_metadata_size(const bzn::uuid_t& uuid, const bzn::key_t& metadata_key, const bzn::key_t& key,
-    uint32_t size)
-{
-    rocksdb::WriteOptions write_options;
-    write_options.sync = true;
+    // a waiting reader cuts the window short, it already keeps new writers out
+    ++this->group_commit_readers_waiting;
+    this->group_commit_cv.notify_all();
 
-    if (!this->db->Put(write_options, generate_key(METADATA_UUID + uuid + metadata_key, key), std::to_string(size)).ok())
+    this->group_commit_cv.wait(lock, [&]()
     {
-        LOG(error) << "update namespace metadata key size failed: " << uuid << ":" << key.substr(0, MAX_MESSAGE_SIZE);
-    }
+        return this->group_commit_synced_ticket >= target;
+    });
+
+    --this->group_commit_readers_waiting;
 }
 
 
 void
-rocksdb_storage::delete_metadata_size(const bzn::uuid_t& uuid, const bzn::key_t& metadata_key, const bzn::key_t& key)
+rocksdb_storage::group_commit_drain()
 {
-    rocksdb::WriteOptions write_options;
-    write_options.sync = true;
+    // caller holds the write lock so no new tickets can be issued...
+    std::unique_lock<std::mutex> lock(this->group_commit_lock);
 
-    if (!this->db->Delete(write_options, generate_key(METADATA_UUID + uuid + metadata_key, key)).ok())
+    this->group_commit_cv.wait(lock, [&]()
     {
-        LOG(error) << "delete namespace metadata key size failed: " << uuid << ":" << key.substr(0, MAX_MESSAGE_SIZE);
-    }
+        return !this->group_commit_in_progress && this->group_commit_synced_ticket == this->group_commit_last_ticket;
+    });
 }
 
 
@@ -550,7 +2816,7 @@ rocksdb_storage::get_metadata_size(const bzn::uuid_t& uuid, const bzn::key_t& me
 {
     bzn::value_t value;
 
-    if (!this->db->Get(rocksdb::ReadOptions(), generate_key(METADATA_UUID + uuid + metadata_key, key), &value).ok())
+    if (!this->db->Get(rocksdb::ReadOptions(), this->generate_key(this->metadata_namespace(uuid, metadata_key), key), &value).ok())
     {
         LOG(error) << "reading of namespace metadata key size failed: " << uuid << ":" << key.substr(0, MAX_MESSAGE_SIZE);
 
@@ -17,19 +17,43 @@
 #include <include/bluzelle.hpp>
 #include <storage/storage_base.hpp>
 #include <options/options_base.hpp>
+#include <monitor/monitor_base.hpp>
 #include <rocksdb/db.h>
+#include <rocksdb/write_batch.h>
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <map>
 #include <shared_mutex>
+#include <thread>
 
 
 namespace bzn
 {
+    const size_t DEFAULT_GROUP_COMMIT_MAX_BATCH = 64;
+
     class rocksdb_storage : public bzn::storage_base
     {
     public:
-        rocksdb_storage(const std::string& state_dir, const std::string& db_name, const bzn::uuid_t& uuid);
+        /*
+         * A non-zero group_commit_window lets concurrent writers share one wal sync: the first writer to need a sync
+         * waits up to the window (or until group_commit_max_batch writes are pending) and syncs for all of them.
+         * Readers wait for the sync covering every write they could see, so nothing is read before it is durable.
+         *
+         * With hash_state every write also maintains the digests behind get_state_hash() and snapshot deltas; only
+         * storage holding replicated state has any use for them.
+         */
+        rocksdb_storage(const std::string& state_dir, const std::string& db_name, const bzn::uuid_t& uuid,
+            std::chrono::microseconds group_commit_window = std::chrono::microseconds{0},
+            size_t group_commit_max_batch = DEFAULT_GROUP_COMMIT_MAX_BATCH,
+            std::shared_ptr<bzn::monitor_base> monitor = nullptr, bool hash_state = false);
+
+        ~rocksdb_storage();
 
         bzn::storage_result create(const bzn::uuid_t& uuid, const bzn::key_t& key, const bzn::value_t& value) override;
 
+        bzn::storage_result create_batch(const std::vector<bzn::storage_record_t>& records) override;
+
         std::optional<bzn::value_t> read(const bzn::uuid_t& uuid, const bzn::key_t& key) override;
 
         bzn::storage_result update(const bzn::uuid_t& uuid, const bzn::key_t& key, const bzn::value_t& value) override;
@@ -46,11 +70,26 @@ namespace bzn
 
         bzn::storage_result remove(const bzn::uuid_t& uuid) override;
 
-        bool create_snapshot() override;
+        bool create_snapshot(uint64_t checkpoint = 0) override;
 
         std::shared_ptr<std::string> get_snapshot() override;
 
-        bool load_snapshot(const std::string& data) override;
+        bool load_snapshot(const std::string& data, const bzn::hash_t& state_hash = {}) override;
+
+        std::optional<bzn::snapshot_chunk_t> get_snapshot_chunk(uint64_t checkpoint, uint64_t offset, size_t max_size)
+            override;
+
+        bool load_snapshot_chunk(uint64_t checkpoint, uint64_t offset, const std::string& data, uint64_t total_size,
+            bool delta, const bzn::hash_t& state_hash = {}) override;
+
+        std::vector<bzn::hash_t> get_state_manifest() override;
+
+        std::optional<bzn::snapshot_chunk_t> get_snapshot_delta_chunk(uint64_t checkpoint,
+            const std::vector<bzn::hash_t>& manifest, uint64_t offset, size_t max_size) override;
+
+        bzn::hash_t get_state_hash() override;
+
+        void set_local_namespaces(const std::vector<bzn::uuid_t>& uuids) override;
 
         void remove_range(const bzn::uuid_t& uuid, const bzn::key_t& first, const bzn::key_t& last) override;
 
@@ -65,10 +104,82 @@ namespace bzn
     private:
         void open();
 
+        // key layout...
+        void select_key_encoding();
+        bool migrate_legacy_keys();
+        bzn::key_t generate_key(const bzn::uuid_t& uuid, const bzn::key_t& key) const;
+        bzn::key_t metadata_namespace(const bzn::uuid_t& uuid, const bzn::key_t& metadata_key) const;
+
+        bool legacy_key_encoding = false;
+
+        // state digests, maintained by every write if the state is hashed...
+        void load_state_digests();
+        void rebuild_state_digests();
+        void drop_state_digests();
+        rocksdb::Status write_batch(rocksdb::WriteBatch& batch, const rocksdb::WriteOptions& write_options,
+            const std::map<size_t, bzn::hash_t>& removed_digests = {});
+
+        const bool hash_state;
+        std::vector<bzn::hash_t> state_digests;
+        uint64_t digest_generation = 0;
+        std::vector<bzn::uuid_t> local_namespaces;
+        bool local_namespaces_configured = false;
+
         // metadata....
-        void update_metadata_size(const bzn::uuid_t& uuid, const bzn::key_t& metadata_key, const bzn::key_t& key,uint32_t size);
-        void delete_metadata_size(const bzn::uuid_t& uuid, const bzn::key_t& meta_key, const bzn::key_t& key);
+        void update_metadata_size(rocksdb::WriteBatch& batch, const bzn::uuid_t& uuid, const bzn::key_t& metadata_key, const bzn::key_t& key, uint32_t size);
+        void delete_metadata_size(rocksdb::WriteBatch& batch, const bzn::uuid_t& uuid, const bzn::key_t& meta_key, const bzn::key_t& key);
         uint32_t get_metadata_size(const bzn::uuid_t& uuid, const bzn::key_t& meta_key, const bzn::key_t& key);
+        void update_key_count(rocksdb::WriteBatch& batch, const bzn::uuid_t& uuid, uint64_t count);
+        uint64_t get_key_count(const bzn::uuid_t& uuid);
+
+        // records removed by range tombstones are counted and digested from a snapshot of what the tombstones
+        // covered, without holding the write lock...
+        struct removed_records
+        {
+            uint64_t keys = 0;
+            uint64_t bytes = 0;
+        };
+
+        removed_records count_removed(const rocksdb::Snapshot* covered, const bzn::key_t& begin, const bzn::key_t& end,
+            size_t prefix_size, const std::vector<bzn::uuid_t>& local_namespaces, std::map<size_t, bzn::hash_t>* digests);
+        const rocksdb::Snapshot* take_covered_snapshot();
+        void release_covered_snapshot(const rocksdb::Snapshot* covered);
+        void settle_range_accounting();
+
+        std::mutex range_accounting_lock;
+        std::condition_variable range_accounting_cv;
+        size_t range_accounting_in_progress = 0;
+        uint64_t open_generation = 0;
+
+        rocksdb::Status commit(rocksdb::WriteBatch& batch, std::unique_lock<std::shared_mutex>& write_lock,
+            const std::map<size_t, bzn::hash_t>& removed_digests = {});
+
+        // group commit...
+        rocksdb::Status group_commit_sync(uint64_t ticket);
+        rocksdb::Status group_commit_result(uint64_t ticket);
+        void group_commit_drain();
+        void wait_for_durable_writes();
+
+        // a failed sync, kept until every writer whose ticket it covered has collected it
+        struct group_commit_failure
+        {
+            uint64_t first_ticket;
+            rocksdb::Status status;
+            uint64_t uncollected;
+        };
+
+        const std::chrono::microseconds group_commit_window;
+        const size_t group_commit_max_batch;
+        const std::shared_ptr<bzn::monitor_base> monitor;
+
+        std::mutex group_commit_lock;
+        std::condition_variable group_commit_cv;
+        uint64_t group_commit_last_ticket = 0;
+        uint64_t group_commit_synced_ticket = 0;
+        uint64_t group_commit_count = 0;
+        bool group_commit_in_progress = false;
+        size_t group_commit_readers_waiting = 0;
+        std::map<uint64_t, group_commit_failure> group_commit_failures; // by last ticket covered
 
         const std::string db_path;
         const std::string snapshot_file;
@@ -84,6 +195,66 @@ namespace bzn
             std::function<void(const bzn::key_t&, const bzn::value_t&)> action);
 
         void db_flush() const;
+
+        // a delta for a manifest, built on the exporter thread; no file if it would not have been worthwhile...
+        struct snapshot_delta
+        {
+            std::vector<bzn::hash_t> manifest;
+            std::string file;
+            bool built = false;
+        };
+
+        // an exported snapshot and the checkpoint it came from, which is kept to build deltas against the manifests
+        // of lagging replicas...
+        struct snapshot_export
+        {
+            std::string file;
+            std::string checkpoint_dir;
+            std::chrono::steady_clock::time_point last_served;
+
+            // guarded by snapshot_delta_lock
+            std::vector<bzn::hash_t> manifest;
+            std::list<snapshot_delta> deltas; // most recently requested first
+        };
+
+        // snapshots are taken as rocksdb checkpoints and exported in the background, to a file per checkpoint
+        // sequence; chunks are only ever served from a finished export...
+        void export_snapshots();
+        void start_snapshot_exporter();
+        void wait_for_snapshot_export();
+        bool snapshot_export_pending(uint64_t checkpoint) const;
+        std::string snapshot_export_file(uint64_t checkpoint) const;
+        void prune_snapshot_exports();
+        void remove_snapshot_export(const snapshot_export& snapshot);
+        bool load_snapshot_file(const std::string& snapshot_path, const bzn::hash_t& state_hash);
+
+        std::mutex snapshot_lock;
+        std::condition_variable snapshot_cv;
+        std::thread snapshot_exporter;
+        std::string pending_checkpoint;
+        std::optional<uint64_t> pending_checkpoint_sequence;
+        std::optional<uint64_t> exporting_checkpoint_sequence;
+        uint64_t snapshot_generation = 0;
+        bool snapshot_exporting = false;
+        bool snapshot_deltas_requested = false;
+
+        // by checkpoint sequence; entries are only added or removed by the exporter thread (or before it first runs),
+        // holding snapshot_delta_lock and snapshot_lock...
+        std::map<uint64_t, snapshot_export> snapshot_exports;
+
+        bool build_next_snapshot_delta();
+        bool build_snapshot_delta(const snapshot_export& snapshot, std::vector<bzn::hash_t>& snapshot_manifest,
+            const std::vector<bzn::hash_t>& manifest, const std::vector<bzn::uuid_t>& local_namespaces,
+            const std::string& delta_file);
+        bool apply_snapshot_delta(const std::string& delta_file, const bzn::hash_t& state_hash);
+        void remove_stale_checkpoints();
+
+        std::mutex snapshot_delta_lock;
+        uint64_t snapshot_delta_count = 0;
+
+        // chunks being received are staged in a file named for the checkpoint they are of, one transfer at a time...
+        std::mutex snapshot_transfer_lock;
+        std::string snapshot_transfer_file;
     };
 
 } // bzn
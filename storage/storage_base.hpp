@@ -59,6 +59,20 @@ namespace bzn
         {storage_result::invalid_argument,"INVALID_ARGUMENT"},
         {storage_result::invalid_size,    "INVALID_SIZE_LIMITS_SET"}};
 
+    struct snapshot_chunk_t
+    {
+        std::string data;
+        uint64_t total_size = 0; // of the whole snapshot the chunk was read from
+        bool not_ready = false; // the snapshot is still being exported, so ask again later
+    };
+
+    struct storage_record_t
+    {
+        bzn::uuid_t uuid;
+        bzn::key_t key;
+        bzn::value_t value;
+    };
+
 
     class storage_base
     {
@@ -67,6 +81,12 @@ namespace bzn
 
         virtual bzn::storage_result create(const bzn::uuid_t& uuid, const bzn::key_t& key, const bzn::value_t& value) = 0;
 
+        /*
+         * Create records in any namespaces with a single write (and a single sync). Records that already exist are
+         * left as they are. Nothing is written if any record is too large.
+         */
+        virtual bzn::storage_result create_batch(const std::vector<bzn::storage_record_t>& records) = 0;
+
         virtual std::optional<bzn::value_t> read(const bzn::uuid_t& uuid, const bzn::key_t& key) = 0;
 
         virtual bzn::storage_result update(const bzn::uuid_t& uuid, const bzn::key_t& key, const bzn::value_t& value) = 0;
@@ -83,11 +103,62 @@ namespace bzn
 
         virtual bzn::storage_result remove(const bzn::uuid_t& uuid) = 0;
 
-        virtual bool create_snapshot() = 0;
+        /*
+         * Take a snapshot of the stored records as of the given checkpoint. It may be exported in the background, so
+         * chunks of it are only served once that has finished.
+         */
+        virtual bool create_snapshot(uint64_t checkpoint = 0) = 0;
 
         virtual std::shared_ptr<std::string> get_snapshot() = 0;
 
-        virtual bool load_snapshot(const std::string& data) = 0;
+        /*
+         * Replace the stored records with those of a snapshot. If state_hash is given and this storage hashes its
+         * state, the snapshot is only kept if its records hash to state_hash.
+         */
+        virtual bool load_snapshot(const std::string& data, const bzn::hash_t& state_hash = {}) = 0;
+
+        /*
+         * Read up to max_size bytes of the snapshot taken at checkpoint starting at offset. Never waits for an
+         * export: the chunk is marked not_ready while the snapshot is still being exported, and std::nullopt means
+         * there is no snapshot of that checkpoint.
+         */
+        virtual std::optional<bzn::snapshot_chunk_t> get_snapshot_chunk(uint64_t checkpoint, uint64_t offset,
+            size_t max_size) = 0;
+
+        /*
+         * Stage a chunk of the snapshot taken at checkpoint (or of a delta from get_snapshot_delta_chunk) being
+         * received in order. Once the chunk ending at total_size is staged the snapshot is loaded just as
+         * load_snapshot() would, or the delta is applied (and checked against state_hash the same way). Returns false
+         * if the chunk does not follow the staged data.
+         */
+        virtual bool load_snapshot_chunk(uint64_t checkpoint, uint64_t offset, const std::string& data,
+            uint64_t total_size, bool delta, const bzn::hash_t& state_hash = {}) = 0;
+
+        /*
+         * Digests of the stored records, split into ranges by key, to compare against a snapshot. Empty if this
+         * storage cannot apply snapshot deltas.
+         */
+        virtual std::vector<bzn::hash_t> get_state_manifest() = 0;
+
+        /*
+         * Like get_snapshot_chunk() but reads a delta holding only the ranges of the snapshot taken at checkpoint
+         * whose digests differ from manifest. std::nullopt if the delta would not be much smaller than the snapshot
+         * itself.
+         */
+        virtual std::optional<bzn::snapshot_chunk_t> get_snapshot_delta_chunk(uint64_t checkpoint,
+            const std::vector<bzn::hash_t>& manifest, uint64_t offset, size_t max_size) = 0;
+
+        /*
+         * Root of a hash tree over the state manifest, maintained as records are written so that it is cheap to
+         * take at every checkpoint. Empty if this storage does not hash its state.
+         */
+        virtual bzn::hash_t get_state_hash() = 0;
+
+        /*
+         * Namespaces whose contents are particular to this node (such as local expiry times) and are left out of
+         * the state hash, the manifest and snapshot deltas.
+         */
+        virtual void set_local_namespaces(const std::vector<bzn::uuid_t>& uuids) = 0;
 
         virtual void remove_range(const bzn::uuid_t& uuid, const bzn::key_t& first, const bzn::key_t& last) = 0;
 
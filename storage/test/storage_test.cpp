@@ -20,8 +20,10 @@
 #include <boost/filesystem.hpp>
 #include <boost/format.hpp>
 #include <cstdlib>
+#include <limits>
 #include <regex>
 #include <boost/range/irange.hpp>
+#include <thread>
 
 using namespace ::testing;
 
@@ -250,6 +252,26 @@ TYPED_TEST(storageTest, test_has_returns_true_if_key_exists_false_otherwise)
 }
 
 
+TYPED_TEST(storageTest, test_has_only_matches_exact_keys)
+{
+    const bzn::uuid_t user_0{"b9dc2595-15ee-435a-8af7-7cafc132f527"};
+
+    EXPECT_EQ(bzn::storage_result::ok, this->storage->create(user_0, "key", "value"));
+    EXPECT_EQ(bzn::storage_result::ok, this->storage->create(user_0, "key10", "value"));
+
+    EXPECT_TRUE(this->storage->has(user_0, "key"));
+    EXPECT_TRUE(this->storage->has(user_0, "key10"));
+    EXPECT_FALSE(this->storage->has(user_0, "ke"));
+    EXPECT_FALSE(this->storage->has(user_0, "key1"));
+    EXPECT_FALSE(this->storage->has(user_0, "key100"));
+
+    EXPECT_EQ(bzn::storage_result::ok, this->storage->remove(user_0, "key"));
+    EXPECT_FALSE(this->storage->has(user_0, "key"));
+    EXPECT_TRUE(this->storage->has(user_0, "key10"));
+    EXPECT_EQ(bzn::storage_result::ok, this->storage->create(user_0, "key", "value"));
+}
+
+
 TYPED_TEST(storageTest, test_that_storage_fails_to_create_a_value_that_exceeds_the_size_limit)
 {
     std::string value{""};
@@ -259,6 +281,31 @@ TYPED_TEST(storageTest, test_that_storage_fails_to_create_a_value_that_exceeds_t
 }
 
 
+TYPED_TEST(storageTest, test_that_storage_creates_a_batch_of_records_across_namespaces)
+{
+    const bzn::uuid_t OTHER_UUID{"other_uuid"};
+
+    EXPECT_EQ(bzn::storage_result::ok, this->storage->create(USER_UUID, "key1", "old"));
+
+    // records that exist are left alone, and repeats within the batch are written once
+    EXPECT_EQ(bzn::storage_result::ok, this->storage->create_batch({{USER_UUID, "key1", "new"}, {USER_UUID, "key2", "value2"},
+        {OTHER_UUID, "key1", "other"}, {OTHER_UUID, "key1", "other"}}));
+
+    EXPECT_EQ("old", *this->storage->read(USER_UUID, "key1"));
+    EXPECT_EQ("value2", *this->storage->read(USER_UUID, "key2"));
+    EXPECT_EQ("other", *this->storage->read(OTHER_UUID, "key1"));
+    EXPECT_EQ(std::make_pair(std::size_t(2), std::size_t(4 + 3 + 4 + 6)), this->storage->get_size(USER_UUID));
+    EXPECT_EQ(std::make_pair(std::size_t(1), std::size_t(4 + 5)), this->storage->get_size(OTHER_UUID));
+
+    // nothing is written if a record is too large
+    std::string value;
+    value.resize(bzn::MAX_VALUE_SIZE+1, 'c');
+    EXPECT_EQ(bzn::storage_result::value_too_large, this->storage->create_batch({{USER_UUID, "key3", "value3"},
+        {USER_UUID, "key4", value}}));
+    EXPECT_FALSE(this->storage->has(USER_UUID, "key3"));
+}
+
+
 TYPED_TEST(storageTest, test_that_storage_fails_to_update_with_a_value_that_exceeds_the_size_limit)
 {
     std::string expected_value{"gooddata"};
@@ -280,6 +327,14 @@ TYPED_TEST(storageTest, test_that_storage_can_remove_all_keys_values_associated_
     EXPECT_EQ(bzn::storage_result::ok, this->storage->create(USER_UUID, "key3", ""));
     EXPECT_EQ(bzn::storage_result::ok, this->storage->remove(USER_UUID));
     EXPECT_EQ(std::nullopt, this->storage->read(USER_UUID, KEY));
+    EXPECT_EQ(std::nullopt, this->storage->read(USER_UUID, "key1"));
+    EXPECT_TRUE(this->storage->get_keys(USER_UUID).empty());
+    EXPECT_EQ(this->storage->get_size(USER_UUID), std::make_pair(size_t(0), size_t(0)));
+    EXPECT_EQ(bzn::storage_result::not_found, this->storage->remove(USER_UUID));
+
+    // the database can be recreated...
+    EXPECT_EQ(bzn::storage_result::ok, this->storage->create(USER_UUID, "key1", "value"));
+    EXPECT_EQ(this->storage->get_size(USER_UUID), std::make_pair(size_t(1), std::string("key1value").size()));
 }
 
 
@@ -306,6 +361,61 @@ TYPED_TEST(storageTest, test_snapshot)
     EXPECT_FALSE(this->storage->has(user_0, "key3"));
 }
 
+TYPED_TEST(storageTest, test_snapshot_chunks)
+{
+    const bzn::uuid_t user_0{"b9dc2595-15ee-435a-8af7-7cafc132f527"};
+
+    this->storage->create(user_0, "key1", "value1");
+    EXPECT_TRUE(this->storage->create_snapshot(100));
+
+    // the snapshot may still be being exported, which is never waited for...
+    EXPECT_TRUE(this->storage->get_snapshot_chunk(100, 0, 16));
+    EXPECT_FALSE(this->storage->get_snapshot_chunk(200, 0, 16));
+
+    this->storage->create(user_0, "key2", "value2");
+
+    // ...but once it has been, read it back in small chunks
+    EXPECT_NE(this->storage->get_snapshot(), nullptr);
+
+    std::vector<bzn::snapshot_chunk_t> chunks;
+    uint64_t offset = 0;
+    do
+    {
+        auto chunk = this->storage->get_snapshot_chunk(100, offset, 16);
+        ASSERT_TRUE(chunk);
+        ASSERT_FALSE(chunk->not_ready);
+        ASSERT_FALSE(chunk->data.empty());
+        offset += chunk->data.size();
+        chunks.emplace_back(std::move(*chunk));
+    }
+    while (offset < chunks.back().total_size);
+
+    EXPECT_EQ(offset, this->storage->get_snapshot()->size());
+    EXPECT_FALSE(this->storage->get_snapshot_chunk(100, offset + 1, 16));
+
+    // chunks must follow on from each other...
+    ASSERT_GT(chunks.size(), 1u);
+    EXPECT_FALSE(this->storage->load_snapshot_chunk(100, 16, chunks[1].data, offset, false));
+
+    // ...and be of the same checkpoint
+    EXPECT_TRUE(this->storage->load_snapshot_chunk(100, 0, chunks[0].data, offset, false));
+    EXPECT_FALSE(this->storage->load_snapshot_chunk(200, chunks[0].data.size(), chunks[1].data, offset, false));
+
+    offset = 0;
+    for (const auto& chunk : chunks)
+    {
+        EXPECT_TRUE(this->storage->load_snapshot_chunk(100, offset, chunk.data, chunk.total_size, false));
+
+        // nothing is replaced until the last chunk arrives...
+        offset += chunk.data.size();
+        EXPECT_EQ(this->storage->has(user_0, "key2"), offset < chunk.total_size);
+    }
+
+    EXPECT_TRUE(this->storage->has(user_0, "key1"));
+    EXPECT_FALSE(this->storage->has(user_0, "key2"));
+}
+
+
 TYPED_TEST(storageTest, test_range_queries)
 {
     const bzn::uuid_t user_0{"b9dc2595-15ee-435a-8af7-7cafc132f527"};
@@ -334,6 +444,7 @@ TYPED_TEST(storageTest, test_range_queries)
 
     this->storage->remove_range(user_0, "be", "z");
     EXPECT_EQ(this->storage->get_size(user_0).first, 2u);
+    EXPECT_EQ(this->storage->get_size(user_0).second, 2 * std::string("bddvalue").size());
 }
 
 TYPED_TEST(storageTest, test_predicate_queries)
@@ -437,3 +548,541 @@ TYPED_TEST(storageTest, test_regex_match_queries)
     EXPECT_EQ(this->storage->read_if(user_0, "0002", "", match_key3).size(), 6u);
     EXPECT_EQ(this->storage->read_if(user_0, "0002", "0006", match_key3).size(), 4u);
 }
+
+
+TEST(rocksdb_storage, test_group_commit_with_concurrent_writers)
+{
+    if (system(std::string("rm -r -f " + NODE_UUID).c_str())) {}
+
+    {
+        bzn::rocksdb_storage storage("./", "utest", NODE_UUID, std::chrono::microseconds{500}, 8);
+
+        const size_t WRITERS = 8;
+        const size_t WRITES_PER_WRITER = 50;
+
+        std::vector<std::thread> writers;
+        for (size_t w = 0; w < WRITERS; ++w)
+        {
+            writers.emplace_back([&storage, w]()
+            {
+                for (size_t i = 0; i < WRITES_PER_WRITER; ++i)
+                {
+                    const auto key = "key_" + std::to_string(w) + "_" + std::to_string(i);
+                    EXPECT_EQ(bzn::storage_result::ok, storage.create(USER_UUID, key, "value"));
+                }
+            });
+        }
+
+        for (auto& writer : writers)
+        {
+            writer.join();
+        }
+
+        EXPECT_EQ(WRITERS * WRITES_PER_WRITER, storage.get_size(USER_UUID).first);
+        EXPECT_TRUE(storage.has(USER_UUID, "key_7_49"));
+
+        // snapshot loading has to wait for pending syncs...
+        EXPECT_TRUE(storage.create_snapshot());
+        EXPECT_EQ(bzn::storage_result::ok, storage.update(USER_UUID, "key_0_0", "new value"));
+        EXPECT_TRUE(storage.load_snapshot(*storage.get_snapshot()));
+        EXPECT_EQ("value", *storage.read(USER_UUID, "key_0_0"));
+    }
+
+    if (system(std::string("rm -r -f " + NODE_UUID).c_str())) {}
+}
+
+
+TEST(rocksdb_storage, test_readers_wait_for_the_group_commit_sync_of_what_they_read)
+{
+    if (system(std::string("rm -r -f " + NODE_UUID).c_str())) {}
+
+    {
+        // a window no test would wait out, so only a waiting reader can end it early
+        bzn::rocksdb_storage storage("./", "utest", NODE_UUID, std::chrono::seconds{30}, 64);
+
+        const auto start = std::chrono::steady_clock::now();
+        std::thread writer([&storage]()
+        {
+            EXPECT_EQ(bzn::storage_result::ok, storage.create(USER_UUID, KEY, "value"));
+        });
+
+        while (!storage.has(USER_UUID, KEY))
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        writer.join();
+        EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds{10});
+        EXPECT_EQ("value", *storage.read(USER_UUID, KEY));
+    }
+
+    if (system(std::string("rm -r -f " + NODE_UUID).c_str())) {}
+}
+
+
+TEST(rocksdb_storage, test_checkpoints_left_by_an_earlier_run_are_removed)
+{
+    if (system(std::string("rm -r -f " + NODE_UUID).c_str())) {}
+
+    const auto stale = boost::filesystem::path(NODE_UUID).append("SNAPSHOT.utest.checkpoint.7");
+    const auto exported = boost::filesystem::path(NODE_UUID).append("SNAPSHOT.utest.checkpoint");
+
+    boost::filesystem::create_directories(stale);
+    boost::filesystem::create_directories(exported);
+
+    {
+        bzn::rocksdb_storage storage("./", "utest", NODE_UUID);
+
+        EXPECT_FALSE(boost::filesystem::exists(stale));
+        EXPECT_TRUE(boost::filesystem::exists(exported));
+    }
+
+    if (system(std::string("rm -r -f " + NODE_UUID).c_str())) {}
+}
+
+
+TEST(rocksdb_storage, test_remove_range_keeps_counts_exact_with_concurrent_writers)
+{
+    if (system(std::string("rm -r -f " + NODE_UUID).c_str())) {}
+
+    {
+        bzn::rocksdb_storage storage("./", "utest", NODE_UUID);
+
+        for (size_t i = 0; i < 500; ++i)
+        {
+            EXPECT_EQ(bzn::storage_result::ok, storage.create(USER_UUID, "a" + std::to_string(1000 + i), "value"));
+        }
+
+        // removed records are counted without the write lock, so writers get in while the range is sized...
+        std::thread writer([&storage]()
+        {
+            for (size_t i = 0; i < 100; ++i)
+            {
+                EXPECT_EQ(bzn::storage_result::ok, storage.create(USER_UUID, "b" + std::to_string(i), "value"));
+            }
+        });
+
+        storage.remove_range(USER_UUID, "a", "b");
+        writer.join();
+
+        EXPECT_EQ(storage.get_size(USER_UUID), std::make_pair(size_t(100),
+            90 * std::string("b10value").size() + 10 * std::string("b1value").size()));
+    }
+
+    if (system(std::string("rm -r -f " + NODE_UUID).c_str())) {}
+}
+
+
+TEST(rocksdb_storage, test_snapshot_delta_only_carries_changed_ranges)
+{
+    const bzn::uuid_t sender_uuid{"delta-sender-" + NODE_UUID};
+    const bzn::uuid_t receiver_uuid{"delta-receiver-" + NODE_UUID};
+
+    if (system(std::string("rm -r -f " + sender_uuid + " " + receiver_uuid).c_str())) {}
+
+    {
+        bzn::rocksdb_storage sender("./", "utest", sender_uuid, std::chrono::microseconds{0},
+            bzn::DEFAULT_GROUP_COMMIT_MAX_BATCH, nullptr, true);
+        bzn::rocksdb_storage receiver("./", "utest", receiver_uuid, std::chrono::microseconds{0},
+            bzn::DEFAULT_GROUP_COMMIT_MAX_BATCH, nullptr, true);
+
+        for (size_t i = 0; i < 200; ++i)
+        {
+            const auto key = "key" + std::to_string(i);
+            const auto value = generate_test_string(1000);
+
+            EXPECT_EQ(sender.create(USER_UUID, key, value), bzn::storage_result::ok);
+            EXPECT_EQ(receiver.create(USER_UUID, key, value), bzn::storage_result::ok);
+        }
+
+        EXPECT_EQ(sender.get_state_manifest(), receiver.get_state_manifest());
+
+        // the receiver falls behind...
+        EXPECT_EQ(sender.update(USER_UUID, "key1", "updated"), bzn::storage_result::ok);
+        EXPECT_EQ(sender.remove(USER_UUID, "key2"), bzn::storage_result::ok);
+        EXPECT_EQ(sender.create(USER_UUID, "new_key", "new_value"), bzn::storage_result::ok);
+        EXPECT_EQ(receiver.create(USER_UUID, "stray_key", "stray_value"), bzn::storage_result::ok);
+        EXPECT_TRUE(sender.create_snapshot(100));
+        EXPECT_NE(sender.get_snapshot(), nullptr);
+
+        // the delta is built on the exporter thread, so the first request only asks for it...
+        auto delta = sender.get_snapshot_delta_chunk(100, receiver.get_state_manifest(), 0,
+            std::numeric_limits<size_t>::max());
+        ASSERT_TRUE(delta);
+        EXPECT_TRUE(delta->not_ready);
+        EXPECT_NE(sender.get_snapshot(), nullptr);
+
+        delta = sender.get_snapshot_delta_chunk(100, receiver.get_state_manifest(), 0,
+            std::numeric_limits<size_t>::max());
+        ASSERT_TRUE(delta);
+        ASSERT_FALSE(delta->not_ready);
+        EXPECT_EQ(delta->data.size(), delta->total_size);
+        EXPECT_LT(delta->total_size, sender.get_snapshot()->size() / 2);
+
+        EXPECT_TRUE(receiver.load_snapshot_chunk(100, 0, delta->data, delta->total_size, true));
+
+        EXPECT_EQ(*receiver.read(USER_UUID, "key1"), "updated");
+        EXPECT_FALSE(receiver.has(USER_UUID, "key2"));
+        EXPECT_EQ(*receiver.read(USER_UUID, "new_key"), "new_value");
+        EXPECT_FALSE(receiver.has(USER_UUID, "stray_key"));
+        EXPECT_EQ(receiver.get_size(USER_UUID), sender.get_size(USER_UUID));
+        EXPECT_EQ(receiver.get_state_manifest(), sender.get_state_manifest());
+
+        // a replica with nothing in common gets the full snapshot instead...
+        const std::vector<bzn::hash_t> unrelated(receiver.get_state_manifest().size());
+        EXPECT_TRUE(sender.get_snapshot_delta_chunk(100, unrelated, 0, std::numeric_limits<size_t>::max()));
+        EXPECT_NE(sender.get_snapshot(), nullptr);
+        EXPECT_FALSE(sender.get_snapshot_delta_chunk(100, unrelated, 0, std::numeric_limits<size_t>::max()));
+    }
+
+    if (system(std::string("rm -r -f " + sender_uuid + " " + receiver_uuid).c_str())) {}
+}
+
+
+TEST(rocksdb_storage, test_snapshot_delta_that_does_not_lead_to_the_snapshot_is_not_applied)
+{
+    const bzn::uuid_t sender_uuid{"delta-sender-" + NODE_UUID};
+    const bzn::uuid_t receiver_uuid{"delta-receiver-" + NODE_UUID};
+
+    if (system(std::string("rm -r -f " + sender_uuid + " " + receiver_uuid).c_str())) {}
+
+    {
+        bzn::rocksdb_storage sender("./", "utest", sender_uuid, std::chrono::microseconds{0},
+            bzn::DEFAULT_GROUP_COMMIT_MAX_BATCH, nullptr, true);
+        bzn::rocksdb_storage receiver("./", "utest", receiver_uuid, std::chrono::microseconds{0},
+            bzn::DEFAULT_GROUP_COMMIT_MAX_BATCH, nullptr, true);
+
+        for (size_t i = 0; i < 200; ++i)
+        {
+            const auto key = "key" + std::to_string(i);
+            const auto value = generate_test_string(1000);
+
+            EXPECT_EQ(sender.create(USER_UUID, key, value), bzn::storage_result::ok);
+            EXPECT_EQ(receiver.create(USER_UUID, key, value), bzn::storage_result::ok);
+        }
+
+        EXPECT_EQ(sender.update(USER_UUID, "key1", "updated"), bzn::storage_result::ok);
+        EXPECT_TRUE(sender.create_snapshot(100));
+        EXPECT_NE(sender.get_snapshot(), nullptr);
+
+        EXPECT_TRUE(sender.get_snapshot_delta_chunk(100, receiver.get_state_manifest(), 0,
+            std::numeric_limits<size_t>::max()));
+        EXPECT_NE(sender.get_snapshot(), nullptr);
+
+        auto delta = sender.get_snapshot_delta_chunk(100, receiver.get_state_manifest(), 0,
+            std::numeric_limits<size_t>::max());
+        ASSERT_TRUE(delta);
+        ASSERT_FALSE(delta->not_ready);
+
+        // the receiver moves on from the manifest it asked with...
+        for (size_t i = 0; i < 20; ++i)
+        {
+            EXPECT_EQ(receiver.create(USER_UUID, "late" + std::to_string(i), "value"), bzn::storage_result::ok);
+        }
+
+        const auto manifest = receiver.get_state_manifest();
+
+        EXPECT_FALSE(receiver.load_snapshot_chunk(100, 0, delta->data, delta->total_size, true));
+        EXPECT_NE(*receiver.read(USER_UUID, "key1"), "updated");
+        EXPECT_TRUE(receiver.has(USER_UUID, "late0"));
+        EXPECT_EQ(receiver.get_state_manifest(), manifest);
+    }
+
+    if (system(std::string("rm -r -f " + sender_uuid + " " + receiver_uuid).c_str())) {}
+}
+
+
+TEST(rocksdb_storage, test_state_hash_tracks_writes_and_ignores_local_namespaces)
+{
+    const bzn::uuid_t uuid_a{"hash-a-" + NODE_UUID};
+    const bzn::uuid_t uuid_b{"hash-b-" + NODE_UUID};
+    const bzn::uuid_t uuid_c{"hash-c-" + NODE_UUID};
+    const bzn::uuid_t LOCAL_UUID{"TTL"};
+
+    if (system(std::string("rm -r -f " + uuid_a + " " + uuid_b + " " + uuid_c).c_str())) {}
+
+    bzn::hash_t hash;
+    {
+        bzn::rocksdb_storage a("./", "utest", uuid_a, std::chrono::microseconds{0},
+            bzn::DEFAULT_GROUP_COMMIT_MAX_BATCH, nullptr, true);
+        bzn::rocksdb_storage b("./", "utest", uuid_b, std::chrono::microseconds{0},
+            bzn::DEFAULT_GROUP_COMMIT_MAX_BATCH, nullptr, true);
+        bzn::rocksdb_storage empty("./", "utest", uuid_c, std::chrono::microseconds{0},
+            bzn::DEFAULT_GROUP_COMMIT_MAX_BATCH, nullptr, true);
+
+        for (auto storage : {&a, &b, &empty})
+        {
+            storage->set_local_namespaces({LOCAL_UUID});
+        }
+
+        EXPECT_FALSE(a.get_state_hash().empty());
+        EXPECT_EQ(a.get_state_hash(), empty.get_state_hash());
+
+        // the order of writes does not matter...
+        for (size_t i = 0; i < 50; ++i)
+        {
+            EXPECT_EQ(a.create(USER_UUID, "key" + std::to_string(i), "value" + std::to_string(i)), bzn::storage_result::ok);
+            EXPECT_EQ(b.create(USER_UUID, "key" + std::to_string(49 - i), "value" + std::to_string(49 - i)), bzn::storage_result::ok);
+        }
+
+        EXPECT_EQ(a.get_state_hash(), b.get_state_hash());
+        EXPECT_NE(a.get_state_hash(), empty.get_state_hash());
+
+        // ...nor do local namespaces...
+        EXPECT_EQ(a.create(LOCAL_UUID, "key1", "local"), bzn::storage_result::ok);
+        EXPECT_EQ(a.get_state_hash(), b.get_state_hash());
+        EXPECT_EQ(a.get_state_manifest(), b.get_state_manifest());
+
+        // ...but every change of state does
+        const auto before = a.get_state_hash();
+        EXPECT_EQ(a.update(USER_UUID, "key1", "changed"), bzn::storage_result::ok);
+        EXPECT_NE(a.get_state_hash(), before);
+        EXPECT_EQ(a.update(USER_UUID, "key1", "value1"), bzn::storage_result::ok);
+        EXPECT_EQ(a.get_state_hash(), before);
+
+        a.remove_range(USER_UUID, "key2", "key3");
+        EXPECT_NE(a.get_state_hash(), b.get_state_hash());
+        b.remove_range(USER_UUID, "key2", "key3");
+        EXPECT_EQ(a.get_state_hash(), b.get_state_hash());
+
+        EXPECT_EQ(a.remove(USER_UUID), bzn::storage_result::ok);
+        EXPECT_EQ(a.get_state_hash(), empty.get_state_hash());
+
+        EXPECT_EQ(b.remove(USER_UUID, "key40"), bzn::storage_result::ok);
+        hash = b.get_state_hash();
+    }
+
+    // the digests are kept with the data...
+    {
+        bzn::rocksdb_storage b("./", "utest", uuid_b, std::chrono::microseconds{0},
+            bzn::DEFAULT_GROUP_COMMIT_MAX_BATCH, nullptr, true);
+        b.set_local_namespaces({LOCAL_UUID});
+
+        EXPECT_EQ(b.get_state_hash(), hash);
+    }
+
+    if (system(std::string("rm -r -f " + uuid_a + " " + uuid_b + " " + uuid_c).c_str())) {}
+}
+
+
+TEST(rocksdb_storage, test_snapshot_is_only_loaded_if_it_hashes_to_the_expected_state)
+{
+    if (system(std::string("rm -r -f " + NODE_UUID).c_str())) {}
+
+    {
+        bzn::rocksdb_storage storage("./", "utest", NODE_UUID, std::chrono::microseconds{0},
+            bzn::DEFAULT_GROUP_COMMIT_MAX_BATCH, nullptr, true);
+
+        EXPECT_EQ(storage.create(USER_UUID, "key1", "value1"), bzn::storage_result::ok);
+        EXPECT_TRUE(storage.create_snapshot());
+
+        const auto snapshot = storage.get_snapshot();
+        const auto snapshot_hash = storage.get_state_hash();
+
+        EXPECT_EQ(storage.create(USER_UUID, "key2", "value2"), bzn::storage_result::ok);
+        const auto current_hash = storage.get_state_hash();
+
+        EXPECT_FALSE(storage.load_snapshot(*snapshot, current_hash));
+        EXPECT_TRUE(storage.has(USER_UUID, "key2"));
+        EXPECT_EQ(storage.get_state_hash(), current_hash);
+
+        EXPECT_TRUE(storage.load_snapshot(*snapshot, snapshot_hash));
+        EXPECT_FALSE(storage.has(USER_UUID, "key2"));
+        EXPECT_EQ(storage.get_state_hash(), snapshot_hash);
+    }
+
+    if (system(std::string("rm -r -f " + NODE_UUID).c_str())) {}
+}
+
+
+TEST(rocksdb_storage, test_snapshots_being_transferred_are_kept)
+{
+    if (system(std::string("rm -r -f " + NODE_UUID).c_str())) {}
+
+    {
+        bzn::rocksdb_storage storage("./", "utest", NODE_UUID, std::chrono::microseconds{0},
+            bzn::DEFAULT_GROUP_COMMIT_MAX_BATCH, nullptr, true);
+
+        const auto take_snapshot = [&](uint64_t checkpoint)
+        {
+            EXPECT_EQ(storage.create(USER_UUID, "key" + std::to_string(checkpoint), "value"), bzn::storage_result::ok);
+            EXPECT_TRUE(storage.create_snapshot(checkpoint));
+            EXPECT_NE(storage.get_snapshot(), nullptr);
+        };
+
+        take_snapshot(100);
+
+        // a replica starts fetching the snapshot at 100...
+        const auto first = storage.get_snapshot_chunk(100, 0, 16);
+        ASSERT_TRUE(first);
+        ASSERT_FALSE(first->not_ready);
+
+        take_snapshot(200);
+        take_snapshot(300);
+        take_snapshot(400);
+
+        // ...so it is kept along with the latest ones, while those no one asked for are not
+        const auto second = storage.get_snapshot_chunk(100, first->data.size(), 16);
+        ASSERT_TRUE(second);
+        EXPECT_FALSE(second->not_ready);
+        EXPECT_EQ(second->total_size, first->total_size);
+        EXPECT_FALSE(storage.get_snapshot_chunk(200, 0, 16));
+        EXPECT_TRUE(storage.get_snapshot_chunk(300, 0, 16));
+        EXPECT_TRUE(storage.get_snapshot_chunk(400, 0, 16));
+    }
+
+    {
+        // the latest snapshot can still be served after a restart
+        bzn::rocksdb_storage storage("./", "utest", NODE_UUID, std::chrono::microseconds{0},
+            bzn::DEFAULT_GROUP_COMMIT_MAX_BATCH, nullptr, true);
+
+        const auto chunk = storage.get_snapshot_chunk(400, 0, 16);
+        ASSERT_TRUE(chunk);
+        EXPECT_FALSE(chunk->not_ready);
+        EXPECT_FALSE(storage.get_snapshot_chunk(300, 0, 16));
+    }
+
+    if (system(std::string("rm -r -f " + NODE_UUID).c_str())) {}
+}
+
+
+TEST(rocksdb_storage, test_state_is_only_hashed_when_asked_to)
+{
+    const bzn::uuid_t other_uuid{"hash-other-" + NODE_UUID};
+
+    if (system(std::string("rm -r -f " + NODE_UUID + " " + other_uuid).c_str())) {}
+
+    {
+        bzn::rocksdb_storage hashed("./", "utest", NODE_UUID, std::chrono::microseconds{0},
+            bzn::DEFAULT_GROUP_COMMIT_MAX_BATCH, nullptr, true);
+        EXPECT_EQ(hashed.create(USER_UUID, "key1", "value1"), bzn::storage_result::ok);
+    }
+
+    {
+        bzn::rocksdb_storage plain("./", "utest", NODE_UUID);
+
+        EXPECT_TRUE(plain.get_state_hash().empty());
+        EXPECT_TRUE(plain.get_state_manifest().empty());
+        EXPECT_EQ(plain.create(USER_UUID, "key2", "value2"), bzn::storage_result::ok);
+    }
+
+    // ...and digests from before the unhashed writes are not picked up again
+    {
+        bzn::rocksdb_storage hashed("./", "utest", NODE_UUID, std::chrono::microseconds{0},
+            bzn::DEFAULT_GROUP_COMMIT_MAX_BATCH, nullptr, true);
+        bzn::rocksdb_storage other("./", "utest", other_uuid, std::chrono::microseconds{0},
+            bzn::DEFAULT_GROUP_COMMIT_MAX_BATCH, nullptr, true);
+
+        EXPECT_EQ(other.create(USER_UUID, "key1", "value1"), bzn::storage_result::ok);
+        EXPECT_EQ(other.create(USER_UUID, "key2", "value2"), bzn::storage_result::ok);
+        EXPECT_EQ(hashed.get_state_hash(), other.get_state_hash());
+    }
+
+    if (system(std::string("rm -r -f " + NODE_UUID + " " + other_uuid).c_str())) {}
+}
+
+
+namespace
+{
+    // writes records the way storage did before keys were length prefixed
+    void write_legacy_records(const std::vector<std::pair<bzn::uuid_t, bzn::key_t>>& records)
+    {
+        const auto path = boost::filesystem::path(NODE_UUID).append("utest");
+        boost::filesystem::create_directories(path);
+
+        rocksdb::Options options;
+        options.create_if_missing = true;
+        rocksdb::DB* db;
+        ASSERT_TRUE(rocksdb::DB::Open(options, path.string(), &db).ok());
+
+        std::map<bzn::uuid_t, std::pair<size_t, size_t>> namespaces;
+        for (const auto& record : records)
+        {
+            ASSERT_TRUE(db->Put(rocksdb::WriteOptions(), record.first + record.second, "value").ok());
+            ASSERT_TRUE(db->Put(rocksdb::WriteOptions(), "METADATA" + record.first + "SIZE" + record.second,
+                std::to_string(record.second.size() + 5)).ok());
+            namespaces[record.first].first++;
+            namespaces[record.first].second += record.second.size() + 5;
+        }
+
+        for (const auto& ns : namespaces)
+        {
+            ASSERT_TRUE(db->Put(rocksdb::WriteOptions(), "METADATA" + ns.first + "NAMESPACECOUNT", std::to_string(ns.second.first)).ok());
+            ASSERT_TRUE(db->Put(rocksdb::WriteOptions(), "METADATA" + ns.first + "NAMESPACESIZE", std::to_string(ns.second.second)).ok());
+        }
+
+        delete db;
+    }
+}
+
+
+TEST(rocksdb_storage, test_legacy_key_encoding_is_migrated_on_open)
+{
+    if (system(std::string("rm -r -f " + NODE_UUID).c_str())) {}
+
+    write_legacy_records({{USER_UUID, "key1"}, {USER_UUID, "key2"}, {"other", "key1"}});
+
+    {
+        bzn::rocksdb_storage storage("./", "utest", NODE_UUID, std::chrono::microseconds{0},
+            bzn::DEFAULT_GROUP_COMMIT_MAX_BATCH, nullptr, true);
+
+        EXPECT_EQ("value", *storage.read(USER_UUID, "key1"));
+        EXPECT_EQ(storage.get_keys(USER_UUID), std::vector<bzn::key_t>({"key1", "key2"}));
+        EXPECT_EQ(storage.get_size(USER_UUID), std::make_pair(std::size_t(2), std::size_t(18)));
+        EXPECT_EQ(storage.get_key_size("other", "key1"), std::optional<std::size_t>(9));
+        EXPECT_FALSE(storage.get_state_hash().empty());
+
+        // the state hashes the same as one that was always in the new encoding
+        const bzn::uuid_t fresh_uuid{"fresh-" + NODE_UUID};
+        if (system(std::string("rm -r -f " + fresh_uuid).c_str())) {}
+        {
+            bzn::rocksdb_storage fresh("./", "utest", fresh_uuid, std::chrono::microseconds{0},
+                bzn::DEFAULT_GROUP_COMMIT_MAX_BATCH, nullptr, true);
+            fresh.create(USER_UUID, "key1", "value");
+            fresh.create(USER_UUID, "key2", "value");
+            fresh.create("other", "key1", "value");
+            EXPECT_EQ(fresh.get_state_hash(), storage.get_state_hash());
+        }
+        if (system(std::string("rm -r -f " + fresh_uuid).c_str())) {}
+    }
+
+    if (system(std::string("rm -r -f " + NODE_UUID).c_str())) {}
+}
+
+
+TEST(rocksdb_storage, test_legacy_key_encoding_is_kept_when_namespaces_are_ambiguous)
+{
+    if (system(std::string("rm -r -f " + NODE_UUID).c_str())) {}
+
+    write_legacy_records({{"user", "1key"}, {"user1", "key"}});
+
+    {
+        bzn::rocksdb_storage storage("./", "utest", NODE_UUID, std::chrono::microseconds{0},
+            bzn::DEFAULT_GROUP_COMMIT_MAX_BATCH, nullptr, true);
+
+        EXPECT_TRUE(storage.has("user1", "key"));
+        EXPECT_TRUE(storage.get_state_hash().empty());
+    }
+
+    if (system(std::string("rm -r -f " + NODE_UUID).c_str())) {}
+}
+
+
+TYPED_TEST(storageTest, test_namespaces_that_are_prefixes_of_each_other_are_isolated)
+{
+    const bzn::uuid_t user_0{"user"};
+    const bzn::uuid_t user_1{"user1"};
+
+    EXPECT_EQ(bzn::storage_result::ok, this->storage->create(user_0, "1key", "value"));
+    EXPECT_EQ(bzn::storage_result::ok, this->storage->create(user_1, "key", "value"));
+
+    EXPECT_FALSE(this->storage->has(user_1, "1key"));
+    EXPECT_EQ(this->storage->get_keys(user_0), std::vector<bzn::key_t>{"1key"});
+    EXPECT_EQ(this->storage->get_keys(user_1), std::vector<bzn::key_t>{"key"});
+    EXPECT_EQ(this->storage->get_size(user_0).first, 1u);
+    EXPECT_EQ(this->storage->read_if(user_0, "", "").size(), 1u);
+
+    EXPECT_EQ(bzn::storage_result::ok, this->storage->remove(user_0));
+    EXPECT_TRUE(this->storage->has(user_1, "key"));
+    EXPECT_EQ(this->storage->get_size(user_1).second, std::string("keyvalue").size());
+}
@@ -224,7 +224,7 @@ main(int argc, const char* argv[])
 
         // startup...
         auto monitor = std::make_shared<bzn::monitor>(options, io_context, std::make_shared<bzn::system_clock>());
-        auto crypto = std::make_shared<bzn::crypto>(options, monitor);
+        auto crypto = std::make_shared<bzn::crypto>(options, monitor, peers);
         auto chaos = std::make_shared<bzn::chaos>(io_context, options);
         auto websocket = std::make_shared<bzn::beast::websocket>();
         auto node = std::make_shared<bzn::node>(io_context, websocket, chaos, boost::asio::ip::tcp::endpoint{options->get_listener()}, crypto, options, monitor);
@@ -245,12 +245,20 @@ main(int argc, const char* argv[])
         {
             LOG(info) << "Using RocksDB storage";
 
-            stable_storage = std::make_shared<bzn::rocksdb_storage>(options->get_state_dir(), "db", options->get_uuid());
-            unstable_storage = std::make_shared<bzn::rocksdb_storage>(options->get_state_dir(), "pbft", options->get_uuid());
+            const std::chrono::microseconds group_commit_window{
+                options->get_simple_options().get<uint64_t>(bzn::option_names::STORAGE_GROUP_COMMIT_WINDOW_US)};
+            const auto group_commit_max_batch =
+                options->get_simple_options().get<size_t>(bzn::option_names::STORAGE_GROUP_COMMIT_MAX_BATCH);
+
+            // only the database state is checkpointed and transferred, so only it is hashed...
+            stable_storage = std::make_shared<bzn::rocksdb_storage>(options->get_state_dir(), "db", options->get_uuid(),
+                group_commit_window, group_commit_max_batch, monitor, true);
+            unstable_storage = std::make_shared<bzn::rocksdb_storage>(options->get_state_dir(), "pbft", options->get_uuid(),
+                group_commit_window, group_commit_max_batch, monitor);
         }
 
         auto crud = std::make_shared<bzn::crud>(io_context, stable_storage, std::make_shared<bzn::subscription_manager>(io_context), node, options->get_owner_public_key());
-        auto operation_manager = std::make_shared<bzn::pbft_operation_manager>(peers, unstable_storage);
+        auto operation_manager = std::make_shared<bzn::pbft_operation_manager>(peers, unstable_storage, monitor);
 
         auto pbft = std::make_shared<bzn::pbft>(node, io_context, peers, options,
             std::make_shared<bzn::database_pbft_service>(io_context, unstable_storage, crud, monitor, options->get_uuid())